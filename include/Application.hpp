@@ -7,10 +7,27 @@
 #include <functional>
 #include <memory>
 #include <thread>
+#include <mutex>
+#include <chrono>
+#include <vector>
+#include <tuple>
+#include <future>
+#include <condition_variable>
+#include <algorithm>
 
 #include <opencv2/opencv.hpp>
 
 #include "Message.hpp"
+#include "BitrateController.hpp"
+#include "ImageSubscription.hpp"
+#include "TiledImage.hpp"
+#include "RequestTable.hpp"
+#include "LatencyHistogram.hpp"
+#include "ClockSync.hpp"
+#include "Metrics.hpp"
+#include "Trace.hpp"
+#include "Log.hpp"
+#include "TypedMessage.hpp"
 
 #include <PHOENIX/Utils/Info/Info.hpp>
 
@@ -28,10 +45,10 @@ public:
      */
     Application(std::shared_ptr<T> &socket);
     /**
-     * @brief Application 析构函数
+     * @brief Application 析构函数, 停止时钟同步线程
      * 
      */
-    ~Application() = default;
+    ~Application();
     /**
      * @brief 添加命令
      * 
@@ -48,22 +65,172 @@ public:
      * @param data 数据区
      * @param total_lenth 数据总长度, 如果数据长度超过 10218 字节，将会分包发送 
      * @param sendto 发送目标, -1 为广播
+     * @param origin 附带时间戳时的起始时间, 例如图像的采集时间, 0 表示开始发送的时间
      * @note SocketClient 调用时，sendto 参数无效
      * @return int < 0 表示发送失败
      */
     int encode_and_send(unsigned short type, unsigned int dataID,
                         unsigned char *data, unsigned int total_lenth,
-                        int sendto);
+                        int sendto, long long origin = 0);
     /**
      * @brief 编码并发送图片，编码按照 Message 类的格式
      * 
      * @param dataID 消息 ID
      * @param img cv::Mat 图片
      * @param sendto 发送目标, -1 为广播
+     * @param origin 附带时间戳时的起始时间, 例如图像的采集时间, 0 表示开始发送的时间
      * @note 图片将会被编码为 jpg 格式后发送
      * @note SocketClient 调用时，sendto 参数无效
+     * @note SocketServer 设置了码率控制器或图像订阅表时, 每个客户端按各自的
+     *       订阅和质量处理, 参数相同的客户端共用一次裁剪/缩放和编码结果,
+     *       订阅了分块的客户端收到 TiledImage 格式的数据
+     * @note SocketServer 编码后把数据交给各客户端的发送线程并立即返回, 每个客户端
+     *       最多一帧正在发送、一帧等待发送, 等待中的旧帧被新帧替换,
+     *       慢客户端不会阻塞其他客户端
+     * @return int < 0 表示发送失败, SocketServer 为没有发送目标
      */
-    void encode_and_send(unsigned int dataID, cv::Mat img, int sendto);
+    int encode_and_send(unsigned int dataID, cv::Mat img, int sendto,
+                        long long origin = 0);
+    /**
+     * @brief 发送固定大小数据区的消息, 数据区类型由 MessageTraits 在编译时检查
+     * 
+     * @tparam Type 消息类型, 例如 Message::CAMERA_INFO
+     * @param dataID 消息 ID
+     * @param payload 数据区
+     * @param sendto 发送目标, -1 为广播
+     * @return int < 0 表示发送失败
+     */
+    template <unsigned short Type>
+    int send(unsigned int dataID,
+             const typename MessageTraits<Type>::Header &payload, int sendto);
+    /**
+     * @brief 发送头部加元素数组的消息, 头部的 Count 设置为元素数
+     * 
+     * @tparam Type 消息类型, 例如 Message::TRANSFORM_BATCH
+     * @param dataID 消息 ID
+     * @param header 头部
+     * @param items 元素数组
+     * @param count 元素数
+     * @param sendto 发送目标, -1 为广播
+     * @return int < 0 表示发送失败
+     */
+    template <unsigned short Type>
+    int send(unsigned int dataID, typename MessageTraits<Type>::Header header,
+             const typename MessageTraits<Type>::Element *items,
+             unsigned int count, int sendto);
+    /**
+     * @brief 发送字节序列的消息
+     * 
+     * @tparam Type 消息类型, 例如 Message::STRING_MSG
+     * @param dataID 消息 ID
+     * @param items 字节序列
+     * @param count 字节数
+     * @param sendto 发送目标, -1 为广播
+     * @return int < 0 表示发送失败
+     */
+    template <unsigned short Type>
+    int send(unsigned int dataID,
+             const typename MessageTraits<Type>::Element *items,
+             unsigned int count, int sendto);
+    /**
+     * @brief 注册某种消息的处理函数, 由 dispatch 调用
+     * 
+     * @tparam Type 消息类型
+     * @param handler 处理函数, 参数为发送消息的客户端 ID (SocketClient 为 -1) 和
+     *        指向重组缓冲区的类型化视图; 数据长度与类型不符的消息不会交给处理函数
+     */
+    template <unsigned short Type>
+    void on(std::function<void(int from, const MessageView<Type> &view)>
+                handler);
+    /**
+     * @brief 把 receive_and_decode 返回的完整消息交给对应类型的处理函数
+     * 
+     * @param message 接收到的消息
+     * @param data receive_and_decode 返回的数据区, 仍由调用者释放
+     * @param from 发送消息的客户端 ID, SocketClient 调用时为 -1
+     * @return true 已由处理函数处理, false 表示该类型没有注册处理函数
+     */
+    bool dispatch(const Message &message, const unsigned char *data,
+                  int from = -1);
+    /**
+     * @brief 发送请求, 不等待回复
+     * 
+     * @param type 消息类型
+     * @param data 数据区
+     * @param total_lenth 数据总长度
+     * @param timeout 超时时间
+     * @param sendto 发送目标
+     * @note 请求使用自动分配的关联 ID 作为 DataID, 对端需使用相同的 DataID 回复,
+     *       回复由 receive_and_decode 交付给返回的 future, 不再返回给调用者
+     * @note SocketClient 调用时，sendto 参数无效
+     * @return std::future<RequestTable::Reply> 收到回复或超时后就绪
+     */
+    std::future<RequestTable::Reply>
+    request(unsigned short type, unsigned char *data, unsigned int total_lenth,
+            std::chrono::milliseconds timeout, int sendto);
+    /**
+     * @brief 设置图像发送的码率控制器
+     * 
+     * @param controller 码率控制器, nullptr 表示使用默认质量
+     */
+    void set_bitrate_controller(std::shared_ptr<BitrateController> controller);
+    /**
+     * @brief 设置图像订阅表, 发送图像时按客户端订阅裁剪和缩放
+     * 
+     * @param subscriptions 图像订阅表, nullptr 表示所有客户端接收原图
+     */
+    void set_image_subscriptions(
+        std::shared_ptr<ImageSubscriptions> subscriptions);
+    /**
+     * @brief 设置是否在发送的消息中附带时间戳扩展
+     * 
+     * @param enabled true 表示附带, 接收端据此统计从发送到重组完成的延迟
+     * @note 附带时间戳时每个分包的数据减少 16 字节, 对端需同样使用本版本的 Message;
+     *       单个分包能装下而附带时间戳后需要两个分包的消息 (如 TransformRequestData) 不附带
+     */
+    void set_timestamps(bool enabled);
+    /**
+     * @brief 启动时钟同步线程, 定期向对端发送 PING, 按连接估计时钟偏移和往返时间
+     * 
+     * @param period 发送间隔, 启动时先以 10ms 间隔连续发送几次以尽快得到估计值
+     * @note SocketServer 广播 PING, 每个客户端的 PONG 分别计入各自的估计值
+     * @note 之后收到的时间戳都按估计的偏移换算为本地时间再统计延迟
+     */
+    void start_clock_sync(std::chrono::milliseconds period);
+    /**
+     * @brief 获取连接的时钟偏移估计值
+     * 
+     * @param peer SocketServer 为客户端 ID, SocketClient 为 -1
+     * @param estimate 估计值
+     * @return true 已有估计值
+     */
+    bool get_clock(int peer, ClockSync::Estimate &estimate);
+    /**
+     * @brief 删除连接的时钟偏移估计值
+     * 
+     * @param peer SocketServer 为客户端 ID, SocketClient 为 -1
+     * @note 客户端主动断开时不经过 disconnect, 需要在断开连接处理函数中调用,
+     *       否则复用该 ID 的新客户端会沿用旧的估计值
+     */
+    void remove_clock(int peer);
+    /**
+     * @brief 获取消息附带的起始时间, 换算为本地时间
+     * 
+     * @param message 接收到的消息, 任一分包均可
+     * @param origin 本地 steady_clock 纳秒时间戳
+     * @param from 发送消息的客户端 ID, SocketClient 调用时为 -1
+     * @return true 消息附带了时间戳
+     */
+    bool get_origin(const Message &message, long long &origin, int from = -1);
+    /**
+     * @brief 设置运行指标注册表, 统计按消息类型和按客户端收发的消息数、分包数,
+     *        重组缓冲区占用, 丢弃的消息数和图像编码耗时
+     * 
+     * @param metrics 运行指标注册表
+     * @param labels 附加到所有指标上的标签, 例如 app="server"
+     */
+    void set_metrics(std::shared_ptr<Metrics> metrics,
+                     const std::string &labels);
     /**
      * @brief 主动断开某一客户端连接
      * 
@@ -74,9 +241,10 @@ public:
      * @brief 接收并解码消息
      * 
      * @param message 接收到的消息
-     * @return unsigned char* nullptr 表示消息包错误或者未接收完整，否则返回数据区指针
+     * @param from 发送消息的客户端 ID, 用于按客户端统计延迟和回复 PING, SocketClient 调用时为 -1
+     * @return unsigned char* nullptr 表示消息包错误、未接收完整、已作为请求的回复交付或者是 PING/PONG，否则返回数据区指针
      */
-    unsigned char *receive_and_decode(Message &message);
+    unsigned char *receive_and_decode(Message &message, int from = -1);
     /**
      * @brief 阻塞主线程，等待命令输入
      * 
@@ -88,18 +256,167 @@ public:
      * @return std::string 客户端列表
      */
     std::string get_clients();
+    /**
+     * @brief 获取带时间戳消息的延迟统计, 也可以通过 stats 命令查看
+     * 
+     * @return std::string 按消息类型和按客户端的延迟分布
+     */
+    std::string get_stats();
 
 private:
     std::map<std::string, std::function<void(std::string)>>
         commands; ///< 命令列表
-    std::map<unsigned int, unsigned char *> data_temp; ///< 数据缓存
-    std::map<unsigned int, unsigned int> received_lenth; ///< 已接收数据长度
+    /**
+     * @brief 一条正在重组的消息
+     *
+     */
+    typedef struct {
+        unsigned char *data; ///< 数据缓存
+        unsigned int total_lenth; ///< 数据总长度
+        unsigned int received_lenth; ///< 已接收数据长度
+#ifdef ENABLE_TRACE
+        long long begin; ///< 第一个分包到达的时间
+#endif
+    } Reassembly;
+    // 按 (发送方, dataID) 区分, 不同客户端可能同时使用相同的 dataID (如回复同一个 PING)
+    std::map<std::pair<int, unsigned int>, Reassembly> reassembly; ///< 正在重组的消息
+    std::mutex reassembly_mutex; ///< 保护 reassembly, 各客户端的接收线程并发调用 receive_and_decode
     std::shared_ptr<T> socket; ///< SocketServer 或者 SocketClient 的智能指针
+    std::shared_ptr<BitrateController> bitrate; ///< 图像码率控制器
+    std::shared_ptr<ImageSubscriptions> subscriptions; ///< 图像订阅表
+    RequestTable requests; ///< 未完成的请求
+    bool timestamps = false; ///< 发送时是否附带时间戳扩展
+    LatencyStats type_latency; ///< 按消息类型, 从开始发送到重组完成的延迟
+    LatencyStats send_latency; ///< 按消息类型, 从开始发送到最后一个分包发出的延迟
+    LatencyStats client_latency; ///< 按客户端, 从开始发送到重组完成的延迟
+    std::shared_ptr<Metrics> metrics; ///< 运行指标注册表
+    std::shared_ptr<Metrics::Family> frames_sent, fragments_sent; ///< 按消息类型发送的消息数和分包数
+    std::shared_ptr<Metrics::Family> frames_received, fragments_received; ///< 按消息类型接收的消息数和分包数
+    std::shared_ptr<Metrics::Family> client_frames_sent, client_frames_received; ///< 按客户端收发的消息数
+    int reassembly_bytes = -1, reassembly_frames = -1; ///< 重组缓冲区占用的序列编号
+    int dropped = -1; ///< 丢弃的错误消息数的序列编号
+    int encode_time = -1; ///< 图像编码耗时的序列编号
+    MessageDispatcher dispatcher; ///< 各消息类型的处理函数
+    ClockSync clocks; ///< 各连接的时钟偏移估计
+    std::pair<unsigned int, long long> pings[ClockSync::WINDOW] = {}; ///< 最近发出的 PING 的 (dataID, T1), 用于校验 PONG
+    std::mutex sync_mutex; ///< 保护 pings 和 sync_stop
+    std::condition_variable sync_cv; ///< 唤醒时钟同步线程
+    bool sync_stop = false; ///< 停止时钟同步线程
+    std::thread sync_thread; ///< 时钟同步线程
+    /**
+     * @brief 一个客户端的图像发送线程和等待发送的帧
+     *
+     */
+    struct ImageSender {
+        std::thread thread; ///< 发送线程
+        std::condition_variable cv; ///< 有新帧或停止时唤醒发送线程
+        std::shared_ptr<std::vector<unsigned char>> next; ///< 等待发送的编码数据, nullptr 表示没有
+        unsigned int dataID = 0; ///< 等待发送的帧的消息 ID
+        long long origin = 0; ///< 等待发送的帧的起始时间
+        bool stop = false; ///< 停止发送线程
+    };
+    std::map<int, std::unique_ptr<ImageSender>> image_senders; ///< 各客户端的图像发送线程
+    std::mutex image_mutex; ///< 保护 image_senders 及其中等待发送的帧
+    int frames_skipped = -1; ///< 被新帧替换的等待帧数的序列编号
+
+    void count_sent(unsigned short type, int sendto, unsigned int fragments); ///< 统计发送的消息
+    bool use_timestamps(unsigned int total_lenth) const; ///< 发送该长度的消息时是否附带时间戳扩展
+    long long encode(unsigned int dataID, cv::Mat &img,
+                     std::vector<unsigned char> &data,
+                     const std::vector<int> &params); ///< 编码 jpg 并统计耗时
+    int send_buffer(const Message &message, int sendto); ///< 发送一个分包
+    void queue_image(int client, unsigned int dataID, long long origin,
+                     std::shared_ptr<std::vector<unsigned char>> data); ///< 把一帧交给客户端的发送线程, 替换仍在等待的旧帧
+    void send_images(int client, ImageSender *sender); ///< 图像发送线程函数, 发送后更新码率控制器
+    void remove_image_sender(int client); ///< 停止并删除客户端的图像发送线程
+    void on_clock_sync(Message &message, unsigned char *data, int from); ///< 回复 PING 或记录 PONG 的采样
+
+    static long long now() ///< steady_clock 纳秒时间戳
+    {
+        return ClockSync::now();
+    }
 };
 
 template <typename T> Application<T>::Application(std::shared_ptr<T> &socket)
 {
     this->socket = socket;
+    // 内置的延迟统计命令, 可以被同名命令覆盖
+    add_command("stats", [this](std::string args) {
+        if (args.find("reset") != std::string::npos) {
+            type_latency.reset();
+            send_latency.reset();
+            client_latency.reset();
+            INFO("Latency statistics reset.");
+            return;
+        }
+        DEBUG("Message latency:\n" + get_stats());
+    });
+    // 内置的跟踪导出命令, 参数为文件路径
+    add_command("trace", [](std::string args) {
+        if (!Trace::enabled()) {
+            WARNING("Trace is disabled, rebuild with -DENABLE_TRACE=ON.");
+            return;
+        }
+        std::istringstream iss(args);
+        std::string path;
+        iss >> path;
+        if (path.empty())
+            path = "trace_" + std::to_string(getpid()) + ".json";
+        int count = Trace::dump(path);
+        if (count < 0)
+            ERROR("Failed to write " + path);
+        else
+            INFO(std::to_string(count) + " spans written to " + path);
+    });
+    // 内置的时钟偏移查看命令
+    add_command("clock", [this](std::string args) {
+        std::string estimates = clocks.get_estimates();
+        DEBUG("Clock offsets:\n" +
+              (estimates.empty() ? "no samples." : estimates));
+    });
+}
+
+template <typename T> Application<T>::~Application()
+{
+    {
+        std::lock_guard<std::mutex> lock(sync_mutex);
+        sync_stop = true;
+    }
+    sync_cv.notify_all();
+    if (sync_thread.joinable())
+        sync_thread.join();
+    std::vector<int> clients;
+    {
+        std::lock_guard<std::mutex> lock(image_mutex);
+        for (auto &sender : image_senders) {
+            clients.push_back(sender.first);
+        }
+    }
+    for (int client : clients) {
+        remove_image_sender(client);
+    }
+    for (auto &r : reassembly) {
+        delete[] r.second.data;
+    }
+}
+
+template <typename T> void Application<T>::remove_image_sender(int client)
+{
+    std::unique_ptr<ImageSender> sender;
+    {
+        std::lock_guard<std::mutex> lock(image_mutex);
+        auto it = image_senders.find(client);
+        if (it == image_senders.end())
+            return;
+        sender = std::move(it->second);
+        image_senders.erase(it);
+        sender->stop = true;
+    }
+    sender->cv.notify_all();
+    if (sender->thread.get_id() == std::this_thread::get_id())
+        sender->thread.detach(); // 由发送线程自身触发, 不能等待自己
+    else
+        sender->thread.join();
 }
 
 template <typename T>
@@ -112,7 +429,8 @@ void Application<T>::add_command(std::string command,
 template <typename T>
 int Application<T>::encode_and_send(unsigned short type, unsigned int dataID,
                                     unsigned char *data,
-                                    unsigned int total_lenth, int sendto)
+                                    unsigned int total_lenth, int sendto,
+                                    long long origin)
 {
     return 0;
 }
@@ -121,47 +439,266 @@ template <typename T> void Application<T>::disconnect(int client)
 {
 }
 
+template <typename T>
+void Application<T>::set_bitrate_controller(
+    std::shared_ptr<BitrateController> controller)
+{
+    this->bitrate = controller;
+}
+
+template <typename T>
+void Application<T>::set_image_subscriptions(
+    std::shared_ptr<ImageSubscriptions> subscriptions)
+{
+    this->subscriptions = subscriptions;
+}
+
 template <typename T> std::string Application<T>::get_clients()
 {
     return "";
 }
 
+template <typename T> void Application<T>::set_timestamps(bool enabled)
+{
+    this->timestamps = enabled;
+}
+
+template <typename T>
+bool Application<T>::use_timestamps(unsigned int total_lenth) const
+{
+    // 时间戳扩展不能让原本一个分包的消息变成两个分包
+    const unsigned int full = sizeof(Message::MessageBuffer::Data);
+    return timestamps &&
+           (total_lenth > full ||
+            total_lenth <= full - sizeof(Message::TimestampExtension));
+}
+
+template <typename T>
+void Application<T>::start_clock_sync(std::chrono::milliseconds period)
+{
+    if (sync_thread.joinable())
+        return;
+    sync_thread = std::thread([this, period]() {
+        for (int i = 0;; i++) {
+            Message::ClockSyncData data = { 0, 0, 0 };
+            unsigned int id;
+            // 借用请求的关联 ID, 不会与图像和订阅的 dataID 冲突, 回复在 on_clock_sync 中处理
+            requests.add(id, period);
+            data.T1 = now();
+            {
+                std::lock_guard<std::mutex> lock(sync_mutex);
+                pings[i % ClockSync::WINDOW] = { id, data.T1 };
+            }
+            if (send<Message::PING>(id, data, -1) < 0)
+                requests.fail(id);
+
+            std::unique_lock<std::mutex> lock(sync_mutex);
+            auto wait = i < 8 ? std::chrono::milliseconds(10) : period;
+            if (sync_cv.wait_for(lock, wait, [this]() { return sync_stop; }))
+                return;
+        }
+    });
+}
+
+template <typename T>
+bool Application<T>::get_clock(int peer, ClockSync::Estimate &estimate)
+{
+    return clocks.get(peer, estimate);
+}
+
+template <typename T> void Application<T>::remove_clock(int peer)
+{
+    clocks.remove(peer);
+}
+
+template <typename T>
+bool Application<T>::get_origin(const Message &message, long long &origin,
+                                int from)
+{
+    long long send;
+    if (!message.get_timestamps(origin, send))
+        return false;
+    origin = clocks.to_local(from, origin);
+    return true;
+}
+
+template <typename T>
+void Application<T>::on_clock_sync(Message &message, unsigned char *data,
+                                   int from)
+{
+    long long received = now();
+    if (message.get_dataTotalLenth() < sizeof(Message::ClockSyncData))
+        return;
+    Message::ClockSyncData sync = *(Message::ClockSyncData *)data;
+    unsigned int dataID = message.get_dataID();
+    if (message.get_messageType() == Message::MessageType::PING) {
+        sync.T2 = received;
+        sync.T3 = now();
+        send<Message::PONG>(dataID, sync, from);
+        return;
+    }
+    // 只接受自己发出的 PING 的回复, 广播 PING 的每个回复都计入对应客户端
+    {
+        std::lock_guard<std::mutex> lock(sync_mutex);
+        bool found = false;
+        for (auto &ping : pings) {
+            if (ping.first == dataID && ping.second == sync.T1)
+                found = true;
+        }
+        if (!found)
+            return;
+    }
+    clocks.add(from, sync.T1, sync.T2, sync.T3, received);
+    requests.complete(dataID, message.get_messageType(), data,
+                      sizeof(sync));
+}
+
+template <typename T>
+void Application<T>::set_metrics(std::shared_ptr<Metrics> metrics,
+                                 const std::string &labels)
+{
+    this->metrics = metrics;
+    frames_sent = metrics->add_family("app_frames_sent_total",
+                                      "Messages sent, by message type.",
+                                      Metrics::COUNTER, labels, "type", 1,
+                                      true);
+    fragments_sent = metrics->add_family(
+        "app_fragments_sent_total", "Fragments sent, by message type.",
+        Metrics::COUNTER, labels, "type", 1, true);
+    frames_received = metrics->add_family(
+        "app_frames_received_total",
+        "Messages reassembled, by message type.", Metrics::COUNTER, labels,
+        "type", 1, true);
+    fragments_received = metrics->add_family(
+        "app_fragments_received_total", "Fragments received, by message type.",
+        Metrics::COUNTER, labels, "type", 1, true);
+    client_frames_sent = metrics->add_family(
+        "app_client_frames_sent_total", "Messages sent to each client.",
+        Metrics::COUNTER, labels, "client");
+    client_frames_received = metrics->add_family(
+        "app_client_frames_received_total",
+        "Messages reassembled from each client.", Metrics::COUNTER, labels,
+        "client");
+    reassembly_bytes = metrics->add_series(
+        "app_reassembly_bytes", "Bytes held by partially received messages.",
+        Metrics::GAUGE, labels);
+    reassembly_frames = metrics->add_series(
+        "app_reassembly_frames", "Partially received messages.",
+        Metrics::GAUGE, labels);
+    dropped = metrics->add_series("app_dropped_messages_total",
+                                  "Malformed fragments dropped on receive.",
+                                  Metrics::COUNTER, labels);
+    frames_skipped = metrics->add_series(
+        "app_image_frames_skipped_total",
+        "Image frames replaced while waiting for a slow client.",
+        Metrics::COUNTER, labels);
+    encode_time = metrics->add_series("app_encode_seconds",
+                                      "Time spent encoding images to jpg.",
+                                      Metrics::SUMMARY, labels, 1e-9);
+}
+
+template <typename T>
+void Application<T>::count_sent(unsigned short type, int sendto,
+                                unsigned int fragments)
+{
+    if (metrics == nullptr)
+        return;
+    frames_sent->add(type, 1);
+    fragments_sent->add(type, fragments);
+    if (sendto >= 0)
+        client_frames_sent->add(sendto, 1);
+}
+
+template <typename T>
+long long Application<T>::encode(unsigned int dataID, cv::Mat &img,
+                                 std::vector<unsigned char> &data,
+                                 const std::vector<int> &params)
+{
+    TRACE_SPAN("imencode", dataID);
+    auto start = std::chrono::steady_clock::now();
+    cv::imencode(".jpg", img, data, params);
+    long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    if (metrics != nullptr)
+        metrics->observe(encode_time, ns);
+    return ns;
+}
+
+template <typename T> std::string Application<T>::get_stats()
+{
+    std::stringstream ss;
+    ss << std::hex;
+    for (auto h : type_latency.get_all()) {
+        ss << "type 0x" << h->get_key() << " total: " << h->get_summary()
+           << std::endl;
+        const LatencyHistogram *send = send_latency.find(h->get_key());
+        if (send != nullptr)
+            ss << "type 0x" << h->get_key() << " send: "
+               << send->get_summary() << std::endl;
+    }
+    ss << std::dec;
+    for (auto h : client_latency.get_all()) {
+        ss << "client " << h->get_key() << ": " << h->get_summary()
+           << std::endl;
+    }
+    std::string stats = ss.str();
+    return stats.empty() ? "no timestamped messages received." : stats;
+}
+
 #ifdef SOCKETSERVER_HPP
+template <>
+int Application<SocketServer>::send_buffer(const Message &message, int sendto)
+{
+    TRACE_SPAN("send", message.get_dataID());
+    if (sendto == -1)
+        return socket->broadcast((char *)(message.get_buffer()), 10240);
+    return socket->send(sendto, (char *)(message.get_buffer()), 10240);
+}
+
 template <>
 int Application<SocketServer>::encode_and_send(unsigned short type,
                                                unsigned int dataID,
                                                unsigned char *data,
                                                unsigned int total_lenth,
-                                               int sendto)
+                                               int sendto, long long origin)
 {
+    TRACE_SPAN("encode_and_send", dataID);
     Message message(type);
     message.set_dataID(dataID);
     message.set_dataTotalLenth(total_lenth);
+    bool stamped = use_timestamps(total_lenth);
+    if (stamped) {
+        long long start = now();
+        if (origin == 0)
+            origin = start;
+        message.set_timestamps(origin, start);
+    }
+    unsigned int capacity = message.get_capacity();
 
     int ret = 0;
 
-    if (total_lenth < 10218) {
+    if (total_lenth < capacity) {
         message.set_data((char *)data, total_lenth);
-        if (sendto == -1)
-            ret = socket->broadcast((char *)(message.get_buffer()), 10240);
-        else
-            ret = socket->send(sendto, (char *)(message.get_buffer()), 10240);
+        ret = send_buffer(message, sendto);
+        if (ret >= 0)
+            count_sent(type, sendto, 1);
     } else {
         unsigned int offset = 0;
         while (offset < total_lenth) {
             message.set_offset(offset);
-            unsigned int lenth =
-                total_lenth - offset > 10218 ? 10218 : total_lenth - offset;
+            unsigned int lenth = total_lenth - offset > capacity ?
+                                     capacity :
+                                     total_lenth - offset;
             message.set_data((char *)(data + offset), lenth);
-            if (sendto == -1)
-                ret = socket->broadcast((char *)(message.get_buffer()), 10240);
-            else
-                ret =
-                    socket->send(sendto, (char *)(message.get_buffer()), 10240);
+            if (stamped)
+                message.set_timestamps(origin, now());
+            ret = send_buffer(message, sendto);
             offset += lenth;
             if (ret < 0)
                 return ret;
         }
+        count_sent(type, sendto, (total_lenth + capacity - 1) / capacity);
     }
 
     return ret;
@@ -170,6 +707,8 @@ int Application<SocketServer>::encode_and_send(unsigned short type,
 template <> void Application<SocketServer>::disconnect(int client)
 {
     socket->disconnect(client);
+    remove_clock(client);
+    remove_image_sender(client);
     return;
 }
 
@@ -178,38 +717,206 @@ template <> std::string Application<SocketServer>::get_clients()
     return socket->get_clients();
 }
 
+template <>
+void Application<SocketServer>::send_images(int client, ImageSender *sender)
+{
+    std::unique_lock<std::mutex> lock(image_mutex);
+    while (true) {
+        sender->cv.wait(lock, [sender]() {
+            return sender->stop || sender->next != nullptr;
+        });
+        if (sender->stop)
+            return;
+        auto data = std::move(sender->next);
+        sender->next = nullptr;
+        unsigned int dataID = sender->dataID;
+        long long origin = sender->origin;
+        lock.unlock();
+
+        // 每个客户端单独发送并计时, 慢客户端只影响自己的测量结果
+        auto start = std::chrono::steady_clock::now();
+        int r = encode_and_send(Message::MessageType::IMAGE_MSG, dataID,
+                                data->data(), data->size(), client, origin);
+        double latency = std::chrono::duration<double, std::milli>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+        if (bitrate != nullptr) {
+            if (r < 0)
+                bitrate->remove(client);
+            else
+                bitrate->update(client, socket->get_send_queue(client),
+                                latency);
+        }
+        lock.lock();
+    }
+}
+
+template <>
+void Application<SocketServer>::queue_image(
+    int client, unsigned int dataID, long long origin,
+    std::shared_ptr<std::vector<unsigned char>> data)
+{
+    std::lock_guard<std::mutex> lock(image_mutex);
+    auto &sender = image_senders[client];
+    if (sender == nullptr) {
+        sender = std::make_unique<ImageSender>();
+        sender->thread = std::thread(&Application<SocketServer>::send_images,
+                                     this, client, sender.get());
+    }
+    // 上一帧仍在等待时只保留最新的一帧
+    if (sender->next != nullptr && metrics != nullptr)
+        metrics->add(frames_skipped, 1);
+    sender->next = data;
+    sender->dataID = dataID;
+    sender->origin = origin;
+    sender->cv.notify_one();
+}
+
+template <>
+int Application<SocketServer>::encode_and_send(unsigned int dataID,
+                                               cv::Mat img, int sendto,
+                                               long long origin)
+{
+    std::vector<int> targets;
+    if (sendto == -1) {
+        targets = socket->get_client_ids();
+        // 已断开的客户端不再出现在广播目标中, 停止其发送线程
+        std::vector<int> gone;
+        {
+            std::lock_guard<std::mutex> lock(image_mutex);
+            for (auto &sender : image_senders) {
+                if (std::find(targets.begin(), targets.end(), sender.first) ==
+                    targets.end())
+                    gone.push_back(sender.first);
+            }
+        }
+        for (int client : gone) {
+            remove_image_sender(client);
+        }
+    } else {
+        targets.push_back(sendto);
+    }
+    if (targets.empty())
+        return -1;
+
+    if (origin == 0)
+        origin = now(); // 等待发送线程的时间计入延迟
+    if (bitrate == nullptr && subscriptions == nullptr) {
+        // 未启用码率控制和订阅, 所有客户端共用一份默认质量的编码结果
+        auto data = std::make_shared<std::vector<unsigned char>>();
+        encode(dataID, img, *data, {});
+        for (int client : targets) {
+            queue_image(client, dataID, origin, data);
+        }
+        return 0;
+    }
+
+    // 每种订阅只裁剪/缩放一次, 订阅相同的客户端共用处理结果
+    std::vector<Message::ImageSubscribeData> subs;
+    std::vector<cv::Mat> views;
+    // 按 (订阅, 质量, 目标尺寸) 分组编码, 参数相同的客户端共用一份数据
+    std::map<std::tuple<size_t, int, int, int>,
+             std::shared_ptr<std::vector<unsigned char>>>
+        encoded;
+    for (int client : targets) {
+        Message::ImageSubscribeData sub = { 0, 0, 0, 0, 0, 0, 0, 0 };
+        if (subscriptions != nullptr)
+            sub = subscriptions->get(client);
+        size_t view = 0;
+        while (view < subs.size() && !ImageSubscriptions::equal(subs[view], sub))
+            view++;
+        if (view == subs.size()) {
+            subs.push_back(sub);
+            views.push_back(ImageSubscriptions::apply(img, sub));
+        }
+
+        int quality = -1; // quality < 0 表示使用默认质量
+        cv::Size size = views[view].size();
+        if (bitrate != nullptr) {
+            auto state = bitrate->get(client);
+            quality = state.quality;
+            if (state.scale < 1.0)
+                size = cv::Size(
+                    std::max(1, (int)(size.width * state.scale + 0.5)),
+                    std::max(1, (int)(size.height * state.scale + 0.5)));
+        }
+        auto key = std::make_tuple(view, quality, size.width, size.height);
+        if (encoded.find(key) == encoded.end()) {
+            encoded[key] = std::make_shared<std::vector<unsigned char>>();
+            cv::Mat scaled = views[view];
+            if (size != views[view].size())
+                cv::resize(views[view], scaled, size, 0, 0, cv::INTER_AREA);
+            if (subs[view].TileRows > 0 && subs[view].TileCols > 0 &&
+                (subs[view].TileRows > 1 || subs[view].TileCols > 1)) { // 分块编码
+                TiledImage::encode(scaled, subs[view].TileRows,
+                                   subs[view].TileCols, quality,
+                                   *encoded[key]);
+            } else {
+                std::vector<int> params;
+                if (quality >= 0)
+                    params = { cv::IMWRITE_JPEG_QUALITY, quality };
+                encode(dataID, scaled, *encoded[key], params);
+            }
+        }
+        queue_image(client, dataID, origin, encoded[key]);
+    }
+    return 0;
+}
+
 #endif
 
 #ifdef SOCKETCLIENT_HPP
+template <>
+int Application<SocketClient>::send_buffer(const Message &message, int sendto)
+{
+    TRACE_SPAN("send", message.get_dataID());
+    return socket->send((char *)(message.get_buffer()), 10240);
+}
+
 template <>
 int Application<SocketClient>::encode_and_send(unsigned short type,
                                                unsigned int dataID,
                                                unsigned char *data,
                                                unsigned int total_lenth,
-                                               int sendto)
+                                               int sendto, long long origin)
 {
+    TRACE_SPAN("encode_and_send", dataID);
     Message message(type);
     message.set_dataID(dataID);
     message.set_dataTotalLenth(total_lenth);
+    bool stamped = use_timestamps(total_lenth);
+    if (stamped) {
+        long long start = now();
+        if (origin == 0)
+            origin = start;
+        message.set_timestamps(origin, start);
+    }
+    unsigned int capacity = message.get_capacity();
 
     int ret = 0;
 
-    if (total_lenth < 10218) {
+    if (total_lenth < capacity) {
         message.set_data((char *)data, total_lenth);
-        ret = socket->send((char *)(message.get_buffer()), 10240);
+        ret = send_buffer(message, sendto);
+        if (ret >= 0)
+            count_sent(type, -1, 1);
     } else {
         unsigned int offset = 0;
         while (offset < total_lenth) {
             message.set_offset(offset);
-            unsigned int lenth =
-                total_lenth - offset > 10218 ? 10218 : total_lenth - offset;
+            unsigned int lenth = total_lenth - offset > capacity ?
+                                     capacity :
+                                     total_lenth - offset;
             message.set_data((char *)(data + offset), lenth);
+            if (stamped)
+                message.set_timestamps(origin, now());
 
-            ret = socket->send((char *)(message.get_buffer()), 10240);
+            ret = send_buffer(message, sendto);
             offset += lenth;
             if (ret < 0)
                 return ret;
         }
+        count_sent(type, -1, (total_lenth + capacity - 1) / capacity);
     }
 
     return ret;
@@ -217,57 +924,101 @@ int Application<SocketClient>::encode_and_send(unsigned short type,
 #endif
 
 template <typename T>
-void Application<T>::encode_and_send(unsigned int dataID, cv::Mat img,
-                                     int sendto)
+int Application<T>::encode_and_send(unsigned int dataID, cv::Mat img,
+                                    int sendto, long long origin)
 {
     std::vector<unsigned char> data;
-    cv::imencode(".jpg", img, data);
+    encode(dataID, img, data, {});
+
+    return encode_and_send(Message::MessageType::IMAGE_MSG, dataID,
+                           data.data(), data.size(), sendto, origin);
+}
+
+template <typename T>
+template <unsigned short Type>
+int Application<T>::send(unsigned int dataID,
+                         const typename MessageTraits<Type>::Header &payload,
+                         int sendto)
+{
+    static_assert(std::is_void<typename MessageTraits<Type>::Element>::value,
+                  "batch messages need items and count");
+    return encode_and_send(Type, dataID, (unsigned char *)&payload,
+                           sizeof(payload), sendto);
+}
+
+template <typename T>
+template <unsigned short Type>
+int Application<T>::send(unsigned int dataID,
+                         typename MessageTraits<Type>::Header header,
+                         const typename MessageTraits<Type>::Element *items,
+                         unsigned int count, int sendto)
+{
+    typedef typename MessageTraits<Type>::Element Element;
+    static_assert(!std::is_void<Element>::value,
+                  "fixed messages have no items");
+    header.Count = count;
+    // 头部和元素需要连续存放, 复制到一块缓冲区中
+    std::vector<unsigned char> data(sizeof(header) + count * sizeof(Element));
+    memcpy(data.data(), &header, sizeof(header));
+    memcpy(data.data() + sizeof(header), items, count * sizeof(Element));
+    return encode_and_send(Type, dataID, data.data(), data.size(), sendto);
+}
 
-    encode_and_send(Message::MessageType::IMAGE_MSG, dataID, data.data(),
-                    data.size(), sendto);
+template <typename T>
+template <unsigned short Type>
+int Application<T>::send(unsigned int dataID,
+                         const typename MessageTraits<Type>::Element *items,
+                         unsigned int count, int sendto)
+{
+    static_assert(std::is_void<typename MessageTraits<Type>::Header>::value,
+                  "messages with a header need the header");
+    return encode_and_send(Type, dataID, (unsigned char *)items, count,
+                           sendto);
+}
+
+template <typename T>
+template <unsigned short Type>
+void Application<T>::on(
+    std::function<void(int from, const MessageView<Type> &view)> handler)
+{
+    dispatcher.on<Type>(handler);
+}
+
+template <typename T>
+bool Application<T>::dispatch(const Message &message,
+                              const unsigned char *data, int from)
+{
+    return dispatcher.dispatch(message.get_messageType(), data,
+                               message.get_dataTotalLenth(),
+                               message.get_dataID(), from);
+}
+
+template <typename T>
+std::future<RequestTable::Reply>
+Application<T>::request(unsigned short type, unsigned char *data,
+                        unsigned int total_lenth,
+                        std::chrono::milliseconds timeout, int sendto)
+{
+    unsigned int id;
+    auto reply = requests.add(id, timeout);
+    if (encode_and_send(type, id, data, total_lenth, sendto) < 0)
+        requests.fail(id);
+    return reply;
 }
 
 template <typename T>
-unsigned char *Application<T>::receive_and_decode(Message &message)
-{
-    if (((Message::MessageBuffer *)(message.get_buffer()))->Start != 0x0D00 ||
-        ((Message::MessageBuffer *)(message.get_buffer()))->End != 0x0721) {
-        std::string hex;
-        std::stringstream ss;
-
-        ss << std::hex << "0x"
-           << ((Message::MessageBuffer *)(message.get_buffer()))->Start
-           << std::endl
-           << "0x"
-           << ((Message::MessageBuffer *)(message.get_buffer()))->MessageType
-           << std::endl
-           << "0x" << ((Message::MessageBuffer *)(message.get_buffer()))->End
-           << std::endl
-           << std::dec;
-
-        WARNING("Warning: Invalid message. Meta data bellow:");
-        ss >> hex;
-        WARNING("Start: " + hex);
-        ss >> hex;
-        WARNING("MessageType: " + hex);
-        WARNING(
-            "DataID: " +
-            std::to_string(
-                ((Message::MessageBuffer *)(message.get_buffer()))->DataID));
-        WARNING(
-            "DataTotalLenth: " +
-            std::to_string(((Message::MessageBuffer *)(message.get_buffer()))
-                               ->DataTotalLenth));
-        WARNING(
-            "Offset: " +
-            std::to_string(
-                ((Message::MessageBuffer *)(message.get_buffer()))->Offset));
-        WARNING(
-            "DataLenth: " +
-            std::to_string(
-                ((Message::MessageBuffer *)(message.get_buffer()))->DataLenth));
-        ss >> hex;
-        WARNING("End: " + hex + "\n");
+unsigned char *Application<T>::receive_and_decode(Message &message, int from)
+{
+    auto buffer = (Message::MessageBuffer *)(message.get_buffer());
+    if (buffer->Start != 0x0D00 || buffer->End != 0x0721) {
+        // 错误的分包可能连续到达, 只记录头部字段, 由日志线程格式化
+        LOG_WARNING("Invalid message: Start {x}, MessageType {x}, DataID {}, "
+                    "DataTotalLenth {}, Offset {}, DataLenth {}, End {x}",
+                    buffer->Start, buffer->MessageType, buffer->DataID,
+                    buffer->DataTotalLenth, buffer->Offset, buffer->DataLenth,
+                    buffer->End);
+        if (metrics != nullptr)
+            metrics->add(dropped, 1);
         return nullptr;
     }
     unsigned int offset = message.get_offset();
@@ -276,24 +1027,90 @@ unsigned char *Application<T>::receive_and_decode(Message &message)
     unsigned int dataID = message.get_dataID();
 
     if (total_lenth == 0) {
-        ERROR("Error: Received message's total_lenth is 0, drop it.");
+        LOG_ERROR("Received message {}'s total_lenth is 0, drop it.",
+                  message.get_dataID());
+        if (metrics != nullptr)
+            metrics->add(dropped, 1);
         return nullptr;
     }
 
-    if (data_temp.find(dataID) == data_temp.end()) {
-        data_temp[dataID] = new unsigned char[total_lenth];
-        received_lenth[dataID] = 0;
+    if (offset > total_lenth || lenth > total_lenth - offset ||
+        lenth > message.get_capacity()) {
+        LOG_WARNING("Fragment of message {} out of range: offset {}, "
+                    "lenth {}, total {}",
+                    dataID, offset, lenth, total_lenth);
+        if (metrics != nullptr)
+            metrics->add(dropped, 1);
+        return nullptr;
     }
-    memcpy(data_temp[dataID] + offset, message.get_data(), lenth);
-    received_lenth[dataID] += lenth;
-    if (received_lenth[dataID] >= total_lenth) {
-        unsigned char *data = data_temp[dataID];
-        data_temp.erase(dataID);
-        received_lenth.erase(dataID);
-        return data;
-    } else {
+
+    unsigned char *data = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(reassembly_mutex);
+        auto key = std::make_pair(from, dataID);
+        auto it = reassembly.find(key);
+        if (it == reassembly.end()) {
+            Reassembly r = { new unsigned char[total_lenth], total_lenth, 0 };
+#ifdef ENABLE_TRACE
+            r.begin = Trace::now();
+#endif
+            it = reassembly.emplace(key, r).first;
+            if (metrics != nullptr) {
+                metrics->add(reassembly_bytes, total_lenth);
+                metrics->add(reassembly_frames, 1);
+            }
+        }
+        Reassembly &r = it->second;
+        // 总长度与第一个分包不一致的分包不写入缓存
+        if (r.total_lenth != total_lenth) {
+            LOG_WARNING("Fragment of message {} has total {}, expected {}",
+                        dataID, total_lenth, r.total_lenth);
+            if (metrics != nullptr)
+                metrics->add(dropped, 1);
+            return nullptr;
+        }
+        if (metrics != nullptr)
+            fragments_received->add(message.get_messageType(), 1);
+        memcpy(r.data + offset, message.get_data(), lenth);
+        r.received_lenth += lenth;
+        if (r.received_lenth < total_lenth)
+            return nullptr;
+        data = r.data;
+#ifdef ENABLE_TRACE
+        // 从第一个分包到达到重组完成
+        Trace::record("reassemble", dataID, r.begin, Trace::now());
+#endif
+        reassembly.erase(it);
+    }
+    if (metrics != nullptr) {
+        metrics->add(reassembly_bytes, -(long long)total_lenth);
+        metrics->add(reassembly_frames, -1);
+        frames_received->add(message.get_messageType(), 1);
+        if (from >= 0)
+            client_frames_received->add(from, 1);
+    }
+    long long origin, send;
+    if (message.get_timestamps(origin, send)) {
+        long long latency = now() - clocks.to_local(from, origin);
+        type_latency.record(message.get_messageType(), latency);
+        send_latency.record(message.get_messageType(), send - origin);
+        if (from >= 0)
+            client_latency.record(from, latency);
+    }
+    if (message.get_messageType() == Message::MessageType::PING ||
+        message.get_messageType() == Message::MessageType::PONG) {
+        on_clock_sync(message, data, from);
+        delete[] data;
+        return nullptr;
+    }
+    // 按关联 ID 把回复交给等待的请求
+    if (RequestTable::is_request_id(dataID) &&
+        requests.complete(dataID, message.get_messageType(), data,
+                          total_lenth)) {
+        delete[] data;
         return nullptr;
     }
+    return data;
 }
 
 template <typename T> void Application<T>::join()
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+
+/**
+ * @brief BitrateController 类, 按客户端自适应调整图像编码质量
+ *
+ * 根据每个客户端的发送队列深度 (内核未发送字节数) 和单帧发送耗时,
+ * 采用加性增、乘性减的策略在配置范围内调整 JPEG 质量和缩放比例,
+ * 使远程或处理慢的客户端降低码率, 而不影响本地客户端
+ */
+class BitrateController {
+public:
+    /**
+     * @brief 码率控制参数
+     *
+     */
+    typedef struct {
+        int min_quality = 30; ///< 最低 JPEG 质量
+        int max_quality = 95; ///< 最高 JPEG 质量
+        int quality_step = 5; ///< 网络空闲时每次提升的质量
+        double decrease_ratio = 0.8; ///< 拥塞时质量乘以该系数
+        bool adapt_scale = false; ///< 质量降到最低后是否继续降低分辨率
+        double min_scale = 0.5; ///< 最小缩放比例
+        double target_latency = 20.0; ///< 单帧发送耗时目标, 单位 ms
+        int max_queue = 512 * 1024; ///< 发送队列上限, 单位字节
+        int increase_interval = 10; ///< 连续多少帧空闲后才提升质量
+    } Config;
+
+    /**
+     * @brief 单个客户端的码率状态
+     *
+     */
+    typedef struct {
+        int quality; ///< 当前 JPEG 质量
+        double scale; ///< 当前缩放比例
+        double latency; ///< 发送耗时的滑动平均, 单位 ms
+        int queue; ///< 最近一次采样的发送队列深度, 单位字节
+        int idle_frames; ///< 连续空闲帧数
+    } State;
+
+    /**
+     * @brief BitrateController 构造函数, 使用默认参数
+     *
+     */
+    BitrateController();
+    /**
+     * @brief BitrateController 构造函数
+     *
+     * @param config 码率控制参数
+     */
+    BitrateController(const Config &config);
+    /**
+     * @brief 设置码率控制参数, 已有客户端的质量会被限制到新范围内
+     *
+     * @param config 码率控制参数
+     */
+    void set_config(const Config &config);
+    /**
+     * @brief 获取码率控制参数
+     *
+     * @return Config 码率控制参数
+     */
+    Config get_config();
+    /**
+     * @brief 根据一次发送的测量结果更新客户端状态
+     *
+     * @param client 客户端 ID
+     * @param queue 发送后的发送队列深度, 单位字节, < 0 表示无法获取
+     * @param latency 本帧发送耗时, 单位 ms
+     */
+    void update(int client, int queue, double latency);
+    /**
+     * @brief 获取客户端当前状态, 未记录的客户端返回最高质量
+     *
+     * @param client 客户端 ID
+     * @return State 客户端状态
+     */
+    State get(int client);
+    /**
+     * @brief 删除客户端状态, 客户端断开时调用
+     *
+     * @param client 客户端 ID
+     */
+    void remove(int client);
+    /**
+     * @brief 获取所有客户端当前的编码质量
+     *
+     * @return std::string 每行一个客户端: ID, 质量, 缩放比例, 平均耗时, 队列深度
+     */
+    std::string get_qualities();
+
+private:
+    Config config; ///< 码率控制参数
+    std::map<int, State> states; ///< 客户端状态
+    std::mutex mutex; ///< 保护 config 和 states
+
+    State initial_state() const; ///< 新客户端的初始状态
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+
+/**
+ * @brief ClockSync 类, 按连接估计对端时钟与本地时钟的偏移
+ *
+ * 与 NTP 相同, 每次 PING/PONG 往返得到四个时间戳: T1 本地发送, T2 对端接收,
+ * T3 对端回复, T4 本地接收, 由此计算
+ *     rtt = (T4 - T1) - (T3 - T2)
+ *     offset = ((T2 - T1) + (T3 - T4)) / 2, 即对端时钟减本地时钟
+ * 排队和调度只会使往返变长, 往返最短的采样误差最小 (不超过 rtt / 2),
+ * 因此只保留最近 WINDOW 个采样并取其中往返最短的一个作为估计值,
+ * 窗口限制了采样的时效, 时钟漂移时估计值随新采样更新
+ */
+class ClockSync {
+public:
+    static const int WINDOW = 16; ///< 每个连接保留的采样数
+
+    /**
+     * @brief 时钟偏移估计值, 单位纳秒
+     *
+     */
+    typedef struct {
+        long long offset; ///< 对端时钟减本地时钟
+        long long rtt; ///< 往返时间, 估计值的误差不超过 rtt / 2
+    } Estimate;
+
+    /**
+     * @brief 获取当前时间, 与 TimestampExtension 使用相同的时钟
+     *
+     * @return long long steady_clock 纳秒时间戳
+     */
+    static long long now();
+    /**
+     * @brief 添加一次往返的采样
+     *
+     * @param peer 连接, SocketServer 为客户端 ID, SocketClient 为 -1
+     * @param t1 本地发送 PING 的时间
+     * @param t2 对端接收 PING 的时间
+     * @param t3 对端发送 PONG 的时间
+     * @param t4 本地接收 PONG 的时间
+     * @note 往返时间为负的采样 (时间戳错误) 被丢弃
+     */
+    void add(int peer, long long t1, long long t2, long long t3, long long t4);
+    /**
+     * @brief 获取连接的时钟偏移估计值
+     *
+     * @param peer 连接
+     * @param estimate 估计值
+     * @return true 已有采样
+     */
+    bool get(int peer, Estimate &estimate);
+    /**
+     * @brief 把对端时间戳换算为本地时间
+     *
+     * @param peer 连接
+     * @param remote 对端的 steady_clock 纳秒时间戳
+     * @return long long 本地时间戳, 没有采样时原样返回
+     */
+    long long to_local(int peer, long long remote);
+    /**
+     * @brief 删除连接的所有采样, 连接断开后调用
+     *
+     * @param peer 连接
+     */
+    void remove(int peer);
+    /**
+     * @brief 获取所有连接的估计值
+     *
+     * @return std::string 每个连接的偏移、往返时间和采样数, 单位微秒
+     */
+    std::string get_estimates();
+
+private:
+    typedef struct {
+        Estimate samples[WINDOW]; ///< 最近的采样, 循环覆盖
+        unsigned long count; ///< 已添加的采样总数
+        Estimate best; ///< 窗口内往返最短的采样
+    } Peer;
+
+    std::mutex mutex; ///< 保护 peers
+    std::map<int, Peer> peers; ///< 各连接的采样
+};
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "FrameRing.hpp"
+#include "Metrics.hpp"
+
+/**
+ * @brief DecodePool 类, 图像解码线程池
+ *
+ * 接收线程只负责重组消息并调用 push 移交数据, 解码在工作线程中并行进行,
+ * 解码结果由交付线程按到达顺序 (同一视频流中即 dataID 顺序) 交给回调函数,
+ * 落后的帧按跳帧策略丢弃, 接收线程不会因为解码或图像处理而阻塞;
+ * 设置了 FrameRing 时直接解码到其槽位中, 交付时槽位加入历史队列
+ */
+class DecodePool {
+public:
+    /**
+     * @brief 跳帧策略
+     *
+     */
+    enum SkipPolicy {
+        WAIT_ALL, ///< 严格按序交付每一帧, 不跳帧
+        SKIP_LATE, ///< 下一帧未解码完成而更新的帧已有 max_lag 帧解码完成时跳过该帧
+        LATEST_ONLY ///< 总是交付已解码的最新帧, 丢弃更早的帧
+    };
+
+    /**
+     * @brief DecodePool 构造函数, 启动工作线程和交付线程
+     *
+     * @param threads 解码线程数
+     * @param on_frame 交付回调函数, 参数为 dataID 和解码后的图像
+     * @param policy 跳帧策略
+     * @param max_lag SKIP_LATE 策略允许的最大落后帧数
+     * @param ring 帧缓冲池, nullptr 表示每帧解码到新分配的 cv::Mat
+     * @note ring 的 in_flight 应不小于 get_in_flight(threads, max_lag);
+     *       解码中和待交付的帧达到该数量时解码线程等待交付, 槽位不会被淘汰
+     */
+    DecodePool(int threads,
+               std::function<void(unsigned int, cv::Mat &)> on_frame,
+               SkipPolicy policy = SKIP_LATE, unsigned int max_lag = 4,
+               std::shared_ptr<FrameRing> ring = nullptr);
+    /**
+     * @brief DecodePool 析构函数, 停止所有线程并释放未处理的数据
+     *
+     */
+    ~DecodePool();
+    /**
+     * @brief 提交一帧待解码数据
+     *
+     * @param dataID 消息 ID
+     * @param data 重组后的数据区, 由 new[] 分配, 所有权移交给线程池
+     * @param lenth 数据区长度
+     * @note 非 WAIT_ALL 策略下, 待解码队列超过上限时丢弃最早的待解码帧;
+     *       WAIT_ALL 策略不丢帧, 队列满时阻塞调用者直到解码线程取走一帧
+     */
+    void push(unsigned int dataID, unsigned char *data, unsigned int lenth);
+    /**
+     * @brief 获取已交付的帧数
+     *
+     * @return unsigned long 帧数
+     */
+    unsigned long get_delivered();
+    /**
+     * @brief 获取被跳过 (包括解码失败) 的帧数
+     *
+     * @return unsigned long 帧数
+     */
+    unsigned long get_skipped();
+    /**
+     * @brief 计算同时处于解码中或待交付状态的最大帧数
+     *
+     * @param threads 解码线程数
+     * @param max_lag SKIP_LATE 策略允许的最大落后帧数
+     * @return size_t 帧数
+     */
+    static size_t get_in_flight(int threads, unsigned int max_lag);
+    /**
+     * @brief 设置运行指标注册表, 统计解码耗时, 抓取时导出已交付和跳过的帧数
+     *
+     * @param metrics 运行指标注册表
+     * @note 需在第一次 push 之前调用
+     */
+    void set_metrics(std::shared_ptr<Metrics> metrics);
+
+private:
+    typedef struct {
+        unsigned long seq; ///< 到达序号
+        unsigned int dataID; ///< 消息 ID
+        unsigned char *data; ///< 数据区
+        unsigned int lenth; ///< 数据区长度
+        std::chrono::steady_clock::time_point stamp; ///< 接收完成时间
+    } Job;
+    typedef struct {
+        unsigned int dataID; ///< 消息 ID
+        cv::Mat image; ///< 解码结果, 为空表示解码失败或被丢弃
+        int slot; ///< 所在 FrameRing 槽位, 未使用 FrameRing 时为 -1
+        std::chrono::steady_clock::time_point stamp; ///< 接收完成时间
+    } Result;
+
+    std::function<void(unsigned int, cv::Mat &)> on_frame; ///< 交付回调函数
+    std::shared_ptr<FrameRing> ring; ///< 帧缓冲池
+    SkipPolicy policy; ///< 跳帧策略
+    unsigned int max_lag; ///< SKIP_LATE 策略允许的最大落后帧数
+    size_t max_queue; ///< 待解码队列上限
+    size_t max_pending; ///< 解码中和待交付的帧数上限, 不超过 FrameRing 的 in_flight
+    bool stopped = false; ///< 是否已停止
+
+    std::deque<Job> jobs; ///< 待解码队列
+    unsigned long push_seq = 0; ///< 下一帧的到达序号
+    std::mutex jobs_mutex; ///< 保护 jobs 和 push_seq
+    std::condition_variable jobs_cv; ///< 通知工作线程
+    std::condition_variable space_cv; ///< 通知 WAIT_ALL 策略下等待队列空位的接收线程
+
+    std::map<unsigned long, Result> ready; ///< 已解码等待交付的帧
+    size_t decoding = 0; ///< 正在解码的帧数
+    unsigned long deliver_seq = 0; ///< 下一帧应交付的到达序号
+    unsigned long delivered = 0; ///< 已交付帧数
+    unsigned long skipped = 0; ///< 已跳过帧数
+    std::mutex ready_mutex; ///< 保护 ready 及交付状态
+    std::condition_variable ready_cv; ///< 通知交付线程
+    std::condition_variable pending_cv; ///< 通知等待 max_pending 空位的解码线程
+
+    std::vector<std::thread> workers; ///< 解码线程
+    std::thread deliverer; ///< 交付线程
+
+    std::shared_ptr<Metrics> metrics; ///< 运行指标注册表
+    int decode_time = -1; ///< 解码耗时的序列编号
+    int callback = -1; ///< 帧数回调 ID
+
+    void work(); ///< 解码线程处理函数
+    void deliver(); ///< 交付线程处理函数
+    void finish(const Job &job, cv::Mat image, int slot, bool decoded); ///< 提交解码结果, decoded 表示来自解码线程
+    void discard(Result &result); ///< 丢弃一帧, 归还其槽位, 需持有 ready_mutex
+    bool take(Result &result); ///< 按跳帧策略取出下一帧, 需持有 ready_mutex
+};
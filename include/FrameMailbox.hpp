@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+
+#include <opencv2/opencv.hpp>
+
+/**
+ * @brief FrameMailbox 类, 单槽最新帧信箱
+ *
+ * 一个写线程和一个读线程之间传递最新一帧, 内部为三缓冲:
+ * 写线程写后台缓冲, 读线程读前台缓冲, 两者通过原子交换中间缓冲交接,
+ * 读写双方都不会阻塞, 读线程来不及读取的旧帧直接被新帧覆盖
+ */
+class FrameMailbox {
+public:
+    /**
+     * @brief FrameMailbox 构造函数
+     *
+     */
+    FrameMailbox();
+    /**
+     * @brief 放入一帧, 覆盖尚未被读取的旧帧
+     *
+     * @param frame 图像, 会被拷贝到内部缓冲, 尺寸不变时不重新分配内存
+     * @note 只能由同一个写线程调用
+     */
+    void put(const cv::Mat &frame);
+    /**
+     * @brief 取出最新帧
+     *
+     * @param frame 取出的图像, 指向内部前台缓冲, 在下一次 take 之前有效
+     * @return true 有新帧, false 自上次取出后没有新帧
+     * @note 只能由同一个读线程调用
+     */
+    bool take(cv::Mat &frame);
+
+private:
+    static const int FRESH = 4; ///< 中间缓冲中有未读取新帧的标志位
+
+    cv::Mat buffers[3]; ///< 三个缓冲
+    std::atomic<int> middle; ///< 中间缓冲下标及 FRESH 标志
+    int back; ///< 写线程独占的后台缓冲下标
+    int front; ///< 读线程独占的前台缓冲下标
+};
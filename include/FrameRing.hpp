@@ -0,0 +1,101 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "Message.hpp"
+
+/**
+ * @brief FrameRing 类, 固定容量的帧缓冲池和历史帧环形队列
+ *
+ * 所有图像缓冲在使用中复用: 解码器从池中取出空闲槽位直接解码到槽位的 cv::Mat,
+ * 交付后槽位进入历史队列, 历史队列满时最旧的槽位回到空闲列表,
+ * 图像尺寸不变时整个过程不再分配内存
+ */
+class FrameRing {
+public:
+    /**
+     * @brief 一帧及其元数据
+     *
+     */
+    typedef struct {
+        cv::Mat image; ///< 图像
+        unsigned int dataID; ///< 消息 ID
+        std::chrono::steady_clock::time_point stamp; ///< 接收完成时间
+        Message::TransformData transform; ///< 对应的坐标变换
+        bool has_transform; ///< transform 是否有效
+    } Frame;
+
+    /**
+     * @brief FrameRing 构造函数
+     *
+     * @param history 保留的历史帧数, 至少为 2, 保证正在处理的最新帧不会被淘汰
+     * @param in_flight 同时解码中的最大帧数, 一般为解码线程数加待交付帧数
+     */
+    FrameRing(size_t history, size_t in_flight);
+    /**
+     * @brief 取出一个空闲槽位用于解码
+     *
+     * @return int 槽位下标, 没有空闲槽位时淘汰最旧的历史帧
+     */
+    int acquire();
+    /**
+     * @brief 获取槽位的图像缓冲, 解码器直接写入
+     *
+     * @param slot 槽位下标
+     * @return cv::Mat& 图像缓冲
+     * @note 只有 acquire 得到该槽位的线程可以在 commit/release 之前访问
+     */
+    cv::Mat &image(int slot);
+    /**
+     * @brief 放弃槽位 (解码失败或被跳过), 槽位回到空闲列表
+     *
+     * @param slot 槽位下标
+     */
+    void release(int slot);
+    /**
+     * @brief 将解码完成的槽位加入历史队列
+     *
+     * @param slot 槽位下标
+     * @param dataID 消息 ID
+     * @param stamp 接收完成时间
+     */
+    void commit(int slot, unsigned int dataID,
+                std::chrono::steady_clock::time_point stamp);
+    /**
+     * @brief 为历史中的某一帧附加坐标变换
+     *
+     * @param dataID 消息 ID
+     * @param transform 坐标变换
+     * @return true 找到该帧
+     */
+    bool set_transform(unsigned int dataID,
+                       const Message::TransformData &transform);
+    /**
+     * @brief 读取第 k 新的历史帧
+     *
+     * @param k 0 为最新帧
+     * @param frame 读取结果, 图像拷贝到 frame.image, 尺寸不变时不分配内存
+     * @return true 读取成功, false 历史帧不足 k + 1 帧
+     */
+    bool latest(size_t k, Frame &frame);
+    /**
+     * @brief 获取历史帧数
+     *
+     * @return size_t 帧数
+     */
+    size_t size();
+
+private:
+    std::vector<Frame> slots; ///< 全部槽位
+    std::vector<int> free_slots; ///< 空闲槽位栈
+    std::vector<int> order; ///< 历史队列, 环形存放槽位下标
+    size_t head = 0; ///< 历史队列中最旧一帧的位置
+    size_t count = 0; ///< 历史帧数
+    std::mutex mutex; ///< 保护以上成员, 不包括解码中槽位的图像数据
+
+    int evict(); ///< 淘汰最旧的历史帧并返回其槽位, 需持有 mutex
+};
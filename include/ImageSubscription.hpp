@@ -0,0 +1,71 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <opencv2/opencv.hpp>
+
+#include "Message.hpp"
+
+/**
+ * @brief ImageSubscriptions 类, 记录每个客户端订阅的图像分辨率和 ROI
+ *
+ * 未订阅的客户端接收原始全尺寸图像
+ */
+class ImageSubscriptions {
+public:
+    static constexpr unsigned int MAX_SIZE = 4096; ///< 订阅的缩放尺寸的最大边长
+
+    /**
+     * @brief 设置客户端的订阅参数, 覆盖之前的订阅
+     *
+     * @param client 客户端 ID
+     * @param subscription 订阅参数, Width 和 Height 限制在 MAX_SIZE 以内,
+     *        防止客户端让服务器每帧分配任意大的图像
+     */
+    void subscribe(int client,
+                   const Message::ImageSubscribeData &subscription);
+    /**
+     * @brief 删除客户端的订阅, 客户端断开时调用
+     *
+     * @param client 客户端 ID
+     */
+    void remove(int client);
+    /**
+     * @brief 获取客户端的订阅参数
+     *
+     * @param client 客户端 ID
+     * @return Message::ImageSubscribeData 订阅参数, 未订阅时全部为 0
+     */
+    Message::ImageSubscribeData get(int client);
+    /**
+     * @brief 获取所有客户端的订阅
+     *
+     * @return std::string 每行一个客户端的订阅参数
+     */
+    std::string get_subscriptions();
+    /**
+     * @brief 按订阅参数裁剪并缩放图像
+     *
+     * @param img 原图
+     * @param subscription 订阅参数
+     * @return cv::Mat 处理后的图像, 不需要处理时直接返回原图
+     * @note ROI 会被限制在原图范围内, 与原图没有交集时不裁剪
+     */
+    static cv::Mat apply(const cv::Mat &img,
+                         const Message::ImageSubscribeData &subscription);
+    /**
+     * @brief 判断两个订阅参数是否相同
+     *
+     * @param a 订阅参数
+     * @param b 订阅参数
+     * @return true 相同
+     */
+    static bool equal(const Message::ImageSubscribeData &a,
+                      const Message::ImageSubscribeData &b);
+
+private:
+    std::map<int, Message::ImageSubscribeData> subscriptions; ///< 客户端订阅
+    std::mutex mutex; ///< 保护 subscriptions
+};
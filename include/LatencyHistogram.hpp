@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief LatencyHistogram 类, 无锁的对数分桶延迟直方图
+ *
+ * 与 HDR 直方图相同, 每个 2 的幂区间再均分为 16 个子桶, 相对误差不超过 1/16,
+ * 覆盖 0 ~ 2^63 纳秒
+ *
+ * 记录只使用 relaxed 的原子加法, 不加锁; SocketServer 每个客户端一个接收线程,
+ * 按消息类型统计的直方图由所有接收线程同时记录, 不会丢失计数
+ */
+class LatencyHistogram {
+public:
+    static const int SUB_BITS = 4; ///< 每个 2 的幂区间的子桶数为 2^SUB_BITS
+    static const int BUCKETS = (64 - SUB_BITS + 1) << SUB_BITS; ///< 桶数
+
+    /**
+     * @brief LatencyHistogram 构造函数
+     *
+     * @param key 所属统计表中的键, 消息类型或客户端 ID
+     */
+    LatencyHistogram(int key = 0);
+    /**
+     * @brief 记录一个延迟
+     *
+     * @param ns 延迟, 单位纳秒, 小于 0 时按 0 记录
+     */
+    void record(long long ns)
+    {
+        unsigned long long v = ns < 0 ? 0 : ns;
+        buckets[index(v)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(v, std::memory_order_relaxed);
+        unsigned long long m = max.load(std::memory_order_relaxed);
+        while (v > m &&
+               !max.compare_exchange_weak(m, v, std::memory_order_relaxed)) {
+        }
+    }
+    /**
+     * @brief 计算百分位数
+     *
+     * @param p 百分位, 0 ~ 1
+     * @return long long 所在桶的上界, 单位纳秒, 没有记录时返回 0
+     * @note 与记录并发调用时结果是近似值
+     */
+    long long percentile(double p) const;
+    /**
+     * @brief 获取统计摘要
+     *
+     * @return std::string 记录数、平均值、p50/p90/p99/p99.9 和最大值, 单位微秒
+     */
+    std::string get_summary() const;
+    /**
+     * @brief 清空所有记录
+     *
+     */
+    void reset();
+
+    int get_key() const { return key; }
+    unsigned long get_count() const { return count.load(); }
+
+private:
+    const int key; ///< 所属统计表中的键
+    std::atomic<unsigned long> buckets[BUCKETS]; ///< 各桶计数
+    std::atomic<unsigned long> count; ///< 记录数
+    std::atomic<unsigned long long> sum; ///< 延迟总和, 单位纳秒
+    std::atomic<unsigned long long> max; ///< 最大延迟, 单位纳秒
+
+    static int index(unsigned long long v) ///< 值所在的桶
+    {
+        if (v < (1ull << SUB_BITS))
+            return (int)v;
+        int msb = 63 - __builtin_clzll(v);
+        return ((msb - SUB_BITS + 1) << SUB_BITS) +
+               (int)((v >> (msb - SUB_BITS)) & ((1 << SUB_BITS) - 1));
+    }
+    static unsigned long long upper(int i); ///< 桶的上界
+};
+
+/**
+ * @brief LatencyStats 类, 按整数键分组的延迟直方图表
+ *
+ * 固定容量的开放寻址表, 插入时用 CAS 抢占空槽, 查找和插入都不加锁,
+ * 直方图分配后直到表析构都不释放, 返回的指针始终有效
+ */
+class LatencyStats {
+public:
+    static const int CAPACITY = 256; ///< 最多的键数
+
+    LatencyStats();
+    ~LatencyStats();
+    /**
+     * @brief 记录一个延迟
+     *
+     * @param key 键
+     * @param ns 延迟, 单位纳秒
+     * @note 表已满时丢弃
+     */
+    void record(int key, long long ns)
+    {
+        LatencyHistogram *h = get(key);
+        if (h != nullptr)
+            h->record(ns);
+    }
+    /**
+     * @brief 查找键对应的直方图, 不存在时创建
+     *
+     * @param key 键
+     * @return LatencyHistogram* nullptr 表示表已满
+     */
+    LatencyHistogram *get(int key);
+    /**
+     * @brief 查找键对应的直方图, 不创建
+     *
+     * @param key 键
+     * @return const LatencyHistogram* nullptr 表示不存在
+     */
+    const LatencyHistogram *find(int key) const;
+    /**
+     * @brief 获取所有有记录的直方图, 按键升序
+     *
+     * @return std::vector<const LatencyHistogram *> 直方图列表
+     */
+    std::vector<const LatencyHistogram *> get_all() const;
+    /**
+     * @brief 清空所有直方图的记录
+     *
+     */
+    void reset();
+
+private:
+    std::atomic<LatencyHistogram *> slots[CAPACITY]; ///< 直方图, nullptr 表示空槽
+};
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+class Metrics;
+
+/**
+ * @brief 异步输出一条日志, 格式字符串中的 {} 依次替换为参数, {x} 以十六进制输出整数参数
+ *
+ * 调用线程只把格式字符串指针和参数值写入无锁环形缓冲区, 由后台线程格式化后调用
+ * INFO/DEBUG/WARNING/ERROR/SUCCESS 输出, 不会因终端输出阻塞网络线程.
+ * 每个调用位置单独限速, 默认每秒 DEFAULT_RATE 条, 允许 DEFAULT_BURST 条的突发;
+ * 超出限速的日志被抑制, 数量附在该位置下一条输出的日志后面.
+ * 缓冲区满时直接丢弃, 丢弃数通过 Log::get_dropped 或运行指标查看
+ *
+ * @note 格式字符串必须是字符串常量; 字符串参数被复制, 过长时截断
+ */
+#define LOG_AT(level, rate, burst, format, ...)                               \
+    do {                                                                      \
+        static Log::Site log_site_(level, format, __FILE__, __LINE__, rate,  \
+                                   burst);                                    \
+        Log::write(log_site_, ##__VA_ARGS__);                                 \
+    } while (0)
+#define LOG_DEBUG(format, ...)                                                \
+    LOG_AT(Log::LEVEL_DEBUG, Log::DEFAULT_RATE, Log::DEFAULT_BURST, format,  \
+           ##__VA_ARGS__)
+#define LOG_INFO(format, ...)                                                 \
+    LOG_AT(Log::LEVEL_INFO, Log::DEFAULT_RATE, Log::DEFAULT_BURST, format,   \
+           ##__VA_ARGS__)
+#define LOG_SUCCESS(format, ...)                                              \
+    LOG_AT(Log::LEVEL_SUCCESS, Log::DEFAULT_RATE, Log::DEFAULT_BURST,        \
+           format, ##__VA_ARGS__)
+#define LOG_WARNING(format, ...)                                              \
+    LOG_AT(Log::LEVEL_WARNING, Log::DEFAULT_RATE, Log::DEFAULT_BURST,        \
+           format, ##__VA_ARGS__)
+#define LOG_ERROR(format, ...)                                                \
+    LOG_AT(Log::LEVEL_ERROR, Log::DEFAULT_RATE, Log::DEFAULT_BURST, format,  \
+           ##__VA_ARGS__)
+
+/**
+ * @brief Log 类, 异步限速日志
+ *
+ * 多生产者单消费者的有界环形缓冲区, 每个槽带序号, 生产者用一次 CAS 占用槽位,
+ * 写完后发布序号; 后台线程按序号顺序读取. 限速使用 GCRA 算法,
+ * 每个调用位置一个原子的理论到达时间, 判断和更新也只需一次 CAS
+ */
+class Log {
+public:
+    /**
+     * @brief 日志级别, 对应 Info.hpp 中的输出宏
+     *
+     */
+    enum Level {
+        LEVEL_DEBUG,
+        LEVEL_INFO,
+        LEVEL_SUCCESS,
+        LEVEL_WARNING,
+        LEVEL_ERROR
+    };
+
+    static const unsigned int CAPACITY = 4096; ///< 环形缓冲区的槽数
+    static const int MAX_ARGS = 12; ///< 每条日志最多的参数数
+    static const int TEXT = 192; ///< 每条日志中字符串参数的总字节数
+    static constexpr double DEFAULT_RATE = 20; ///< 默认每个位置每秒的条数
+    static constexpr double DEFAULT_BURST = 40; ///< 默认允许的突发条数
+
+    /**
+     * @brief 调用位置, 由 LOG_AT 宏为每个调用位置生成一个静态实例
+     *
+     */
+    struct Site {
+        constexpr Site(Level level, const char *format, const char *file,
+                       int line, double rate, double burst)
+            : level(level), format(format), file(file), line(line),
+              interval(rate > 0 ? (long long)(1e9 / rate) : 0),
+              tolerance(rate > 0 ? (long long)(1e9 / rate * burst) : 0)
+        {
+        }
+
+        const Level level; ///< 级别
+        const char *const format; ///< 格式字符串
+        const char *const file; ///< 源文件
+        const int line; ///< 行号
+        const long long interval; ///< 限速的发放间隔, 单位纳秒, 0 表示不限速
+        const long long tolerance; ///< 允许的突发, 单位纳秒
+        std::atomic<long long> tat{ 0 }; ///< GCRA 理论到达时间
+        std::atomic<unsigned long> suppressed{ 0 }; ///< 上一条输出后被限速抑制的条数
+    };
+
+    /**
+     * @brief 写入一条日志, 由 LOG_* 宏调用
+     *
+     * @param site 调用位置
+     * @param args 参数, 支持整数、浮点数、字符串和 bool, 按值传递, 可以直接传入 packed 结构体的成员
+     */
+    template <typename... Args> static void write(Site &site, Args... args)
+    {
+        static_assert(sizeof...(Args) <= MAX_ARGS, "too many log arguments");
+        long long time = now();
+        if (!admit(site, time))
+            return;
+        Record *record = claim();
+        if (record == nullptr)
+            return;
+        record->site = &site;
+        record->time = time;
+        record->suppressed = site.suppressed.exchange(0);
+        record->count = 0;
+        record->text_used = 0;
+        (store(*record, args), ...);
+        publish(record);
+    }
+    /**
+     * @brief 等待后台线程输出缓冲区中的所有日志
+     *
+     * @param timeout_ms 最长等待时间, 单位毫秒
+     * @note 调用 _exit 退出前调用, 否则最后的日志可能不会输出
+     */
+    static void flush(int timeout_ms = 1000);
+    /**
+     * @brief 获取缓冲区满而丢弃的日志数
+     *
+     * @return unsigned long 丢弃数
+     */
+    static unsigned long get_dropped();
+    /**
+     * @brief 获取被限速抑制的日志数
+     *
+     * @return unsigned long 抑制数
+     */
+    static unsigned long get_suppressed();
+    /**
+     * @brief 把丢弃数和抑制数导出到运行指标注册表
+     *
+     * @param metrics 运行指标注册表, 导出 log_dropped_total 和 log_suppressed_total
+     */
+    static void set_metrics(std::shared_ptr<Metrics> metrics);
+
+private:
+    enum Type { INT, UINT, DOUBLE, TEXT_ARG };
+
+    /**
+     * @brief 缓冲区中的一条日志, 只保存参数值, 由后台线程格式化
+     *
+     */
+    struct Record {
+        std::atomic<unsigned long> sequence; ///< 槽位序号, 等于写入位置时可写, 等于写入位置加一时可读
+        const Site *site; ///< 调用位置
+        long long time; ///< 写入时间
+        unsigned long suppressed; ///< 之前被抑制的条数
+        int count; ///< 参数数
+        int text_used; ///< text 已使用的字节数
+        Type types[MAX_ARGS]; ///< 参数类型
+        union {
+            long long i;
+            unsigned long long u;
+            double d;
+            int text; ///< 字符串在 text 中的偏移
+        } values[MAX_ARGS]; ///< 参数值
+        char text[TEXT]; ///< 字符串参数, 以 0 结尾
+    };
+
+    /**
+     * @brief 环形缓冲区和后台线程, 首次写入时创建
+     *
+     */
+    struct Queue {
+        Record records[CAPACITY]; ///< 槽位
+        std::atomic<unsigned long> head{ 0 }; ///< 下一个写入位置
+        std::atomic<unsigned long> tail{ 0 }; ///< 下一个读取位置, 只由后台线程修改
+        std::atomic<bool> stop{ false }; ///< 停止后台线程
+        std::thread thread; ///< 后台格式化线程
+
+        Queue();
+        ~Queue();
+        void run(); ///< 后台线程处理函数
+        bool drain(); ///< 输出所有已发布的日志, 没有日志时返回 false
+    };
+
+    static std::atomic<unsigned long> dropped; ///< 缓冲区满丢弃的条数
+    static std::atomic<unsigned long> suppressed; ///< 被限速抑制的条数
+
+    static Queue &queue(); ///< 全局缓冲区
+    static long long now(); ///< steady_clock 纳秒时间戳
+    static bool admit(Site &site, long long time); ///< 限速判断
+    static Record *claim(); ///< 占用一个槽位, 缓冲区满时返回 nullptr
+    static void publish(Record *record); ///< 发布写完的槽位
+    static std::string format(const Record &record); ///< 格式化一条日志
+
+    template <typename V> static void store(Record &record, const V &value)
+    {
+        typedef typename std::decay<V>::type D;
+        int i = record.count++;
+        if constexpr (std::is_same<D, bool>::value) {
+            store_text(record, i, value ? "true" : "false");
+        } else if constexpr (std::is_integral<D>::value &&
+                             std::is_signed<D>::value) {
+            record.types[i] = INT;
+            record.values[i].i = value;
+        } else if constexpr (std::is_integral<D>::value ||
+                             std::is_enum<D>::value) {
+            record.types[i] = UINT;
+            record.values[i].u = (unsigned long long)value;
+        } else if constexpr (std::is_floating_point<D>::value) {
+            record.types[i] = DOUBLE;
+            record.values[i].d = value;
+        } else {
+            store_text(record, i, std::string_view(value));
+        }
+    }
+    static void store_text(Record &record, int i, std::string_view text)
+    {
+        // 空间不足时截断, 至少保留结尾的 0
+        int lenth = std::min<int>(text.size(), TEXT - 1 - record.text_used);
+        if (lenth < 0)
+            lenth = 0;
+        record.types[i] = TEXT_ARG;
+        record.values[i].text = record.text_used;
+        memcpy(record.text + record.text_used, text.data(), lenth);
+        record.text[record.text_used + lenth] = 0;
+        record.text_used = std::min(TEXT - 1, record.text_used + lenth + 1);
+    }
+};
@@ -5,12 +5,33 @@
  */
 class Message {
 public:
+    static const unsigned int TILED_IMAGE_MAGIC = 0x454C4954; // "TILE"
+    // MessageType 的最高位表示 Data 末尾带有 TimestampExtension, get_messageType 返回时去掉该位
+    static const unsigned short TIMESTAMP_FLAG = 0x8000;
+
     enum MessageType {
         STRING_MSG = 0x0000,
+        PING = 0x0001,
+        PONG = 0x0002,
         IMAGE_MSG = 0x1145,
+        IMAGE_SUBSCRIBE = 0x1146,
         CAMERA_INFO = 0x1419,
         TRANSFORM = 0x1981,
-        TRANSFORM_REQUEST = 0x1982
+        TRANSFORM_REQUEST = 0x1982,
+        TRANSFORM_SUBSCRIBE = 0x1983,
+        TRANSFORM_REQUEST_STAMPED = 0x1984,
+        TRANSFORM_PUBLISH = 0x1985,
+        TRANSFORM_BATCH_REQUEST = 0x1986,
+        TRANSFORM_BATCH = 0x1987,
+        OBSERVATION = 0x2024,
+        PREDICTION = 0x2025
+    };
+
+    // TRANSFORM_SUBSCRIBE 的推送策略
+    enum TransformPushPolicy {
+        PUSH_ON_CHANGE = 0, // 坐标变换变化时推送
+        PUSH_RATE = 1,      // 按固定频率推送
+        PUSH_CANCEL = 2     // 取消订阅
     };
 
 #pragma pack(1) // 关闭内存对齐
@@ -28,6 +49,22 @@ public:
         unsigned short End = 0x0721;    // 结束位       10238 ~ 10239
     } MessageBuffer;                // 10240 Bytes
 
+    // MessageType 带有 TIMESTAMP_FLAG 时, Data 的最后 16 字节为时间戳扩展,
+    // 此时每个分包最多携带 10218 - 16 字节数据. 时间戳为发送端的 steady_clock 纳秒,
+    // 不同主机之间需要按 PING/PONG 估计的时钟偏移换算后才能比较
+    typedef struct{
+        long long OriginTime;   // encode_and_send 开始的时间, 同一消息的所有分包相同
+        long long SendTime;     // 该分包发送的时间
+    } TimestampExtension;
+
+    // MessageType 为 PING 和 PONG 时的 Data 部分数据结构, 时间戳为各自的 steady_clock 纳秒
+    // 对端收到 PING 后填入 T2 和 T3, 以相同的 DataID 回复 PONG
+    typedef struct{
+        long long T1;           // 发送 PING 的时间
+        long long T2;           // 对端接收 PING 的时间
+        long long T3;           // 对端发送 PONG 的时间
+    } ClockSyncData;
+
     // MessageType 为 IMAGE_MSG 时的 Data 部分数据结构
     // 此时 Offset 为 ImageData 的偏移
     //* 已弃用
@@ -38,10 +75,48 @@ public:
         unsigned char ImageData[10218 - 12];
     } ImageData;
 
+    // MessageType 为 IMAGE_SUBSCRIBE 时的 Data 部分数据结构
+    // 服务器先按 ROI 裁剪原图, 再缩放到 Width x Height 后编码发送
+    // RoiWidth 或 RoiHeight 为 0 表示不裁剪, Width 或 Height 为 0 表示不缩放
+    // TileRows 和 TileCols 均大于 0 且不同时为 1 时使用分块编码
+    typedef struct{
+        int RoiX;
+        int RoiY;
+        int RoiWidth;
+        int RoiHeight;
+        unsigned int Width;
+        unsigned int Height;
+        unsigned int TileRows;
+        unsigned int TileCols;
+    } ImageSubscribeData;
+
+    // 分块编码的 IMAGE_MSG 数据区头部, 用 Magic 与普通 jpg 数据区分
+    // 之后紧跟 TileCount 个 ImageTileHeader, 再之后是各分块的 jpg 数据
+    typedef struct{
+        unsigned int Magic;     // 固定为 TILED_IMAGE_MAGIC
+        unsigned int Rows;      // 整幅图像行数
+        unsigned int Cols;      // 整幅图像列数
+        unsigned int Channels;  // 图像通道数, 1 或 3
+        unsigned int TileCount; // 分块数
+    } TiledImageHeader;
+
+    // 分块编码中每个分块的头部
+    typedef struct{
+        unsigned int X;         // 分块在整幅图像中的列偏移
+        unsigned int Y;         // 分块在整幅图像中的行偏移
+        unsigned int Width;     // 分块宽度
+        unsigned int Height;    // 分块高度
+        unsigned int Offset;    // 分块 jpg 数据相对数据区起始的偏移
+        unsigned int Lenth;     // 分块 jpg 数据长度
+    } ImageTileHeader;
+
     // MessageType 为 CAMERA_INFO 时的 Data 部分数据结构
+    // Width 和 Height 为标定时的图像分辨率, 内参对应该分辨率的完整图像
     typedef struct{
         double CameraMatrix[9];
         double DistortionCoefficients[5];
+        unsigned int Width;
+        unsigned int Height;
     } CameraInfoData;
 
     // MessageType 为 TRANSFORM 时的 Data 部分数据结构
@@ -55,6 +130,55 @@ public:
         char From[10218 / 2];
         char To[10218 / 2];
     } TransformRequestData;
+    // MessageType 为 TRANSFORM_SUBSCRIBE 时的 Data 部分数据结构
+    // 消息的 DataID 作为订阅 ID, 服务器推送的 TRANSFORM 消息使用相同的 DataID
+    typedef struct{
+        char From[64];
+        char To[64];
+        unsigned int Policy;    // TransformPushPolicy
+        double Rate;            // Policy 为 PUSH_RATE 时的推送频率, 单位 Hz
+    } TransformSubscribeData;
+    // MessageType 为 TRANSFORM_REQUEST_STAMPED 时的 Data 部分数据结构
+    // 查询指定时刻的坐标变换, 服务器回复的 TRANSFORM 消息使用请求的 DataID
+    typedef struct{
+        char From[64];
+        char To[64];
+        long long Stamp;        // system_clock 纳秒时间戳
+    } TransformStampedRequestData;
+    // MessageType 为 TRANSFORM_PUBLISH 时的 Data 部分数据结构
+    // 客户端向服务器发布一条边的坐标变换, 服务器不回复
+    typedef struct{
+        char From[64];
+        char To[64];
+        long long Stamp;        // system_clock 纳秒时间戳, 0 表示使用服务器接收时间
+        TransformData Transform;
+    } TransformPublishData;
+    // MessageType 为 TRANSFORM_BATCH_REQUEST 和 TRANSFORM_BATCH 时 Data 部分的头部
+    // 请求: TransformBatchHeader + Count 个 TransformPair
+    // 回复: TransformBatchHeader + Count 个 TransformBatchResult, 使用请求的 DataID
+    typedef struct{
+        long long Stamp;        // system_clock 纳秒时间戳, 0 表示最新
+        unsigned int Count;     // 坐标系对数量
+    } TransformBatchHeader;
+    typedef struct{
+        char From[32];
+        char To[32];
+    } TransformPair;
+    typedef struct{
+        unsigned int Valid;     // 0 表示该坐标系对不存在或超出历史范围
+        TransformData Transform;
+    } TransformBatchResult;
+    // MessageType 为 OBSERVATION 和 PREDICTION 时的 Data 部分数据结构
+    // PoseBatchHeader + Count 个 PoseSample
+    typedef struct{
+        unsigned int Count;     // 位姿数量
+    } PoseBatchHeader;
+    typedef struct{
+        long long Stamp;        // system_clock 纳秒时间戳
+        unsigned int Target;    // 目标编号
+        double Position[3];     // 位置 xyz
+        double Rotation[4];     // 姿态四元数 xyzw
+    } PoseSample;
 #pragma pack()  // 开启内存对齐
 
     Message();
@@ -69,6 +193,7 @@ public:
     void set_dataTotalLenth(const unsigned int lenth);
     void set_offset(const unsigned int offset);
     void set_data(const char *data, const unsigned int lenth);
+    void set_timestamps(const long long origin, const long long send);
 
     unsigned short get_messageType() const;
     unsigned int get_dataID() const;
@@ -77,6 +202,8 @@ public:
     unsigned int get_dataLenth() const;
     const unsigned char *get_data() const;
     const unsigned char *get_buffer() const;
+    bool get_timestamps(long long &origin, long long &send) const;
+    unsigned int get_capacity() const;
 
 private:
     MessageBuffer message;
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Metrics 类, 进程内的运行指标注册表, 以 Prometheus 文本格式导出
+ *
+ * 每个指标序列 (名称 + 标签) 分配一个整数编号, 计数保存在每个线程自己的分片中,
+ * 热路径上只有一次线程局部查找和一次非原子化的加法, 不使用锁和带 lock 前缀的指令.
+ * 抓取时把所有线程的分片求和, 线程退出时其分片合并到注册表中, 计数不会丢失
+ *
+ * 计数器 (COUNTER) 和可增减的仪表 (GAUGE) 都按分片求和; 摘要 (SUMMARY) 占用两个编号,
+ * 分别保存观测值总和与观测次数. 只能在抓取时读取的值 (如发送队列深度) 使用回调函数导出
+ */
+class Metrics {
+public:
+    /**
+     * @brief 指标类型
+     *
+     */
+    enum Type {
+        COUNTER, ///< 只增不减的计数
+        GAUGE, ///< 可增减的数值
+        SUMMARY ///< 观测值的总和与次数, 导出为 <name>_sum 和 <name>_count
+    };
+
+    /**
+     * @brief 回调导出的一组采样, 每个元素为 (标签, 值)
+     *
+     */
+    typedef std::vector<std::pair<std::string, double>> Samples;
+
+    /**
+     * @brief 按一个整数标签区分的一组指标序列, 例如按客户端 ID 或消息类型
+     *
+     * 整数键到序列编号的映射保存在固定容量的无锁表中, 首次出现的键才需要加锁注册
+     */
+    class Family {
+    public:
+        static const int CAPACITY = 512; ///< 最多的键数, 超出后的键不再统计
+
+        /**
+         * @brief 增加某个键的计数
+         *
+         * @param key 标签值
+         * @param n 增量, GAUGE 可以为负
+         */
+        void add(int key, long long n);
+        /**
+         * @brief 记录某个键的一次观测, 只用于 SUMMARY
+         *
+         * @param key 标签值
+         * @param value 观测值, 按注册时的 scale 换算后导出
+         */
+        void observe(int key, long long value);
+
+    private:
+        friend class Metrics;
+        Family(Metrics *metrics, const std::string &name,
+               const std::string &labels, const std::string &key_label,
+               bool hex);
+
+        Metrics *metrics; ///< 所属注册表
+        std::string name; ///< 指标名称
+        std::string labels; ///< 固定标签
+        std::string key_label; ///< 整数标签的名称
+        bool hex; ///< 整数标签是否以十六进制导出
+        std::atomic<unsigned long long> slots[CAPACITY]; ///< 高 32 位为键, 低 32 位为序列编号加一, 0 表示空槽
+
+        int get(int key); ///< 查找或注册键对应的序列编号
+    };
+
+    /**
+     * @brief Metrics 构造函数
+     *
+     */
+    Metrics();
+    /**
+     * @brief Metrics 析构函数, 停止 HTTP 服务线程
+     *
+     */
+    ~Metrics();
+    /**
+     * @brief 注册一个指标序列, 名称和标签都相同时返回已有的编号
+     *
+     * @param name 指标名称
+     * @param help 说明
+     * @param type 指标类型
+     * @param labels 标签, 例如 port="8000",client="1", 可以为空
+     * @param scale 导出时的换算系数, 例如纳秒计数导出为秒时为 1e-9
+     * @return int 序列编号, < 0 表示编号已用完
+     */
+    int add_series(const std::string &name, const std::string &help, Type type,
+                   const std::string &labels = "", double scale = 1);
+    /**
+     * @brief 注册一组按整数标签区分的指标序列
+     *
+     * @param name 指标名称
+     * @param help 说明
+     * @param type 指标类型
+     * @param labels 固定标签, 可以为空
+     * @param key_label 整数标签的名称
+     * @param scale 导出时的换算系数
+     * @param hex 整数标签是否以十六进制导出, 用于消息类型
+     * @return std::shared_ptr<Family> 指标组
+     */
+    std::shared_ptr<Family> add_family(const std::string &name,
+                                       const std::string &help, Type type,
+                                       const std::string &labels,
+                                       const std::string &key_label,
+                                       double scale = 1, bool hex = false);
+    /**
+     * @brief 注册抓取时调用的回调函数
+     *
+     * @param name 指标名称
+     * @param help 说明
+     * @param type COUNTER 或 GAUGE
+     * @param callback 返回当前的采样
+     * @return int 回调 ID, 用于 remove_callback
+     */
+    int add_callback(const std::string &name, const std::string &help,
+                     Type type, std::function<Samples()> callback);
+    /**
+     * @brief 注销回调函数, 回调引用的对象析构前调用
+     *
+     * @param id 回调 ID
+     */
+    void remove_callback(int id);
+    /**
+     * @brief 增加计数
+     *
+     * @param series 序列编号, < 0 时忽略
+     * @param n 增量
+     */
+    void add(int series, long long n);
+    /**
+     * @brief 记录一次观测, 只用于 SUMMARY
+     *
+     * @param series 序列编号, < 0 时忽略
+     * @param value 观测值
+     */
+    void observe(int series, long long value);
+    /**
+     * @brief 汇总所有线程的计数, 生成 Prometheus 文本格式
+     *
+     * @return std::string 文本
+     */
+    std::string scrape();
+    /**
+     * @brief 在后台线程中提供 HTTP 服务, GET /metrics 返回 scrape 的结果
+     *
+     * @param port 端口, 只监听本机回环地址
+     * @return true 开始监听
+     * @note 逐个处理连接, 每个连接最多等待 TIMEOUT_MS 毫秒, 空闲连接不会阻塞后续抓取
+     */
+    bool serve(int port);
+
+private:
+    static const int TIMEOUT_MS = 1000; ///< HTTP 连接的读写超时, 单位毫秒
+    static const int CHUNK = 256; ///< 每块的编号数
+    static const int CHUNKS = 256; ///< 每个分片最多的块数
+
+    /**
+     * @brief 一个线程的计数分片, 只由该线程写入
+     *
+     * 按块分配, 抓取线程读取时块指针和计数都是原子的
+     */
+    struct Shard {
+        std::atomic<std::atomic<long long> *> chunks[CHUNKS];
+        Shard();
+        ~Shard();
+    };
+
+    typedef struct {
+        std::string labels; ///< 标签
+        int cell; ///< 编号
+    } Series;
+
+    typedef struct {
+        std::string help; ///< 说明
+        Type type; ///< 指标类型
+        double scale; ///< 导出时的换算系数
+        std::vector<Series> series; ///< 所有序列, 按注册顺序
+    } Descriptor;
+
+    typedef struct {
+        int id; ///< 回调 ID
+        std::string name; ///< 指标名称
+        std::string help; ///< 说明
+        Type type; ///< 指标类型
+        std::function<Samples()> callback; ///< 回调函数
+    } Callback;
+
+    /**
+     * @brief 注册表状态, 由注册表和使用过它的线程共享, 线程退出时仍可合并分片
+     *
+     */
+    struct State {
+        std::mutex mutex; ///< 保护以下所有成员
+        std::map<std::string, Descriptor> descriptors; ///< 按名称排序的指标
+        std::map<std::string, int> cells; ///< 名称和标签到编号的映射
+        int next_cell = 0; ///< 下一个可用编号
+        std::vector<Shard *> shards; ///< 存活线程的分片
+        std::vector<long long> retired; ///< 已退出线程的计数之和
+        std::vector<Callback> callbacks; ///< 回调函数
+        int next_callback = 0; ///< 下一个回调 ID
+    };
+
+    std::shared_ptr<State> state; ///< 注册表状态
+    int server_fd = -1; ///< HTTP 监听 socket
+    std::thread server; ///< HTTP 服务线程
+
+    Shard *local(); ///< 当前线程的分片, 首次使用时创建
+    void respond(int client); ///< 处理一个 HTTP 请求
+    static void retire(State &state, Shard *shard); ///< 把分片合并到 retired 并释放
+    static std::string format(double value); ///< 格式化数值
+};
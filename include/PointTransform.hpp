@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "Message.hpp"
+
+/**
+ * @brief PointTransform 类, 对点集批量应用坐标变换
+ *
+ * 点集按结构体数组拆分 (SoA) 保存为 x, y, z 三个数组, 坐标变换预先转换为旋转矩阵和平移,
+ * 支持 AVX2 的 CPU 上每次处理 4 个点, 其他 CPU 使用标量实现, 运行时自动选择
+ */
+class PointTransform {
+public:
+    /**
+     * @brief PointTransform 构造函数, 单位变换
+     *
+     */
+    PointTransform();
+    /**
+     * @brief 由接收到的坐标变换构造
+     *
+     * @param data 坐标变换, p' = R(Rotation) * p + Translation
+     */
+    PointTransform(const Message::TransformData &data);
+    /**
+     * @brief 由坐标变换链构造
+     *
+     * @param chain 坐标变换链, 依次应用 chain[0], chain[1], ...
+     */
+    PointTransform(const std::vector<Message::TransformData> &chain);
+    /**
+     * @brief 复合坐标变换, 先应用 other 再应用本变换
+     *
+     * @param other 先应用的坐标变换
+     * @return PointTransform 复合后的坐标变换
+     */
+    PointTransform operator*(const PointTransform &other) const;
+    /**
+     * @brief 变换点集
+     *
+     * @param x 输入 x 坐标
+     * @param y 输入 y 坐标
+     * @param z 输入 z 坐标
+     * @param out_x 输出 x 坐标, 可以与输入相同
+     * @param out_y 输出 y 坐标, 可以与输入相同
+     * @param out_z 输出 z 坐标, 可以与输入相同
+     * @param n 点数
+     */
+    void apply(const double *x, const double *y, const double *z,
+               double *out_x, double *out_y, double *out_z, size_t n) const;
+    /**
+     * @brief 使用标量实现变换点集, 参数同 apply
+     *
+     */
+    void apply_scalar(const double *x, const double *y, const double *z,
+                      double *out_x, double *out_y, double *out_z,
+                      size_t n) const;
+    /**
+     * @brief 使用 AVX2 实现变换点集, 参数同 apply
+     *
+     * @note 只能在 has_avx2() 为 true 时调用
+     */
+    void apply_avx2(const double *x, const double *y, const double *z,
+                    double *out_x, double *out_y, double *out_z,
+                    size_t n) const;
+    /**
+     * @brief CPU 是否支持 AVX2 和 FMA
+     *
+     * @return true 支持
+     */
+    static bool has_avx2();
+
+private:
+    double r[9]; ///< 旋转矩阵, 行优先
+    double t[3]; ///< 平移
+};
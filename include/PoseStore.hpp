@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Message.hpp"
+
+/**
+ * @brief PoseStore 类, 按列存储客户端上传的观测和预测位姿
+ *
+ * 每列预先分配固定容量, 接收线程整批追加到当前块, 写入线程定期或在当前块过半时
+ * 交换两个块, 在锁外把写满的块按列追加写入二进制文件. 写入跟不上时丢弃新数据并计数,
+ * 不阻塞接收线程
+ *
+ * 文件由若干块组成, 每块为 BlockHeader 后依次是各列的连续数组:
+ * stamp (int64), client (int32), kind (uint16), target (uint32), 7 列 double
+ * (位置 xyz, 四元数 xyzw), 每列 Rows 个元素
+ */
+class PoseStore {
+public:
+    static const unsigned int BLOCK_MAGIC = 0x45534F50; ///< "POSE"
+
+    /**
+     * @brief 位姿类型
+     *
+     */
+    enum Kind { OBSERVATION = 0, PREDICTION = 1 };
+
+#pragma pack(1)
+    typedef struct {
+        unsigned int Magic; ///< BLOCK_MAGIC
+        unsigned int Version; ///< 文件格式版本, 当前为 1
+        unsigned long long Rows; ///< 行数
+    } BlockHeader;
+#pragma pack()
+
+    /**
+     * @brief PoseStore 构造函数, 启动写入线程
+     *
+     * @param path 追加写入的文件路径
+     * @param capacity 每块的行数
+     * @param interval 定期写入的间隔
+     */
+    PoseStore(const std::string &path, size_t capacity = 65536,
+              std::chrono::milliseconds interval = std::chrono::seconds(1));
+    /**
+     * @brief PoseStore 析构函数, 写入剩余数据并停止写入线程
+     *
+     */
+    ~PoseStore();
+    /**
+     * @brief 追加一批位姿
+     *
+     * @param client 客户端 ID
+     * @param kind 位姿类型
+     * @param samples 位姿数组
+     * @param count 位姿数量
+     * @return size_t 实际保存的数量, 当前块已满时丢弃其余数据
+     */
+    size_t append(int client, Kind kind, const Message::PoseSample *samples,
+                  size_t count);
+    /**
+     * @brief 获取统计信息
+     *
+     * @return std::string 接收、写入和丢弃的行数
+     */
+    std::string get_stats();
+    /**
+     * @brief 获取写入线程来不及写出而丢弃的行数
+     *
+     * @return unsigned long 丢弃的行数
+     */
+    unsigned long get_dropped() const { return dropped.load(); }
+
+private:
+    typedef struct {
+        size_t rows; ///< 已写入行数
+        std::vector<long long> stamp; ///< 时间戳列
+        std::vector<int> client; ///< 客户端列
+        std::vector<unsigned short> kind; ///< 类型列
+        std::vector<unsigned int> target; ///< 目标编号列
+        std::vector<double> values[7]; ///< 位置和姿态列
+    } Block;
+
+    size_t capacity; ///< 每块行数
+    std::chrono::milliseconds interval; ///< 定期写入间隔
+    std::ofstream file; ///< 追加写入的文件
+    std::unique_ptr<Block> active; ///< 接收线程追加的块
+    std::unique_ptr<Block> spare; ///< 空闲块, 写入线程写文件期间为空
+    std::mutex mutex; ///< 保护 active 和 spare
+    std::condition_variable cv; ///< 当前块过半时唤醒写入线程
+    bool stopped = false; ///< 是否停止
+    std::thread writer; ///< 写入线程
+
+    std::atomic<unsigned long> received; ///< 保存的行数
+    std::atomic<unsigned long> written; ///< 写入文件的行数
+    std::atomic<unsigned long> dropped; ///< 丢弃的行数
+
+    std::unique_ptr<Block> make_block(); ///< 分配一个块
+    void write(const Block &block); ///< 按列写入一个块
+    void flush(); ///< 写入线程函数
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief RequestTable 类, 请求/回复的关联表
+ *
+ * 每个请求分配唯一的关联 ID 作为消息的 DataID, 对端回复时使用相同的 DataID,
+ * 接收线程据此把回复交给对应请求的 future, 同一连接上可以同时有任意多个未完成的请求.
+ * 一个计时线程在最早的超时时刻醒来使超时的请求失败, 连接上没有其他流量时 future 也会按时就绪
+ */
+class RequestTable {
+public:
+    static const unsigned int ID_BASE = 0x80000000; ///< 关联 ID 起始值, 避免与图像 dataID 冲突
+    static const unsigned int ID_COUNT = 0x7FFF0000; ///< 关联 ID 数量, 不与 TransformCache 的订阅 ID 重叠
+
+    /**
+     * @brief 请求的回复
+     *
+     */
+    typedef struct {
+        bool ok; ///< false 表示超时或发送失败
+        unsigned short type; ///< 回复的消息类型
+        std::vector<unsigned char> data; ///< 回复的数据区
+    } Reply;
+
+    /**
+     * @brief RequestTable 构造函数, 启动计时线程
+     *
+     */
+    RequestTable();
+    /**
+     * @brief RequestTable 析构函数, 停止计时线程, 未完成的请求均失败
+     *
+     */
+    ~RequestTable();
+    /**
+     * @brief 登记一个新请求
+     *
+     * @param id 分配的关联 ID, 作为请求消息的 DataID
+     * @param timeout 超时时间
+     * @return std::future<Reply> 收到回复或超时后就绪, 超时后 Reply::ok 为 false
+     */
+    std::future<Reply> add(unsigned int &id, std::chrono::milliseconds timeout);
+    /**
+     * @brief 交付回复
+     *
+     * @param id 回复消息的 DataID
+     * @param type 回复消息类型
+     * @param data 数据区
+     * @param lenth 数据区长度
+     * @return true id 属于未完成的请求, 回复已交付
+     */
+    bool complete(unsigned int id, unsigned short type,
+                  const unsigned char *data, unsigned int lenth);
+    /**
+     * @brief 使请求失败, 用于发送失败
+     *
+     * @param id 关联 ID
+     */
+    void fail(unsigned int id);
+    /**
+     * @brief 判断 DataID 是否在关联 ID 范围内
+     *
+     * @param id DataID
+     * @return true 可能是请求的回复
+     */
+    static bool is_request_id(unsigned int id);
+    /**
+     * @brief 获取未完成的请求数
+     *
+     * @return size_t 请求数
+     */
+    size_t get_pending();
+
+private:
+    typedef struct {
+        std::promise<Reply> promise; ///< 回复
+        std::chrono::steady_clock::time_point deadline; ///< 超时时刻
+    } Pending;
+
+    std::mutex mutex; ///< 保护 pending, deadlines 和 stopped
+    std::unordered_map<unsigned int, Pending> pending; ///< 未完成的请求
+    std::multimap<std::chrono::steady_clock::time_point, unsigned int>
+        deadlines; ///< 按超时时刻排序, 已完成请求的条目在检查超时时跳过
+    unsigned int counter = 0; ///< 关联 ID 计数
+    std::condition_variable cv; ///< 出现更早的超时时刻或停止时唤醒计时线程
+    bool stopped = false; ///< 是否停止计时线程
+    std::thread timer; ///< 计时线程
+
+    void run(); ///< 计时线程函数, 等待到最早的超时时刻后使超时的请求失败
+};
@@ -6,7 +6,11 @@
 #include <cstring>
 #include <arpa/inet.h>
 #include <functional>
+#include <memory>
+#include <mutex>
 
+#include "Metrics.hpp"
+#include "StreamLog.hpp"
 
 /**
  * @brief SocketClient 类, 基础的 socket 客户端类
@@ -63,15 +67,35 @@ public:
      * 
      */
     void join();
+    /**
+     * @brief 设置运行指标注册表, 统计收发的字节数和消息数、发送失败次数
+     * 
+     * @param metrics 运行指标注册表, 指标带有 server="地址:端口" 标签
+     */
+    void set_metrics(std::shared_ptr<Metrics> metrics);
+    /**
+     * @brief 设置记录器, 接收到的每个应用层消息都原样追加到记录文件
+     * 
+     * @param recorder 记录器, nullptr 表示停止记录, 记录的 Source 为服务器端口
+     * @note 需在 connect 之前调用
+     */
+    void set_recorder(std::shared_ptr<StreamRecorder> recorder);
 
 private:
     const char* address;    ///< 服务器地址
     int port;            ///< 服务器端口
     int client_fd;      ///< socket 描述符
+    std::mutex send_mutex; ///< 写锁, 回复 PING 与其他线程的发送同时进行时分包不会交错
     std::function<void(const char*)> on_message;    ///< 接收到消息时的回调函数
     std::function<void()> on_connect;   ///< 连接成功时的回调函数
     std::function<void()> on_disconnect;    ///< 断开连接时的回调函数
 
+    std::shared_ptr<Metrics> metrics; ///< 运行指标注册表
+    int bytes_sent = -1, bytes_received = -1; ///< 收发字节数的序列编号
+    int messages_sent = -1, messages_received = -1; ///< 收发消息数的序列编号
+    int send_errors = -1; ///< 发送失败次数的序列编号
+    std::shared_ptr<StreamRecorder> recorder; ///< 接收数据记录器
+
     void receive();   ///< 接收消息线程处理函数
 };
 #endif
\ No newline at end of file
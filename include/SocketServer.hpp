@@ -7,7 +7,13 @@
 #include <arpa/inet.h>
 #include <thread>
 #include <map>
+#include <mutex>
+#include <vector>
+#include <string>
 #include <functional>
+#include <memory>
+
+#include "Metrics.hpp"
 
 /**
  * @brief SocketServer 类, 基础的 socket 服务器类
@@ -84,18 +90,48 @@ public:
      * @return std::string 客户端列表
      */
     std::string get_clients();
+    /**
+     * @brief 获取当前连接的客户端 ID 列表
+     * 
+     * @return std::vector<int> 客户端 ID 列表
+     */
+    std::vector<int> get_client_ids();
+    /**
+     * @brief 获取客户端发送队列中尚未被对端确认的字节数
+     * 
+     * @param client 客户端 ID
+     * @return int 字节数, < 0 表示客户端不存在或获取失败
+     */
+    int get_send_queue(int client);
+    /**
+     * @brief 设置运行指标注册表, 统计每个客户端收发的字节数和消息数、发送失败次数,
+     *        抓取时导出发送队列深度和客户端数
+     * 
+     * @param metrics 运行指标注册表, 指标带有 port 标签
+     * @note 需在 start 之前调用, 服务器析构前注册表不能析构
+     */
+    void set_metrics(std::shared_ptr<Metrics> metrics);
 
 private:
     int port;   ///< 服务器端口
     int server_fd;  ///< 服务器 socket 描述符
     std::map<int, int> clients; ///< 客户端列表
     std::map<int, std::thread::native_handle_type> receive_threads;   ///< 接收线程列表
+    std::map<int, std::shared_ptr<std::mutex>> write_mutexes; ///< 各客户端的写锁, 多个线程同时写同一个 socket 时分包会交错
+    std::mutex clients_mutex; ///< 保护 clients, receive_threads 和 write_mutexes, 不在持有时读写 socket 或调用回调函数
 
     std::function<void(int, const char*)> on_message;   ///< 接收到消息时的回调函数
     std::function<void(int)> on_connect;    ///< 连接成功时的回调函数
     std::function<void(int)> on_disconnect; ///< 断开连接时的回调函数
 
+    std::shared_ptr<Metrics> metrics; ///< 运行指标注册表
+    std::shared_ptr<Metrics::Family> bytes_sent, bytes_received; ///< 每个客户端收发的字节数
+    std::shared_ptr<Metrics::Family> messages_sent, messages_received; ///< 每个客户端收发的消息数
+    std::shared_ptr<Metrics::Family> send_errors; ///< 每个客户端发送失败次数
+
     void accept();  ///< accept 线程处理函数
     void receive(int client);   ///< receive 线程处理函数
+    static int write_all(int fd, std::mutex &mutex, const char *message,
+                         int lenth); ///< 持有写锁写入完整的消息
 };
 #endif
\ No newline at end of file
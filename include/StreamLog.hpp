@@ -0,0 +1,151 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+
+/**
+ * @brief 记录文件的格式
+ *
+ * 记录按分段文件保存, 文件名为 <前缀>.000000.log、<前缀>.000001.log ...
+ * 每个分段以 SegmentHeader 开头, 之后是连续的记录, 每条记录为 RecordHeader
+ * 加上接收到的原始数据, 数据按 8 字节对齐. Lenth 为 0 的记录头表示分段结束,
+ * 进程异常退出时分段末尾未写入的部分全为 0, 读取时同样在此结束
+ */
+namespace StreamLog {
+static const unsigned int MAGIC = 0x4C525850; // "PXRL"
+static const unsigned int VERSION = 1;
+
+#pragma pack(1)
+typedef struct {
+    unsigned int Magic;     // MAGIC
+    unsigned int Version;   // VERSION
+    unsigned int Index;     // 分段序号
+    unsigned int Reserved;
+    long long StartTime;    // 创建分段时的 system_clock 纳秒时间戳, 仅供查看
+} SegmentHeader;
+typedef struct {
+    long long Time;         // 接收时间, steady_clock 纳秒时间戳
+    int Source;             // 数据来源, SocketClient 记录时为服务器端口
+    unsigned int Lenth;     // 数据长度
+} RecordHeader;
+#pragma pack()
+
+/**
+ * @brief 获取分段文件名
+ *
+ * @param prefix 文件名前缀
+ * @param index 分段序号
+ * @return std::string 文件名
+ */
+std::string segment_path(const std::string &prefix, unsigned int index);
+} // namespace StreamLog
+
+/**
+ * @brief StreamRecorder 类, 把接收到的原始数据追加写入内存映射的分段记录文件
+ *
+ * 当前分段整体映射到内存, 写入一条记录只是一次 memcpy, 不需要系统调用;
+ * 分段写满后截断到实际长度并映射下一个分段. 多个 SocketClient 可以共用一个记录器,
+ * 记录的 Source 区分数据来自哪个服务器
+ */
+class StreamRecorder {
+public:
+    static const size_t SEGMENT_SIZE = 256 << 20; ///< 默认分段大小
+
+    /**
+     * @brief StreamRecorder 构造函数, 创建第一个分段
+     *
+     * @param prefix 文件名前缀
+     * @param segment_size 分段大小, 不小于一条最大的记录
+     */
+    StreamRecorder(const std::string &prefix,
+                   size_t segment_size = SEGMENT_SIZE);
+    /**
+     * @brief StreamRecorder 析构函数, 把当前分段截断到实际长度
+     *
+     */
+    ~StreamRecorder();
+    /**
+     * @brief 追加一条记录
+     *
+     * @param source 数据来源
+     * @param data 数据
+     * @param lenth 数据长度
+     * @return true 写入成功, 文件创建失败后始终返回 false
+     */
+    bool append(int source, const char *data, unsigned int lenth);
+
+    unsigned long get_records() const { return records.load(); }
+    unsigned long get_bytes() const { return bytes.load(); }
+
+private:
+    std::mutex mutex; ///< 保护以下成员
+    std::string prefix; ///< 文件名前缀
+    size_t segment_size; ///< 分段大小
+    unsigned int index = 0; ///< 当前分段序号
+    int fd = -1; ///< 当前分段文件描述符
+    char *map = nullptr; ///< 当前分段的映射
+    size_t used = 0; ///< 当前分段已写入的字节数
+    bool failed = false; ///< 文件创建或映射失败, 不再写入
+    std::atomic<unsigned long> records{ 0 }; ///< 已写入的记录数
+    std::atomic<unsigned long> bytes{ 0 }; ///< 已写入的数据字节数
+
+    bool open_segment(); ///< 创建并映射新的分段
+    void close_segment(); ///< 解除映射并截断当前分段
+};
+
+/**
+ * @brief StreamReader 类, 按顺序读取 StreamRecorder 写入的记录
+ *
+ * 每次映射一个分段, 返回的数据直接指向映射区域, 不复制
+ */
+class StreamReader {
+public:
+    /**
+     * @brief 一条记录
+     *
+     */
+    typedef struct {
+        long long time; ///< 接收时间, steady_clock 纳秒时间戳
+        int source; ///< 数据来源
+        unsigned int lenth; ///< 数据长度
+        const char *data; ///< 数据, 在读取到下一个分段之前有效
+    } Record;
+
+    /**
+     * @brief StreamReader 构造函数, 打开第一个分段
+     *
+     * @param prefix 文件名前缀
+     */
+    StreamReader(const std::string &prefix);
+    ~StreamReader();
+    /**
+     * @brief 读取下一条记录
+     *
+     * @param record 记录
+     * @return true 读取成功, false 表示所有分段都已读完
+     */
+    bool next(Record &record);
+    /**
+     * @brief 回到第一个分段的开头
+     *
+     */
+    void rewind();
+    /**
+     * @brief 第一个分段是否打开成功
+     *
+     * @return true 打开成功
+     */
+    bool is_open() const { return opened; }
+
+private:
+    std::string prefix; ///< 文件名前缀
+    unsigned int index = 0; ///< 当前分段序号
+    const char *map = nullptr; ///< 当前分段的映射
+    size_t size = 0; ///< 当前分段大小
+    size_t offset = 0; ///< 下一条记录的偏移
+    bool opened = false; ///< 第一个分段是否打开成功
+
+    bool open_segment(unsigned int index); ///< 映射分段, 失败时返回 false
+    void close_segment(); ///< 解除当前分段的映射
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "Message.hpp"
+
+/**
+ * @brief TiledImage 类, 图像分块编解码
+ *
+ * 将图像切分为若干独立编码的 jpg 分块, 打包在同一个 IMAGE_MSG 数据区中,
+ * 解码时各分块并行解码到同一个 cv::Mat 的对应区域,
+ * 数据区格式见 Message::TiledImageHeader 和 Message::ImageTileHeader
+ */
+class TiledImage {
+public:
+    static constexpr unsigned int MAX_TILES = 64; ///< 每个方向最多的分块数
+    static constexpr unsigned int MAX_SIDE = 16384; ///< 解码时接受的最大图像边长
+
+    /**
+     * @brief 分块并行编码图像
+     *
+     * @param img 图像, CV_8UC1 或 CV_8UC3
+     * @param tile_rows 纵向分块数, 最多 MAX_TILES
+     * @param tile_cols 横向分块数, 最多 MAX_TILES
+     * @param quality jpg 质量, < 0 表示使用默认质量
+     * @param data 编码结果
+     * @return true 编码成功
+     */
+    static bool encode(const cv::Mat &img, unsigned int tile_rows,
+                       unsigned int tile_cols, int quality,
+                       std::vector<unsigned char> &data);
+    /**
+     * @brief 判断数据区是否为分块编码
+     *
+     * @param data 数据区
+     * @param lenth 数据区长度
+     * @return true 分块编码
+     */
+    static bool is_tiled(const unsigned char *data, unsigned int lenth);
+    /**
+     * @brief 分块并行解码图像
+     *
+     * @param data 数据区
+     * @param lenth 数据区长度
+     * @param dst 解码结果, 尺寸和类型一致时复用其内存
+     * @return true 解码成功
+     * @note 数据区来自网络, 图像边长超过 MAX_SIDE、分块数超过 MAX_TILES^2
+     *       或分块超出图像范围时直接返回 false
+     */
+    static bool decode(const unsigned char *data, unsigned int lenth,
+                       cv::Mat &dst);
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+
+#include <signal.h>
+#include <unistd.h>
+
+#include "Log.hpp"
+
+/**
+ * @brief 忽略 SIGPIPE 信号, 对端断开后发送返回错误而不是终止进程
+ *
+ */
+inline void ignore_sigpipe()
+{
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &sa, 0);
+}
+
+/**
+ * @brief 写出异步日志和标准输出后直接退出, 供 bench, swarm, replay 等工具程序使用
+ *
+ * @param code 退出码
+ * @note 接收线程均已分离, 不析构仍在使用的 socket;
+ *       _exit 不运行静态析构, 队列中尚未写出的日志需要先 flush
+ */
+inline void exit_tool(int code)
+{
+    Log::flush();
+    fflush(stdout);
+    _exit(code);
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+/**
+ * @brief 在当前作用域记录一个跟踪区间, 以 dataID 标识所属的消息
+ *
+ * 未定义 ENABLE_TRACE 时展开为空语句, 不产生任何代码; 使用 cmake -DENABLE_TRACE=ON 开启
+ */
+#ifdef ENABLE_TRACE
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SPAN(name, id) \
+    Trace::Span TRACE_CONCAT(trace_span_, __LINE__)(name, id)
+#else
+#define TRACE_SPAN(name, id) ((void)0)
+#endif
+
+/**
+ * @brief Trace 类, 跟踪区间的记录和导出
+ *
+ * 每个线程把区间写入自己的固定容量环形缓冲区, 写满后覆盖最早的记录, 写入不加锁.
+ * 线程退出后缓冲区保留并交给之后新建的线程复用, 短生命周期的发送线程不会不断分配内存.
+ * 导出为 Chrome trace JSON, 可以在 chrome://tracing 或 Perfetto 中按时间线查看;
+ * 时间戳为 steady_clock, 同一主机上多个进程导出的文件可以合并到同一时间线
+ */
+class Trace {
+public:
+    static const unsigned int CAPACITY = 16384; ///< 每个线程保留的区间数
+
+    /**
+     * @brief 作用域区间, 构造时开始, 析构时记录
+     *
+     */
+    class Span {
+    public:
+        Span(const char *name, unsigned int id)
+            : name(name), id(id), begin(now())
+        {
+        }
+        ~Span() { record(name, id, begin, now()); }
+
+    private:
+        const char *name; ///< 区间名称, 必须是字符串常量
+        unsigned int id; ///< 消息 dataID
+        long long begin; ///< 开始时间
+    };
+
+    /**
+     * @brief 是否在编译时开启了跟踪
+     *
+     * @return true 定义了 ENABLE_TRACE
+     */
+    static constexpr bool enabled()
+    {
+#ifdef ENABLE_TRACE
+        return true;
+#else
+        return false;
+#endif
+    }
+    /**
+     * @brief 记录一个已结束的区间, 用于开始和结束不在同一作用域的阶段
+     *
+     * @param name 区间名称, 必须是字符串常量
+     * @param id 消息 dataID
+     * @param begin 开始时间, 由 now 获取
+     * @param end 结束时间, 由 now 获取
+     */
+    static void record(const char *name, unsigned int id, long long begin,
+                       long long end);
+    /**
+     * @brief 获取当前时间
+     *
+     * @return long long steady_clock 纳秒时间戳
+     */
+    static long long now();
+    /**
+     * @brief 把所有线程的缓冲区导出为 Chrome trace JSON 文件
+     *
+     * @param path 文件路径
+     * @return int 导出的区间数, < 0 表示写入失败
+     * @note 导出时不停止记录, 导出期间被覆盖的区间会被丢弃
+     */
+    static int dump(const std::string &path);
+
+private:
+    typedef struct {
+        std::atomic<const char *> name; ///< 区间名称
+        std::atomic<unsigned int> id; ///< 消息 dataID
+        std::atomic<int> tid; ///< 线程 ID
+        std::atomic<long long> begin; ///< 开始时间
+        std::atomic<long long> end; ///< 结束时间
+    } Event;
+
+    /**
+     * @brief 一个线程的环形缓冲区, 只由持有它的线程写入
+     *
+     */
+    struct Ring {
+        Event events[CAPACITY]; ///< 区间
+        std::atomic<unsigned long> head{ 0 }; ///< 已写入的区间总数
+        int tid = 0; ///< 当前持有线程的 ID
+    };
+
+    static Ring *local(); ///< 当前线程的缓冲区, 首次使用时从空闲列表取出或新建
+};
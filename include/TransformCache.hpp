@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include "Message.hpp"
+
+/**
+ * @brief TransformCache 类, 客户端订阅坐标变换的本地缓存
+ *
+ * 每个订阅一个条目, 由接收线程在收到推送时写入, 图像处理线程无锁读取,
+ * 每个条目使用序列锁 (seqlock): 写入期间序号为奇数, 读取前后序号不一致时重读
+ */
+class TransformCache {
+public:
+    static const int MAX_ENTRIES = 16; ///< 最大订阅数
+    static const unsigned int ID_BASE = 0xFFFF0000; ///< 订阅 ID 起始值, 避免与图像 dataID 冲突
+
+    /**
+     * @brief TransformCache 构造函数
+     *
+     */
+    TransformCache();
+    /**
+     * @brief 添加一个订阅条目
+     *
+     * @param from 源坐标系
+     * @param to 目标坐标系
+     * @return int 条目下标, < 0 表示条目已满
+     * @note 应在接收推送之前调用, 与 update/get 不能并发
+     */
+    int add(const std::string &from, const std::string &to);
+    /**
+     * @brief 获取条目对应的订阅 ID, 即 TRANSFORM_SUBSCRIBE 消息的 DataID
+     *
+     * @param index 条目下标
+     * @return unsigned int 订阅 ID
+     */
+    static unsigned int get_id(int index);
+    /**
+     * @brief 生成订阅消息的数据区
+     *
+     * @param index 条目下标
+     * @param policy 推送策略
+     * @param rate PUSH_RATE 策略的推送频率, 单位 Hz
+     * @return Message::TransformSubscribeData 订阅数据
+     */
+    Message::TransformSubscribeData subscription(int index,
+                                                 unsigned int policy,
+                                                 double rate) const;
+    /**
+     * @brief 写入推送的坐标变换
+     *
+     * @param id 推送消息的 DataID
+     * @param data 坐标变换
+     * @return true id 属于本缓存的订阅
+     * @note 每个条目只能有一个写线程
+     */
+    bool update(unsigned int id, const Message::TransformData &data);
+    /**
+     * @brief 无锁读取最新的坐标变换
+     *
+     * @param index 条目下标
+     * @param data 读取结果
+     * @param stamp 收到该坐标变换的时间, 可为 nullptr
+     * @return true 已收到过推送
+     */
+    bool get(int index, Message::TransformData &data,
+             std::chrono::steady_clock::time_point *stamp = nullptr) const;
+
+private:
+    typedef struct {
+        char from[64]; ///< 源坐标系
+        char to[64]; ///< 目标坐标系
+        std::atomic<unsigned int> seq; ///< 序列号, 奇数表示正在写入, 0 表示无数据
+        std::atomic<double> values[7]; ///< 平移 xyz, 旋转四元数 xyzw
+        std::atomic<long long> stamp; ///< 接收时间, steady_clock 纳秒
+    } Entry;
+
+    Entry entries[MAX_ENTRIES]; ///< 订阅条目
+    int count = 0; ///< 条目数
+};
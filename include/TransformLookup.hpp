@@ -0,0 +1,259 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <eigen3/Eigen/Eigen>
+#include <eigen3/Eigen/Geometry>
+
+#include <PHOENIX/Transformer/TransformTree.hpp>
+
+#include "Message.hpp"
+
+/**
+ * @brief TransformLookup 类, 带缓存的坐标变换查询
+ *
+ * 坐标系名称映射为整数 ID, 查询过的 (from, to) 组合缓存其复合后的坐标变换,
+ * 缓存条目记录所经过的每条边及其版本号, 只有路径上的边被修改时才重新计算,
+ * 稳定状态下一次查询只需要一次哈希查找
+ *
+ * 坐标转换树保存为不可变的快照, 修改时构造新快照后原子替换,
+ * 正在进行的查询继续使用旧快照, 不会被重新加载阻塞. 修改后的边必须构成森林
+ * (每个坐标系最多一个父坐标系且没有环), 否则整个修改被忽略, 因此任意两个坐标系
+ * 之间的路径唯一, 单个查询的广度优先搜索与批量查询沿父坐标系的计算结果相同
+ *
+ * 每条边另有一个固定容量的带时间戳历史环形缓冲区, 可以查询任意时刻的坐标变换,
+ * 相邻两个采样之间平移线性插值, 旋转球面插值. 边 (from, to) 的坐标变换表示
+ * to 坐标系在 from 坐标系中的位姿, 查询 (from, to) 的结果把 from 坐标系中的点
+ * 变换到 to 坐标系
+ */
+class TransformLookup {
+public:
+    /**
+     * @brief 重新加载回调函数类型
+     *
+     * @param changed 发生变化的边数
+     */
+    typedef std::function<void(int changed)> ReloadFunction;
+
+    static constexpr long long STRUCTURAL_INTERVAL_MS = 1000; ///< publish 添加新边的最小间隔
+
+    /**
+     * @brief TransformLookup 构造函数
+     *
+     * @param cache_enabled 是否启用缓存, 关闭时每次查询都遍历坐标转换树
+     * @param history 每条边保存的历史采样数
+     */
+    TransformLookup(bool cache_enabled = true, int history = 512);
+    /**
+     * @brief TransformLookup 析构函数, 停止文件监视线程
+     *
+     */
+    ~TransformLookup();
+    /**
+     * @brief 从 json 文件读取坐标变换, 格式见 asset/tf.json
+     *
+     * @param path 文件路径
+     * @return true 读取成功
+     * @note 文件中不再出现的边会被删除; 文件中的边不构成森林时保留原来的坐标转换树
+     */
+    bool load(const std::string &path);
+    /**
+     * @brief 使用 inotify 监视 json 文件, 文件被修改后在后台线程重新加载
+     *
+     * @param path 文件路径
+     * @param on_reload 重新加载且有边发生变化时调用
+     * @return true 开始监视
+     */
+    bool watch(const std::string &path, ReloadFunction on_reload);
+    /**
+     * @brief 停止监视 json 文件, 返回后不会再调用重新加载回调
+     *
+     * @note 析构时自动调用; 回调引用了先于本对象析构的对象时需要提前调用
+     */
+    void unwatch();
+    /**
+     * @brief 添加或修改一条边
+     *
+     * @param from 父坐标系
+     * @param to 子坐标系
+     * @param tf 坐标变换
+     */
+    void set_transform(const std::string &from, const std::string &to,
+                       const PHOENIX::Transform &tf);
+    /**
+     * @brief 发布一条边在某一时刻的采样
+     *
+     * @param from 父坐标系
+     * @param to 子坐标系
+     * @param data 坐标变换
+     * @param stamp system_clock 纳秒时间戳
+     * @return true 添加成功, 早于该边最新采样的数据会被丢弃,
+     *         坐标系不存在时失败, 新的边使坐标系有两个父坐标系或形成环时失败
+     * @note 只能在已有的坐标系之间发布; 新的边会重建快照,
+     *       每 STRUCTURAL_INTERVAL_MS 毫秒最多添加一条, 超出频率时失败
+     * @note 边有采样后, 不带时间戳的查询使用最新采样而不是静态值;
+     *       同一条边的多个发布者之间互斥, 与查询之间不互相阻塞
+     */
+    bool publish(std::string_view from, std::string_view to,
+                 const Message::TransformData &data, long long stamp);
+    /**
+     * @brief 查找坐标系 ID
+     *
+     * @param name 坐标系名称
+     * @return int 坐标系 ID, < 0 表示不存在
+     */
+    int find(std::string_view name);
+    /**
+     * @brief 按坐标系 ID 查询坐标变换
+     *
+     * @param from 源坐标系 ID
+     * @param to 目标坐标系 ID
+     * @param data 查询结果
+     * @return true 查询成功
+     */
+    bool lookup(int from, int to, Message::TransformData &data);
+    /**
+     * @brief 按坐标系名称查询坐标变换
+     *
+     * @param from 源坐标系名称
+     * @param to 目标坐标系名称
+     * @param data 查询结果
+     * @return true 查询成功
+     */
+    bool lookup(std::string_view from, std::string_view to,
+                Message::TransformData &data);
+    /**
+     * @brief 查询指定时刻的坐标变换
+     *
+     * @param from 源坐标系 ID
+     * @param to 目标坐标系 ID
+     * @param stamp system_clock 纳秒时间戳
+     * @param data 查询结果
+     * @return true 查询成功, 早于某条边保存的最早采样时失败
+     * @note 晚于最新采样时使用最新采样, 不外推
+     */
+    bool lookup(int from, int to, long long stamp,
+                Message::TransformData &data);
+    /**
+     * @brief 按坐标系名称查询指定时刻的坐标变换
+     *
+     * @param from 源坐标系名称
+     * @param to 目标坐标系名称
+     * @param stamp system_clock 纳秒时间戳
+     * @param data 查询结果
+     * @return true 查询成功
+     */
+    bool lookup(std::string_view from, std::string_view to, long long stamp,
+                Message::TransformData &data);
+    /**
+     * @brief 批量查询同一时刻的多个坐标变换
+     *
+     * 每个坐标系到根坐标系的位姿在一次批量查询中只计算一次, 多个坐标系对共享的路径不重复计算
+     *
+     * @param pairs (源坐标系 ID, 目标坐标系 ID) 列表
+     * @param stamp system_clock 纳秒时间戳, 0 表示最新
+     * @param results 查询结果, 长度与 pairs 相同
+     * @return int 查询成功的数量
+     */
+    int lookup(const std::vector<std::pair<int, int>> &pairs, long long stamp,
+               Message::TransformBatchResult *results);
+    /**
+     * @brief 获取缓存命中和未命中次数
+     *
+     * @return std::string 统计信息
+     */
+    std::string get_stats();
+
+private:
+    typedef struct {
+        Eigen::Vector3d translation; ///< 平移
+        Eigen::Quaterniond rotation; ///< 旋转
+    } Pose;
+
+    typedef struct {
+        std::atomic<long long> stamp; ///< system_clock 纳秒时间戳
+        std::atomic<double> values[7]; ///< 平移 xyz, 旋转四元数 xyzw
+    } Slot;
+
+    /**
+     * @brief 一条边的历史采样, 按时间戳升序保存在环形缓冲区中
+     *
+     * 在快照之间共享, 添加采样不需要构造新快照. 使用序列锁 (seqlock):
+     * 写入期间序号为奇数, 查询前后序号不一致时重读, 查询不阻塞写入, 写入也不阻塞查询
+     */
+    struct History {
+        std::mutex writer; ///< 同一条边的多个发布者之间互斥, 查询不使用
+        std::unique_ptr<Slot[]> slots; ///< 环形缓冲区
+        size_t capacity = 0; ///< 缓冲区容量
+        std::atomic<size_t> head{ 0 }; ///< 最早采样的下标
+        std::atomic<size_t> count{ 0 }; ///< 采样数
+        std::atomic<unsigned long> seq{ 0 }; ///< 序列号, 每次写入加二, 参与缓存校验
+    };
+
+    typedef struct {
+        Message::TransformData data; ///< 复合后的坐标变换
+        std::vector<int> edges; ///< 路径经过的边
+        std::vector<unsigned long> versions; ///< 计算时各边的版本号
+    } CacheEntry;
+
+    typedef struct {
+        int a; ///< 父坐标系 ID
+        int b; ///< 子坐标系 ID
+        unsigned long version; ///< 版本号, 每次修改加一
+        bool removed; ///< 是否已删除, 删除的边保留下标以保持边编号不变
+        Pose pose; ///< 静态坐标变换
+        std::shared_ptr<History> history; ///< 历史采样
+    } Edge;
+
+    /**
+     * @brief 坐标转换树快照, 发布后只读
+     *
+     * 坐标系 ID 和边的下标在快照之间保持不变, 缓存条目可以跨快照校验
+     */
+    struct Snapshot {
+        std::deque<std::string> names; ///< 坐标系名称, deque 保证元素地址不变
+        std::unordered_map<std::string_view, int> ids; ///< 名称到 ID 的映射
+        std::vector<Edge> edges; ///< 所有边
+        std::vector<std::vector<std::pair<int, int>>> adjacency; ///< 每个坐标系的 (相邻坐标系, 边)
+        std::vector<int> parent; ///< 每个坐标系作为子坐标系的边, -1 表示根坐标系
+    };
+
+    typedef std::tuple<std::string, std::string, Pose> Definition; ///< (from, to, pose)
+
+    bool cache_enabled; ///< 是否启用缓存
+    size_t history_size; ///< 每条边保存的历史采样数
+    std::shared_ptr<const Snapshot> snapshot; ///< 当前快照, 使用 std::atomic_load/atomic_store 访问
+    std::mutex writer; ///< 串行化快照的修改
+    std::unordered_map<unsigned long long, CacheEntry> cache; ///< (from, to) 缓存
+    std::shared_mutex cache_mutex; ///< 查询缓存持有读锁, 写入缓存持有写锁
+    std::atomic<unsigned long> hits; ///< 缓存命中次数
+    std::atomic<unsigned long> misses; ///< 缓存未命中次数
+    std::atomic<unsigned long> reloads; ///< 重新加载次数
+    std::atomic<long long> last_structural; ///< 上次 publish 添加新边的 steady_clock 纳秒时间
+
+    std::thread watcher; ///< 文件监视线程
+    std::atomic<bool> stopped; ///< 是否停止监视
+    int inotify_fd = -1; ///< inotify 文件描述符
+
+    static bool parse(const std::string &path, std::vector<Definition> &defs); ///< 解析 json 文件
+    int apply(const std::vector<Definition> &defs, bool replace); ///< 构造并发布新快照, 返回变化的边数, 结果不是森林时不发布并返回 -1
+    std::shared_ptr<History> make_history(); ///< 分配一条边的历史采样缓冲区
+    void monitor(std::string path, ReloadFunction on_reload); ///< 文件监视线程函数
+    static bool find_path(const Snapshot &snap, int from, int to, std::vector<int> &path); ///< 查找两坐标系之间经过的边, 按 from 到 to 的顺序
+    static unsigned long get_version(const Edge &edge); ///< 边的版本号, 包括静态值修改和添加采样
+    static bool valid(const Snapshot &snap, const CacheEntry &entry); ///< 缓存条目路径上的边是否都未修改
+    static bool sample(const Edge &edge, long long stamp, Pose &pose); ///< 边在某一时刻的位姿, stamp 为 0 表示最新
+    static bool compose(const Snapshot &snap, int from, const std::vector<int> &path, long long stamp, Message::TransformData &data); ///< 沿路径复合坐标变换
+    static Message::TransformData to_data(const Pose &pose); ///< 转换为消息格式
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Message.hpp"
+
+/**
+ * @brief TransformPublisher 类, 服务器端坐标变换订阅推送
+ *
+ * 客户端通过 TRANSFORM_SUBSCRIBE 订阅 (from, to) 坐标变换,
+ * 推送线程按订阅策略 (固定频率或变化时) 主动发送 TRANSFORM 消息,
+ * 客户端不再需要每帧发送 TRANSFORM_REQUEST 并等待回复
+ */
+class TransformPublisher {
+public:
+    /**
+     * @brief 坐标变换查询函数, 查询失败返回 false
+     *
+     */
+    typedef std::function<bool(const std::string &, const std::string &,
+                               Message::TransformData &)>
+        LookupFunction;
+    /**
+     * @brief 推送函数, 参数为客户端 ID, 订阅 ID 和坐标变换, 返回 < 0 表示发送失败
+     *
+     */
+    typedef std::function<int(int, unsigned int,
+                              const Message::TransformData &)>
+        SendFunction;
+
+    /**
+     * @brief TransformPublisher 构造函数, 启动推送线程
+     *
+     * @param lookup 坐标变换查询函数
+     * @param send 推送函数
+     */
+    TransformPublisher(LookupFunction lookup, SendFunction send);
+    /**
+     * @brief TransformPublisher 析构函数, 停止推送线程
+     *
+     */
+    ~TransformPublisher();
+    /**
+     * @brief 添加、修改或取消订阅
+     *
+     * @param client 客户端 ID
+     * @param id 订阅 ID, 即 TRANSFORM_SUBSCRIBE 消息的 DataID
+     * @param data 订阅参数
+     */
+    void subscribe(int client, unsigned int id,
+                   const Message::TransformSubscribeData &data);
+    /**
+     * @brief 删除客户端的全部订阅, 客户端断开时调用
+     *
+     * @param client 客户端 ID
+     */
+    void remove(int client);
+    /**
+     * @brief 通知坐标变换可能已变化, 立即检查 PUSH_ON_CHANGE 订阅
+     *
+     */
+    void notify();
+    /**
+     * @brief 获取所有订阅
+     *
+     * @return std::string 每行一个订阅
+     */
+    std::string get_subscriptions();
+
+private:
+    typedef struct {
+        int client; ///< 客户端 ID
+        unsigned int id; ///< 订阅 ID
+        std::string from; ///< 源坐标系
+        std::string to; ///< 目标坐标系
+        unsigned int policy; ///< 推送策略
+        std::chrono::steady_clock::duration period; ///< PUSH_RATE 推送周期
+        std::chrono::steady_clock::time_point next; ///< 下一次推送时间
+        Message::TransformData last; ///< 上一次推送的坐标变换
+        bool sent; ///< 是否已推送过
+    } Subscription;
+
+    LookupFunction lookup; ///< 坐标变换查询函数
+    SendFunction send; ///< 推送函数
+    std::vector<Subscription> subscriptions; ///< 所有订阅
+    bool changed = false; ///< 是否需要检查 PUSH_ON_CHANGE 订阅
+    bool stopped = false; ///< 是否已停止
+    std::mutex mutex; ///< 保护以上成员
+    std::condition_variable cv; ///< 唤醒推送线程
+    std::thread publisher; ///< 推送线程
+
+    void publish(); ///< 推送线程处理函数
+};
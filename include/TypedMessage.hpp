@@ -0,0 +1,305 @@
+#pragma once
+
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+#include "Message.hpp"
+
+/**
+ * @brief 消息类型到数据区结构的映射, 每种消息类型一个特化
+ *
+ * 数据区分为三种布局:
+ * - FixedMessage: 一个固定大小的结构体, 如 CAMERA_INFO 的 CameraInfoData
+ * - BatchMessage: 带 Count 字段的头部加 Count 个元素, 如 TRANSFORM_BATCH_REQUEST
+ * - BytesMessage: 任意长度的字节序列, 如 STRING_MSG 和 IMAGE_MSG 的 jpg 数据
+ *
+ * 未特化的消息类型不能用于 Application::send 和 Application::on, 编译时报错
+ */
+template <unsigned short Type> struct MessageTraits;
+
+/**
+ * @brief 固定大小的数据区
+ *
+ * @tparam T 消息类型
+ * @tparam P 数据区结构体
+ */
+template <unsigned short T, typename P> struct FixedMessage {
+    static_assert(std::is_trivially_copyable<P>::value,
+                  "payload must be trivially copyable");
+    static_assert(sizeof(P) <= sizeof(Message::MessageBuffer::Data),
+                  "payload must fit in the data area of one fragment");
+    static constexpr unsigned short type = T;
+    typedef P Header; ///< 数据区结构体
+    typedef void Element; ///< 没有元素
+};
+
+/**
+ * @brief 头部加变长元素数组的数据区, 头部的 Count 字段为元素数
+ *
+ * @tparam T 消息类型
+ * @tparam H 头部结构体
+ * @tparam E 元素结构体
+ */
+template <unsigned short T, typename H, typename E> struct BatchMessage {
+    static_assert(std::is_trivially_copyable<H>::value &&
+                      std::is_trivially_copyable<E>::value,
+                  "payload must be trivially copyable");
+    static_assert(std::is_integral<decltype(H::Count)>::value,
+                  "batch header must have an integral Count field");
+    static constexpr unsigned short type = T;
+    typedef H Header; ///< 头部结构体
+    typedef E Element; ///< 元素结构体
+};
+
+/**
+ * @brief 任意长度的字节序列
+ *
+ * @tparam T 消息类型
+ * @tparam E 字节类型
+ */
+template <unsigned short T, typename E> struct BytesMessage {
+    static_assert(sizeof(E) == 1, "byte payload element must be one byte");
+    static constexpr unsigned short type = T;
+    typedef void Header; ///< 没有头部
+    typedef E Element; ///< 字节类型
+};
+
+// clang-format off
+template <> struct MessageTraits<Message::STRING_MSG> : BytesMessage<Message::STRING_MSG, char> {};
+template <> struct MessageTraits<Message::PING> : FixedMessage<Message::PING, Message::ClockSyncData> {};
+template <> struct MessageTraits<Message::PONG> : FixedMessage<Message::PONG, Message::ClockSyncData> {};
+template <> struct MessageTraits<Message::IMAGE_MSG> : BytesMessage<Message::IMAGE_MSG, unsigned char> {};
+template <> struct MessageTraits<Message::IMAGE_SUBSCRIBE> : FixedMessage<Message::IMAGE_SUBSCRIBE, Message::ImageSubscribeData> {};
+template <> struct MessageTraits<Message::CAMERA_INFO> : FixedMessage<Message::CAMERA_INFO, Message::CameraInfoData> {};
+template <> struct MessageTraits<Message::TRANSFORM> : FixedMessage<Message::TRANSFORM, Message::TransformData> {};
+template <> struct MessageTraits<Message::TRANSFORM_REQUEST> : FixedMessage<Message::TRANSFORM_REQUEST, Message::TransformRequestData> {};
+template <> struct MessageTraits<Message::TRANSFORM_SUBSCRIBE> : FixedMessage<Message::TRANSFORM_SUBSCRIBE, Message::TransformSubscribeData> {};
+template <> struct MessageTraits<Message::TRANSFORM_REQUEST_STAMPED> : FixedMessage<Message::TRANSFORM_REQUEST_STAMPED, Message::TransformStampedRequestData> {};
+template <> struct MessageTraits<Message::TRANSFORM_PUBLISH> : FixedMessage<Message::TRANSFORM_PUBLISH, Message::TransformPublishData> {};
+template <> struct MessageTraits<Message::TRANSFORM_BATCH_REQUEST> : BatchMessage<Message::TRANSFORM_BATCH_REQUEST, Message::TransformBatchHeader, Message::TransformPair> {};
+template <> struct MessageTraits<Message::TRANSFORM_BATCH> : BatchMessage<Message::TRANSFORM_BATCH, Message::TransformBatchHeader, Message::TransformBatchResult> {};
+template <> struct MessageTraits<Message::OBSERVATION> : BatchMessage<Message::OBSERVATION, Message::PoseBatchHeader, Message::PoseSample> {};
+template <> struct MessageTraits<Message::PREDICTION> : BatchMessage<Message::PREDICTION, Message::PoseBatchHeader, Message::PoseSample> {};
+// clang-format on
+
+/**
+ * @brief 所有带 MessageTraits 的消息类型, 以及按类型低 8 位索引的分发表
+ *
+ */
+namespace MessageSchema {
+constexpr unsigned short TYPES[] = {
+    Message::STRING_MSG,
+    Message::PING,
+    Message::PONG,
+    Message::IMAGE_MSG,
+    Message::IMAGE_SUBSCRIBE,
+    Message::CAMERA_INFO,
+    Message::TRANSFORM,
+    Message::TRANSFORM_REQUEST,
+    Message::TRANSFORM_SUBSCRIBE,
+    Message::TRANSFORM_REQUEST_STAMPED,
+    Message::TRANSFORM_PUBLISH,
+    Message::TRANSFORM_BATCH_REQUEST,
+    Message::TRANSFORM_BATCH,
+    Message::OBSERVATION,
+    Message::PREDICTION
+};
+constexpr int COUNT = sizeof(TYPES) / sizeof(TYPES[0]); ///< 消息类型数
+
+/**
+ * @brief 消息类型的低 8 位到 TYPES 下标的映射, -1 表示没有对应的类型
+ *
+ */
+struct Slots {
+    signed char index[256];
+};
+
+constexpr Slots make_slots()
+{
+    Slots slots{};
+    for (int i = 0; i < 256; i++) {
+        slots.index[i] = -1;
+    }
+    for (int i = 0; i < COUNT; i++) {
+        slots.index[TYPES[i] & 0xFF] = (signed char)i;
+    }
+    return slots;
+}
+
+constexpr Slots SLOTS = make_slots(); ///< 分发表
+
+/**
+ * @brief 检查各消息类型的低 8 位互不相同, 分发时只需一次查表
+ *
+ */
+constexpr bool unique_slots()
+{
+    for (int i = 0; i < COUNT; i++) {
+        if (SLOTS.index[TYPES[i] & 0xFF] != i)
+            return false;
+    }
+    return true;
+}
+static_assert(unique_slots(), "message types must differ in the low 8 bits");
+
+/**
+ * @brief 获取消息类型在 TYPES 中的下标
+ *
+ * @param type 消息类型
+ * @return int 下标, -1 表示没有 MessageTraits
+ */
+constexpr int index_of(unsigned short type)
+{
+    int i = SLOTS.index[type & 0xFF];
+    return i >= 0 && TYPES[i] == type ? i : -1;
+}
+
+template <std::size_t... I>
+constexpr bool all_described(std::index_sequence<I...>)
+{
+    return ((MessageTraits<TYPES[I]>::type == TYPES[I]) && ...);
+}
+static_assert(all_described(std::make_index_sequence<COUNT>()),
+              "every message type in TYPES needs a MessageTraits");
+} // namespace MessageSchema
+
+/**
+ * @brief 重组后的数据区的类型化视图, 直接指向接收缓冲区, 不复制
+ *
+ * @tparam Type 消息类型
+ * @note 只在处理函数中有效, 处理函数返回后缓冲区被释放
+ */
+template <unsigned short Type> class MessageView {
+public:
+    typedef typename MessageTraits<Type>::Header Header;
+    typedef typename MessageTraits<Type>::Element Element;
+
+    /**
+     * @brief 检查数据长度并建立视图
+     *
+     * @param data 数据区
+     * @param lenth 数据长度
+     * @param dataID 消息 ID
+     * @param view 视图
+     * @return true 长度与类型相符
+     */
+    static bool parse(const unsigned char *data, unsigned int lenth,
+                      unsigned int dataID, MessageView &view)
+    {
+        view.dataID = dataID;
+        view.bytes = lenth;
+        if constexpr (std::is_void<Header>::value) {
+            view.head = nullptr;
+            view.items = (const Element *)data;
+            view.count = lenth;
+            return true;
+        } else if constexpr (std::is_void<Element>::value) {
+            view.head = (const Header *)data;
+            view.items = nullptr;
+            view.count = 0;
+            return lenth >= sizeof(Header);
+        } else {
+            if (lenth < sizeof(Header))
+                return false;
+            view.head = (const Header *)data;
+            view.items = (const Element *)(data + sizeof(Header));
+            view.count = view.head->Count;
+            return view.count <= (lenth - sizeof(Header)) / sizeof(Element);
+        }
+    }
+    /**
+     * @brief 检查数据长度并建立视图, 用于请求的回复
+     *
+     * @param data 数据区
+     * @param lenth 数据长度
+     * @param view 视图
+     * @return true 长度与类型相符
+     */
+    static bool parse(const unsigned char *data, unsigned int lenth,
+                      MessageView &view)
+    {
+        return parse(data, lenth, 0, view);
+    }
+
+    // 模板参数推迟到调用时实例化, 没有头部或元素的类型不会形成 void 的引用
+    template <typename H = Header> const H &operator*() const { return *head; }
+    template <typename H = Header> const H *operator->() const { return head; }
+    const Element *begin() const { return items; }
+    const Element *end() const { return items + count; }
+    template <typename E = Element>
+    const E &operator[](unsigned int i) const
+    {
+        return items[i];
+    }
+    unsigned int size() const { return count; }
+    unsigned int get_dataID() const { return dataID; }
+    unsigned int get_bytes() const { return bytes; }
+
+private:
+    const Header *head = nullptr; ///< 头部或固定大小的数据区
+    const Element *items = nullptr; ///< 元素数组
+    unsigned int count = 0; ///< 元素数
+    unsigned int dataID = 0; ///< 消息 ID
+    unsigned int bytes = 0; ///< 数据长度
+};
+
+/**
+ * @brief MessageDispatcher 类, 按消息类型调用注册的处理函数
+ *
+ * 处理函数保存在按 MessageSchema::TYPES 下标排列的数组中, 分发时按消息类型的
+ * 低 8 位查编译期生成的表得到下标, 不需要逐个比较消息类型
+ */
+class MessageDispatcher {
+public:
+    /**
+     * @brief 类型擦除后的处理函数
+     *
+     * @param data 数据区
+     * @param lenth 数据长度
+     * @param dataID 消息 ID
+     * @param from 发送消息的客户端 ID, SocketClient 为 -1
+     * @return bool 数据长度与类型相符
+     */
+    typedef std::function<bool(const unsigned char *data, unsigned int lenth,
+                               unsigned int dataID, int from)>
+        Handler;
+
+    /**
+     * @brief 注册某种消息的处理函数, 同一类型只保留最后注册的一个
+     *
+     * @tparam Type 消息类型
+     * @param handler 处理函数, 参数为发送者和类型化视图
+     */
+    template <unsigned short Type>
+    void on(std::function<void(int from, const MessageView<Type> &view)>
+                handler)
+    {
+        constexpr int index = MessageSchema::index_of(Type);
+        static_assert(index >= 0, "message type is not in MessageSchema::TYPES");
+        handlers[index] = [handler](const unsigned char *data,
+                                    unsigned int lenth, unsigned int dataID,
+                                    int from) {
+            MessageView<Type> view;
+            if (!MessageView<Type>::parse(data, lenth, dataID, view))
+                return false;
+            handler(from, view);
+            return true;
+        };
+    }
+    /**
+     * @brief 调用消息类型对应的处理函数
+     *
+     * @param type 消息类型
+     * @param data 重组后的数据区
+     * @param lenth 数据长度
+     * @param dataID 消息 ID
+     * @param from 发送消息的客户端 ID, SocketClient 为 -1
+     * @return true 有对应的处理函数, 长度不符的消息也已丢弃
+     */
+    bool dispatch(unsigned short type, const unsigned char *data,
+                  unsigned int lenth, unsigned int dataID, int from);
+
+private:
+    Handler handlers[MessageSchema::COUNT]; ///< 各消息类型的处理函数
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "Message.hpp"
+
+/**
+ * @brief Undistorter 类, 缓存去畸变映射表
+ *
+ * 相机内参按值保存, 接收到的图像可能是按 ROI 裁剪并缩放后的图像, 按 ROI 和
+ * 图像尺寸相对标定分辨率的比例换算内参后计算 initUndistortRectifyMap 的映射表
+ * 和点去畸变查找表. 最近使用的几种尺寸的映射表都保留, 码率控制来回切换分辨率时
+ * 不需要重新计算, 每帧去畸变只需要一次 remap, 点去畸变只需要查表插值
+ */
+class Undistorter {
+public:
+    /**
+     * @brief Undistorter 构造函数
+     *
+     * @param step 点去畸变查找表的网格间距, 单位像素
+     */
+    Undistorter(int step = 4);
+    /**
+     * @brief 设置相机内参
+     *
+     * @param info 接收到的相机内参和畸变系数
+     * @return true 内参发生变化, 映射表将在下次使用时重新计算
+     */
+    bool set_camera_info(const Message::CameraInfoData &info);
+    /**
+     * @brief 获取相机内参
+     *
+     * @param info 相机内参和畸变系数
+     * @return true 已收到相机内参
+     */
+    bool get_camera_info(Message::CameraInfoData &info);
+    /**
+     * @brief 设置图像订阅的 ROI
+     *
+     * @param roi 标定分辨率下的 ROI, 宽或高为 0 表示完整图像
+     * @note 与服务器端相同, ROI 先按标定分辨率的图像范围裁剪
+     */
+    void set_roi(const cv::Rect &roi);
+    /**
+     * @brief 图像去畸变
+     *
+     * @param src 原图
+     * @param dst 去畸变后的图像, 尺寸不变时复用内存
+     * @return true 成功, false 表示尚未收到相机内参或内参中没有标定分辨率
+     */
+    bool undistort(const cv::Mat &src, cv::Mat &dst);
+    /**
+     * @brief 批量点去畸变
+     *
+     * @param points 原图中的像素坐标
+     * @param undistorted 去畸变后的像素坐标, 与 undistort 输出图像一致
+     * @param size 原图尺寸
+     * @return true 成功, false 表示尚未收到相机内参或内参中没有标定分辨率
+     * @note 图像范围内的点使用查找表双线性插值, 范围外的点调用 cv::undistortPoints
+     */
+    bool undistort_points(const std::vector<cv::Point2f> &points,
+                          std::vector<cv::Point2f> &undistorted,
+                          cv::Size size);
+
+private:
+    typedef struct {
+        Message::CameraInfoData info; ///< 计算时使用的相机内参
+        cv::Rect roi; ///< 计算时使用的 ROI
+        cv::Size size; ///< 图像尺寸
+        double camera[9]; ///< 按 ROI 和图像尺寸换算后的内参矩阵
+        cv::Mat map1, map2; ///< remap 映射表, CV_16SC2 格式
+        std::vector<cv::Point2f> lut; ///< 网格点去畸变后的坐标
+        int cols, rows; ///< 网格列数和行数
+    } Maps;
+
+    int step; ///< 查找表网格间距
+    std::mutex mutex; ///< 保护 info, roi 和 maps
+    bool has_info = false; ///< 是否已收到相机内参
+    bool warned = false; ///< 是否已提示内参中没有标定分辨率
+    Message::CameraInfoData info; ///< 最新的相机内参
+    cv::Rect roi; ///< 图像订阅的 ROI, 空表示完整图像
+    std::vector<std::shared_ptr<const Maps>> maps; ///< 最近使用的映射表, 最近使用的在前, 使用中的旧表在释放前保持有效
+
+    static constexpr size_t MAX_MAPS = 4; ///< 保留的映射表数, 覆盖码率控制的几档分辨率
+
+    std::shared_ptr<const Maps> get(cv::Size size); ///< 获取对应尺寸的映射表, 必要时重新计算
+};
@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <cstdio>
+
+#include "BitrateController.hpp"
+
+BitrateController::BitrateController()
+{
+}
+
+BitrateController::BitrateController(const Config &config)
+{
+    this->config = config;
+}
+
+void BitrateController::set_config(const Config &config)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    this->config = config;
+    for (auto &state : states) {
+        state.second.quality =
+            std::clamp(state.second.quality, config.min_quality,
+                       config.max_quality);
+        if (!config.adapt_scale)
+            state.second.scale = 1.0;
+        else
+            state.second.scale =
+                std::clamp(state.second.scale, config.min_scale, 1.0);
+    }
+}
+
+BitrateController::Config BitrateController::get_config()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return config;
+}
+
+BitrateController::State BitrateController::initial_state() const
+{
+    return State{ config.max_quality, 1.0, 0.0, 0, 0 };
+}
+
+void BitrateController::update(int client, int queue, double latency)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (states.find(client) == states.end())
+        states[client] = initial_state();
+    State &state = states[client];
+
+    // 发送耗时做指数滑动平均, 避免单帧抖动导致质量频繁变化
+    state.latency = state.latency == 0.0 ? latency :
+                                           state.latency * 0.7 + latency * 0.3;
+    state.queue = queue;
+
+    bool congested = state.latency > config.target_latency ||
+                     (queue >= 0 && queue > config.max_queue);
+    bool idle = state.latency < config.target_latency / 2 &&
+                (queue < 0 || queue < config.max_queue / 4);
+
+    if (congested) { // 拥塞: 乘性降低质量, 质量到底后降低分辨率
+        state.idle_frames = 0;
+        if (state.quality > config.min_quality) {
+            state.quality = std::max(
+                config.min_quality,
+                (int)(state.quality * config.decrease_ratio));
+        } else if (config.adapt_scale) {
+            state.scale = std::max(config.min_scale, state.scale * 0.75);
+        }
+    } else if (idle) { // 空闲: 连续若干帧后先恢复分辨率, 再加性提升质量
+        if (++state.idle_frames < config.increase_interval)
+            return;
+        state.idle_frames = 0;
+        if (state.scale < 1.0) {
+            state.scale = std::min(1.0, state.scale + 0.1);
+        } else {
+            state.quality = std::min(config.max_quality,
+                                     state.quality + config.quality_step);
+        }
+    } else {
+        state.idle_frames = 0;
+    }
+}
+
+BitrateController::State BitrateController::get(int client)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = states.find(client);
+    if (it == states.end())
+        return initial_state();
+    return it->second;
+}
+
+void BitrateController::remove(int client)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    states.erase(client);
+}
+
+std::string BitrateController::get_qualities()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string qualities = "";
+    char line[128];
+    for (auto const &state : states) {
+        snprintf(line, sizeof(line),
+                 "Client %d: quality %d, scale %.2f, latency %.2f ms, queue "
+                 "%d bytes\n",
+                 state.first, state.second.quality, state.second.scale,
+                 state.second.latency, state.second.queue);
+        qualities += line;
+    }
+    return qualities;
+}
@@ -0,0 +1,70 @@
+#include <chrono>
+#include <sstream>
+
+#include "ClockSync.hpp"
+
+long long ClockSync::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void ClockSync::add(int peer, long long t1, long long t2, long long t3,
+                    long long t4)
+{
+    Estimate sample;
+    sample.rtt = (t4 - t1) - (t3 - t2);
+    sample.offset = ((t2 - t1) + (t3 - t4)) / 2;
+    if (sample.rtt < 0)
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Peer &p = peers[peer];
+    p.samples[p.count % WINDOW] = sample;
+    p.count++;
+    // 被覆盖的可能正是最短的采样, 每次都在整个窗口中重新选取
+    int n = p.count < WINDOW ? (int)p.count : WINDOW;
+    p.best = p.samples[0];
+    for (int i = 1; i < n; i++) {
+        if (p.samples[i].rtt < p.best.rtt)
+            p.best = p.samples[i];
+    }
+}
+
+bool ClockSync::get(int peer, Estimate &estimate)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = peers.find(peer);
+    if (it == peers.end())
+        return false;
+    estimate = it->second.best;
+    return true;
+}
+
+long long ClockSync::to_local(int peer, long long remote)
+{
+    Estimate estimate;
+    if (!get(peer, estimate))
+        return remote;
+    return remote - estimate.offset;
+}
+
+void ClockSync::remove(int peer)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    peers.erase(peer);
+}
+
+std::string ClockSync::get_estimates()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::stringstream ss;
+    for (auto &item : peers) {
+        ss << "peer " << item.first
+           << ": offset " << item.second.best.offset / 1e3 << " us, rtt "
+           << item.second.best.rtt / 1e3 << " us, " << item.second.count
+           << " samples" << std::endl;
+    }
+    return ss.str();
+}
@@ -0,0 +1,278 @@
+#include <algorithm>
+
+#include "DecodePool.hpp"
+#include "TiledImage.hpp"
+#include "Trace.hpp"
+
+DecodePool::DecodePool(int threads,
+                       std::function<void(unsigned int, cv::Mat &)> on_frame,
+                       SkipPolicy policy, unsigned int max_lag,
+                       std::shared_ptr<FrameRing> ring)
+{
+    this->on_frame = on_frame;
+    this->ring = ring;
+    this->policy = policy;
+    this->max_lag = max_lag;
+    threads = std::max(1, threads);
+    // 待解码队列最多保留每个线程两帧, 再加上允许落后的帧数
+    this->max_queue = threads * 2 + max_lag;
+    this->max_pending = get_in_flight(threads, max_lag);
+
+    for (int i = 0; i < threads; i++) {
+        workers.push_back(std::thread(&DecodePool::work, this));
+    }
+    deliverer = std::thread(&DecodePool::deliver, this);
+}
+
+DecodePool::~DecodePool()
+{
+    if (metrics != nullptr)
+        metrics->remove_callback(callback);
+    {
+        std::scoped_lock lock(jobs_mutex, ready_mutex);
+        stopped = true;
+    }
+    jobs_cv.notify_all();
+    ready_cv.notify_all();
+    pending_cv.notify_all();
+    space_cv.notify_all();
+    for (auto &t : workers) {
+        t.join();
+    }
+    deliverer.join();
+    for (auto &job : jobs) {
+        delete[] job.data;
+    }
+    jobs.clear();
+}
+
+size_t DecodePool::get_in_flight(int threads, unsigned int max_lag)
+{
+    // 解码中的帧加上乱序等待交付的帧, 再加上正在交付的一帧
+    return std::max(1, threads) + max_lag + 2;
+}
+
+void DecodePool::push(unsigned int dataID, unsigned char *data,
+                      unsigned int lenth)
+{
+    {
+        std::unique_lock<std::mutex> lock(jobs_mutex);
+        // 不允许跳帧时阻塞接收线程, 由 TCP 流量控制使服务器放慢发送, 队列不会无限增长
+        if (policy == WAIT_ALL)
+            space_cv.wait(lock, [this]() {
+                return stopped || jobs.size() < max_queue;
+            });
+        if (stopped) {
+            delete[] data;
+            return;
+        }
+        jobs.push_back(Job{ push_seq++, dataID, data, lenth,
+                            std::chrono::steady_clock::now() });
+        if (policy != WAIT_ALL && jobs.size() > max_queue) {
+            // 解码跟不上接收速度, 丢弃最早的待解码帧, 而不是阻塞接收线程
+            Job old = jobs.front();
+            jobs.pop_front();
+            delete[] old.data;
+            finish(old, cv::Mat(), -1, false);
+        }
+    }
+    jobs_cv.notify_one();
+}
+
+unsigned long DecodePool::get_delivered()
+{
+    std::lock_guard<std::mutex> lock(ready_mutex);
+    return delivered;
+}
+
+unsigned long DecodePool::get_skipped()
+{
+    std::lock_guard<std::mutex> lock(ready_mutex);
+    return skipped;
+}
+
+void DecodePool::set_metrics(std::shared_ptr<Metrics> metrics)
+{
+    this->metrics = metrics;
+    decode_time = metrics->add_series("decode_seconds",
+                                      "Time spent decoding received images.",
+                                      Metrics::SUMMARY, "", 1e-9);
+    callback = metrics->add_callback(
+        "decode_frames_total", "Frames delivered or skipped by the decoder.",
+        Metrics::COUNTER, [this]() {
+            std::lock_guard<std::mutex> lock(ready_mutex);
+            return Metrics::Samples{
+                { "result=\"delivered\"", (double)delivered },
+                { "result=\"skipped\"", (double)skipped }
+            };
+        });
+}
+
+void DecodePool::work()
+{
+    while (true) {
+        Job job;
+        {
+            // 解码中和待交付的帧达到上限时等待交付, 否则处理函数较慢时 ready 无限增长,
+            // 且 FrameRing 没有空闲槽位时会淘汰正在交付的帧
+            std::unique_lock<std::mutex> lock(ready_mutex);
+            pending_cv.wait(lock, [this]() {
+                return stopped || decoding + ready.size() < max_pending;
+            });
+            if (stopped)
+                return;
+            decoding++;
+        }
+        {
+            std::unique_lock<std::mutex> lock(jobs_mutex);
+            jobs_cv.wait(lock, [this]() { return stopped || !jobs.empty(); });
+            if (stopped)
+                return;
+            job = jobs.front();
+            jobs.pop_front();
+        }
+        space_cv.notify_one();
+
+        // 有帧缓冲池时直接解码到槽位缓冲, 尺寸不变时复用内存
+        int slot = ring != nullptr ? ring->acquire() : -1;
+        cv::Mat image;
+        if (slot >= 0)
+            image = ring->image(slot);
+        bool ok;
+        auto start = std::chrono::steady_clock::now();
+        {
+            TRACE_SPAN("imdecode", job.dataID);
+            if (TiledImage::is_tiled(job.data, job.lenth)) {
+                ok = TiledImage::decode(job.data, job.lenth, image);
+            } else {
+                cv::Mat decoded = cv::imdecode(
+                    cv::Mat(1, job.lenth, CV_8U, job.data), cv::IMREAD_COLOR,
+                    &image);
+                ok = !decoded.empty();
+            }
+        }
+        if (metrics != nullptr)
+            metrics->observe(decode_time,
+                             std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::steady_clock::now() - start)
+                                 .count());
+        delete[] job.data;
+        if (slot >= 0)
+            ring->image(slot) = image; // 尺寸变化时槽位换用新分配的缓冲
+        if (!ok)
+            image = cv::Mat();
+
+        finish(job, image, slot, true);
+    }
+}
+
+void DecodePool::finish(const Job &job, cv::Mat image, int slot,
+                        bool decoded)
+{
+    {
+        std::lock_guard<std::mutex> lock(ready_mutex);
+        if (decoded)
+            decoding--;
+        if (job.seq < deliver_seq || stopped) { // 已被跳过
+            Result result = { job.dataID, image, slot, job.stamp };
+            discard(result);
+        } else {
+            ready[job.seq] = Result{ job.dataID, image, slot, job.stamp };
+        }
+    }
+    ready_cv.notify_one();
+    pending_cv.notify_one();
+}
+
+void DecodePool::discard(Result &result)
+{
+    if (result.slot >= 0)
+        ring->release(result.slot);
+    result.slot = -1;
+    result.image.release();
+}
+
+bool DecodePool::take(Result &result)
+{
+    // 已被跳过的帧解码完成后直接丢弃
+    while (!ready.empty() && ready.begin()->first < deliver_seq) {
+        discard(ready.begin()->second);
+        ready.erase(ready.begin());
+    }
+
+    while (!ready.empty()) {
+        if (policy == LATEST_ONLY) { // 交付最新的解码成功帧
+            auto latest = ready.end();
+            for (auto it = ready.begin(); it != ready.end(); it++) {
+                if (!it->second.image.empty())
+                    latest = it;
+            }
+            if (latest == ready.end()) {
+                skipped += ready.rbegin()->first + 1 - deliver_seq;
+                deliver_seq = ready.rbegin()->first + 1;
+                for (auto &r : ready) {
+                    discard(r.second);
+                }
+                ready.clear();
+                return false;
+            }
+            skipped += latest->first - deliver_seq;
+            deliver_seq = latest->first + 1;
+            result = latest->second;
+            for (auto it = ready.begin(); it != latest; it++) {
+                discard(it->second);
+            }
+            ready.erase(ready.begin(), std::next(latest));
+            return true;
+        }
+
+        auto next = ready.begin();
+        if (next->first == deliver_seq) { // 下一帧已就绪
+            deliver_seq++;
+            if (next->second.image.empty()) { // 解码失败或被丢弃
+                skipped++;
+                discard(next->second);
+                ready.erase(next);
+                continue;
+            }
+            result = next->second;
+            ready.erase(next);
+            return true;
+        }
+        if (policy == SKIP_LATE && ready.size() >= max_lag) {
+            // 更新的帧已积压 max_lag 帧, 放弃等待中间尚未完成的帧
+            skipped += next->first - deliver_seq;
+            deliver_seq = next->first;
+            continue;
+        }
+        return false;
+    }
+    return false;
+}
+
+void DecodePool::deliver()
+{
+    while (true) {
+        Result result = { 0, cv::Mat(), -1, {} };
+        {
+            std::unique_lock<std::mutex> lock(ready_mutex);
+            ready_cv.wait(lock, [&]() {
+                if (stopped)
+                    return true;
+                bool taken = take(result);
+                // take 取出或丢弃了帧时让出空位, 通知等待的解码线程
+                pending_cv.notify_all();
+                return taken;
+            });
+            if (stopped) {
+                discard(result);
+                return;
+            }
+            delivered++;
+            // 先加入历史队列再交付, 处理函数可以按 dataID 访问这一帧
+            if (result.slot >= 0)
+                ring->commit(result.slot, result.dataID, result.stamp);
+        }
+        on_frame(result.dataID, result.image);
+    }
+}
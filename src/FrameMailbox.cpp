@@ -0,0 +1,22 @@
+#include "FrameMailbox.hpp"
+
+FrameMailbox::FrameMailbox() : middle(1), back(0), front(2)
+{
+}
+
+void FrameMailbox::put(const cv::Mat &frame)
+{
+    frame.copyTo(buffers[back]);
+    // 写好的后台缓冲与中间缓冲交换, 并标记有新帧
+    back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & ~FRESH;
+}
+
+bool FrameMailbox::take(cv::Mat &frame)
+{
+    if (!(middle.load(std::memory_order_acquire) & FRESH))
+        return false;
+    // 前台缓冲与中间缓冲交换, 同时清除新帧标志
+    front = middle.exchange(front, std::memory_order_acq_rel) & ~FRESH;
+    frame = buffers[front];
+    return true;
+}
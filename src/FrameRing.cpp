@@ -0,0 +1,95 @@
+#include <algorithm>
+
+#include "FrameRing.hpp"
+
+FrameRing::FrameRing(size_t history, size_t in_flight)
+{
+    history = std::max<size_t>(2, history);
+    slots.resize(history + in_flight);
+    order.resize(history);
+    free_slots.reserve(slots.size());
+    for (int i = (int)slots.size() - 1; i >= 0; i--) {
+        slots[i].has_transform = false;
+        free_slots.push_back(i);
+    }
+}
+
+int FrameRing::evict()
+{
+    int slot = order[head];
+    head = (head + 1) % order.size();
+    count--;
+    return slot;
+}
+
+int FrameRing::acquire()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (free_slots.empty()) {
+        if (count == 0)
+            return -1; // 所有槽位都在解码中
+        return evict();
+    }
+    int slot = free_slots.back();
+    free_slots.pop_back();
+    return slot;
+}
+
+cv::Mat &FrameRing::image(int slot)
+{
+    return slots[slot].image;
+}
+
+void FrameRing::release(int slot)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    free_slots.push_back(slot);
+}
+
+void FrameRing::commit(int slot, unsigned int dataID,
+                       std::chrono::steady_clock::time_point stamp)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    slots[slot].dataID = dataID;
+    slots[slot].stamp = stamp;
+    slots[slot].has_transform = false;
+    if (count == order.size()) // 历史队列已满, 最旧的槽位回到空闲列表
+        free_slots.push_back(evict());
+    order[(head + count) % order.size()] = slot;
+    count++;
+}
+
+bool FrameRing::set_transform(unsigned int dataID,
+                              const Message::TransformData &transform)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = count; i > 0; i--) { // 从最新帧开始查找
+        Frame &frame = slots[order[(head + i - 1) % order.size()]];
+        if (frame.dataID == dataID) {
+            frame.transform = transform;
+            frame.has_transform = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FrameRing::latest(size_t k, Frame &frame)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (k >= count)
+        return false;
+    const Frame &src = slots[order[(head + count - 1 - k) % order.size()]];
+    src.image.copyTo(frame.image);
+    frame.dataID = src.dataID;
+    frame.stamp = src.stamp;
+    frame.transform = src.transform;
+    frame.has_transform = src.has_transform;
+    return true;
+}
+
+size_t FrameRing::size()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return count;
+}
@@ -0,0 +1,76 @@
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+#include "ImageSubscription.hpp"
+
+void ImageSubscriptions::subscribe(
+    int client, const Message::ImageSubscribeData &subscription)
+{
+    Message::ImageSubscribeData sub = subscription;
+    sub.Width = std::min(sub.Width, MAX_SIZE);
+    sub.Height = std::min(sub.Height, MAX_SIZE);
+    std::lock_guard<std::mutex> lock(mutex);
+    subscriptions[client] = sub;
+}
+
+void ImageSubscriptions::remove(int client)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    subscriptions.erase(client);
+}
+
+Message::ImageSubscribeData ImageSubscriptions::get(int client)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = subscriptions.find(client);
+    if (it == subscriptions.end())
+        return Message::ImageSubscribeData{ 0, 0, 0, 0, 0, 0, 0, 0 };
+    return it->second;
+}
+
+std::string ImageSubscriptions::get_subscriptions()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string str = "";
+    char line[128];
+    for (auto const &sub : subscriptions) {
+        snprintf(line, sizeof(line),
+                 "Client %d: roi (%d, %d, %d, %d), size %ux%u, tiles %ux%u\n",
+                 sub.first, sub.second.RoiX, sub.second.RoiY,
+                 sub.second.RoiWidth, sub.second.RoiHeight, sub.second.Width,
+                 sub.second.Height, sub.second.TileRows, sub.second.TileCols);
+        str += line;
+    }
+    return str;
+}
+
+cv::Mat ImageSubscriptions::apply(const cv::Mat &img,
+                                  const Message::ImageSubscribeData &subscription)
+{
+    cv::Mat view = img;
+    if (subscription.RoiWidth > 0 && subscription.RoiHeight > 0) {
+        cv::Rect roi = cv::Rect(subscription.RoiX, subscription.RoiY,
+                                subscription.RoiWidth,
+                                subscription.RoiHeight) &
+                       cv::Rect(0, 0, img.cols, img.rows);
+        if (!roi.empty())
+            view = img(roi); // 只引用原图数据, 不拷贝
+    }
+    if (subscription.Width > 0 && subscription.Height > 0 &&
+        (view.cols != (int)subscription.Width ||
+         view.rows != (int)subscription.Height)) {
+        cv::Mat resized;
+        cv::resize(view, resized,
+                   cv::Size(subscription.Width, subscription.Height), 0, 0,
+                   cv::INTER_AREA);
+        return resized;
+    }
+    return view;
+}
+
+bool ImageSubscriptions::equal(const Message::ImageSubscribeData &a,
+                               const Message::ImageSubscribeData &b)
+{
+    return memcmp(&a, &b, sizeof(Message::ImageSubscribeData)) == 0;
+}
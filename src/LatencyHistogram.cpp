@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <cstdio>
+
+#include "LatencyHistogram.hpp"
+
+LatencyHistogram::LatencyHistogram(int key) : key(key)
+{
+    reset();
+}
+
+unsigned long long LatencyHistogram::upper(int i)
+{
+    if (i < (1 << SUB_BITS))
+        return i;
+    int shift = (i >> SUB_BITS) - 1;
+    unsigned long long lower =
+        (unsigned long long)((1 << SUB_BITS) | (i & ((1 << SUB_BITS) - 1)))
+        << shift;
+    return lower + (1ull << shift) - 1;
+}
+
+long long LatencyHistogram::percentile(double p) const
+{
+    unsigned long total = 0;
+    unsigned long counts[BUCKETS];
+    for (int i = 0; i < BUCKETS; i++) {
+        counts[i] = buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0)
+        return 0;
+    unsigned long rank = std::min(total, (unsigned long)(p * total) + 1);
+    unsigned long seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank)
+            return std::min(upper(i), max.load(std::memory_order_relaxed));
+    }
+    return max.load(std::memory_order_relaxed);
+}
+
+std::string LatencyHistogram::get_summary() const
+{
+    unsigned long n = count.load();
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer),
+             "count: %lu, mean: %.1f us, p50: %.1f us, p90: %.1f us, "
+             "p99: %.1f us, p99.9: %.1f us, max: %.1f us",
+             n, n == 0 ? 0 : sum.load() / 1e3 / n, percentile(0.5) / 1e3,
+             percentile(0.9) / 1e3, percentile(0.99) / 1e3,
+             percentile(0.999) / 1e3, max.load() / 1e3);
+    return buffer;
+}
+
+void LatencyHistogram::reset()
+{
+    for (auto &bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    count = 0;
+    sum = 0;
+    max = 0;
+}
+
+LatencyStats::LatencyStats()
+{
+    for (auto &slot : slots) {
+        slot.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+LatencyStats::~LatencyStats()
+{
+    for (auto &slot : slots) {
+        delete slot.load();
+    }
+}
+
+LatencyHistogram *LatencyStats::get(int key)
+{
+    unsigned int start = (unsigned int)key * 2654435761u % CAPACITY;
+    for (int probe = 0; probe < CAPACITY; probe++) {
+        auto &slot = slots[(start + probe) % CAPACITY];
+        LatencyHistogram *h = slot.load(std::memory_order_acquire);
+        if (h == nullptr) {
+            // 空槽, 先分配再抢占, 抢占失败说明其他线程刚插入了某个键, 检查是否相同
+            LatencyHistogram *created = new LatencyHistogram(key);
+            if (slot.compare_exchange_strong(h, created,
+                                             std::memory_order_acq_rel))
+                return created;
+            delete created;
+        }
+        if (h->get_key() == key)
+            return h;
+    }
+    return nullptr;
+}
+
+const LatencyHistogram *LatencyStats::find(int key) const
+{
+    unsigned int start = (unsigned int)key * 2654435761u % CAPACITY;
+    for (int probe = 0; probe < CAPACITY; probe++) {
+        LatencyHistogram *h =
+            slots[(start + probe) % CAPACITY].load(std::memory_order_acquire);
+        if (h == nullptr)
+            return nullptr; // 插入时占用探测序列中第一个空槽, 之后不会再有该键
+        if (h->get_key() == key)
+            return h;
+    }
+    return nullptr;
+}
+
+std::vector<const LatencyHistogram *> LatencyStats::get_all() const
+{
+    std::vector<const LatencyHistogram *> all;
+    for (auto &slot : slots) {
+        LatencyHistogram *h = slot.load(std::memory_order_acquire);
+        if (h != nullptr && h->get_count() > 0)
+            all.push_back(h);
+    }
+    std::sort(all.begin(), all.end(),
+              [](const LatencyHistogram *a, const LatencyHistogram *b) {
+                  return a->get_key() < b->get_key();
+              });
+    return all;
+}
+
+void LatencyStats::reset()
+{
+    for (auto &slot : slots) {
+        LatencyHistogram *h = slot.load(std::memory_order_acquire);
+        if (h != nullptr)
+            h->reset();
+    }
+}
@@ -0,0 +1,210 @@
+#include <chrono>
+#include <cstdio>
+
+#include "Log.hpp"
+#include "Metrics.hpp"
+
+#include <PHOENIX/Utils/Info/Info.hpp>
+
+std::atomic<unsigned long> Log::dropped{ 0 };
+std::atomic<unsigned long> Log::suppressed{ 0 };
+
+Log::Queue::Queue()
+{
+    for (unsigned int i = 0; i < CAPACITY; i++) {
+        records[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    thread = std::thread(&Queue::run, this);
+}
+
+Log::Queue::~Queue()
+{
+    stop = true;
+    if (thread.joinable())
+        thread.join();
+}
+
+void Log::Queue::run()
+{
+    while (true) {
+        if (drain())
+            continue;
+        if (stop.load()) {
+            drain(); // 退出前输出剩余的日志
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+bool Log::Queue::drain()
+{
+    bool any = false;
+    unsigned long pos = tail.load(std::memory_order_relaxed);
+    while (true) {
+        Record &record = records[pos % CAPACITY];
+        if (record.sequence.load(std::memory_order_acquire) != pos + 1)
+            break; // 尚未发布
+        std::string text = format(record);
+        Level level = record.site->level;
+        // 槽位交还给下一轮的生产者
+        record.sequence.store(pos + CAPACITY, std::memory_order_release);
+        pos++;
+        tail.store(pos, std::memory_order_release);
+        any = true;
+
+        switch (level) {
+        case LEVEL_DEBUG:
+            DEBUG(text);
+            break;
+        case LEVEL_INFO:
+            INFO(text);
+            break;
+        case LEVEL_SUCCESS:
+            SUCCESS(text);
+            break;
+        case LEVEL_WARNING:
+            WARNING(text);
+            break;
+        case LEVEL_ERROR:
+            ERROR(text);
+            break;
+        }
+    }
+    return any;
+}
+
+Log::Queue &Log::queue()
+{
+    static Queue queue;
+    return queue;
+}
+
+long long Log::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+bool Log::admit(Site &site, long long time)
+{
+    if (site.interval == 0)
+        return true;
+    long long tat = site.tat.load(std::memory_order_relaxed);
+    while (true) {
+        if (time < tat - site.tolerance) {
+            site.suppressed.fetch_add(1, std::memory_order_relaxed);
+            suppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        long long next = std::max(tat, time) + site.interval;
+        if (site.tat.compare_exchange_weak(tat, next,
+                                           std::memory_order_relaxed))
+            return true;
+    }
+}
+
+Log::Record *Log::claim()
+{
+    Queue &q = queue();
+    unsigned long pos = q.head.load(std::memory_order_relaxed);
+    while (true) {
+        Record &record = q.records[pos % CAPACITY];
+        unsigned long sequence = record.sequence.load(std::memory_order_acquire);
+        if (sequence == pos) {
+            if (q.head.compare_exchange_weak(pos, pos + 1,
+                                             std::memory_order_relaxed))
+                return &record;
+        } else if (sequence < pos) {
+            // 槽位还未被后台线程读取, 缓冲区已满, 丢弃而不是等待
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        } else {
+            pos = q.head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void Log::publish(Record *record)
+{
+    record->sequence.store(
+        record->sequence.load(std::memory_order_relaxed) + 1,
+        std::memory_order_release);
+}
+
+std::string Log::format(const Record &record)
+{
+    std::string text;
+    const char *f = record.site->format;
+    int arg = 0;
+    char buffer[32];
+    while (*f != 0) {
+        bool hex = strncmp(f, "{x}", 3) == 0;
+        if ((strncmp(f, "{}", 2) != 0 && !hex) || arg >= record.count) {
+            text += *f++;
+            continue;
+        }
+        f += hex ? 3 : 2;
+        switch (record.types[arg]) {
+        case INT:
+            snprintf(buffer, sizeof(buffer), hex ? "0x%llx" : "%lld",
+                     record.values[arg].i);
+            text += buffer;
+            break;
+        case UINT:
+            snprintf(buffer, sizeof(buffer), hex ? "0x%llx" : "%llu",
+                     record.values[arg].u);
+            text += buffer;
+            break;
+        case DOUBLE:
+            snprintf(buffer, sizeof(buffer), "%g", record.values[arg].d);
+            text += buffer;
+            break;
+        case TEXT_ARG:
+            text += record.text + record.values[arg].text;
+            break;
+        }
+        arg++;
+    }
+    if (record.suppressed > 0)
+        text += " (" + std::to_string(record.suppressed) +
+                " similar messages suppressed)";
+    return text;
+}
+
+void Log::flush(int timeout_ms)
+{
+    Queue &q = queue();
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(timeout_ms);
+    while (q.tail.load() < q.head.load() &&
+           std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+unsigned long Log::get_dropped()
+{
+    return dropped.load();
+}
+
+unsigned long Log::get_suppressed()
+{
+    return suppressed.load();
+}
+
+void Log::set_metrics(std::shared_ptr<Metrics> metrics)
+{
+    metrics->add_callback("log_dropped_total",
+                          "Log records dropped because the queue was full.",
+                          Metrics::COUNTER, []() {
+                              return Metrics::Samples{ { "", get_dropped() } };
+                          });
+    metrics->add_callback("log_suppressed_total",
+                          "Log records suppressed by per-site rate limits.",
+                          Metrics::COUNTER, []() {
+                              return Metrics::Samples{ { "",
+                                                         get_suppressed() } };
+                          });
+}
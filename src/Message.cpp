@@ -59,8 +59,14 @@ void Message::set_offset(const unsigned int offset){
     message.Offset = offset;
 }
 
+void Message::set_timestamps(const long long origin, const long long send){
+    TimestampExtension ext = { origin, send };
+    message.MessageType |= TIMESTAMP_FLAG;
+    memcpy(message.Data + sizeof(message.Data) - sizeof(ext), &ext, sizeof(ext));
+}
+
 unsigned short Message::get_messageType() const{
-    return message.MessageType;
+    return message.MessageType & ~TIMESTAMP_FLAG;
 }
 
 unsigned int Message::get_dataID() const{
@@ -85,4 +91,20 @@ unsigned int Message::get_dataLenth() const{
 
 const unsigned char* Message::get_buffer() const{
     return (unsigned char*)&message;
-}
\ No newline at end of file
+}
+
+bool Message::get_timestamps(long long &origin, long long &send) const{
+    if (!(message.MessageType & TIMESTAMP_FLAG))
+        return false;
+    TimestampExtension ext;
+    memcpy(&ext, message.Data + sizeof(message.Data) - sizeof(ext), sizeof(ext));
+    origin = ext.OriginTime;
+    send = ext.SendTime;
+    return true;
+}
+
+unsigned int Message::get_capacity() const{
+    if (message.MessageType & TIMESTAMP_FLAG)
+        return sizeof(message.Data) - sizeof(TimestampExtension);
+    return sizeof(message.Data);
+}
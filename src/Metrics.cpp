@@ -0,0 +1,400 @@
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "Metrics.hpp"
+
+#include <PHOENIX/Utils/Info/Info.hpp>
+
+namespace {
+/**
+ * @brief 当前线程使用过的所有注册表的分片, 线程退出时合并到各注册表中
+ *
+ */
+struct LocalShards {
+    std::vector<std::pair<std::shared_ptr<void>, void *>> entries; ///< (注册表状态, 分片)
+    std::function<void(void *, void *)> retire; ///< 合并函数, 由 Metrics 设置
+
+    ~LocalShards()
+    {
+        for (auto &entry : entries) {
+            retire(entry.first.get(), entry.second);
+        }
+    }
+};
+
+thread_local LocalShards local_shards;
+thread_local const void *cached_state = nullptr; ///< 最近使用的注册表状态
+thread_local void *cached_shard = nullptr; ///< 最近使用的分片
+} // namespace
+
+Metrics::Shard::Shard()
+{
+    for (auto &chunk : chunks) {
+        chunk.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+Metrics::Shard::~Shard()
+{
+    for (auto &chunk : chunks) {
+        delete[] chunk.load();
+    }
+}
+
+Metrics::Family::Family(Metrics *metrics, const std::string &name,
+                        const std::string &labels,
+                        const std::string &key_label, bool hex)
+    : metrics(metrics), name(name), labels(labels), key_label(key_label),
+      hex(hex)
+{
+    for (auto &slot : slots) {
+        slot.store(0, std::memory_order_relaxed);
+    }
+}
+
+int Metrics::Family::get(int key)
+{
+    unsigned int start = (unsigned int)key * 2654435761u % CAPACITY;
+    for (int probe = 0; probe < CAPACITY; probe++) {
+        auto &slot = slots[(start + probe) % CAPACITY];
+        unsigned long long value = slot.load(std::memory_order_acquire);
+        if (value == 0) {
+            // 首次出现的键, 注册序列后抢占空槽; 重复注册返回相同编号, 抢占失败时检查新的槽值
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), hex ? "0x%x" : "%d", key);
+            std::string series = labels.empty() ? "" : labels + ",";
+            series += key_label + "=\"" + buffer + "\"";
+            int cell = metrics->add_series(name, "", COUNTER, series);
+            if (cell < 0)
+                return -1;
+            unsigned long long entry =
+                ((unsigned long long)(unsigned int)key << 32) |
+                (unsigned int)(cell + 1);
+            if (slot.compare_exchange_strong(value, entry,
+                                             std::memory_order_acq_rel))
+                return cell;
+        }
+        if ((unsigned int)(value >> 32) == (unsigned int)key)
+            return (int)(value & 0xFFFFFFFF) - 1;
+    }
+    return -1;
+}
+
+void Metrics::Family::add(int key, long long n)
+{
+    metrics->add(get(key), n);
+}
+
+void Metrics::Family::observe(int key, long long value)
+{
+    metrics->observe(get(key), value);
+}
+
+Metrics::Metrics() : state(std::make_shared<State>())
+{
+}
+
+Metrics::~Metrics()
+{
+    if (server_fd >= 0) {
+        shutdown(server_fd, SHUT_RDWR);
+        close(server_fd);
+    }
+    if (server.joinable())
+        server.join();
+}
+
+int Metrics::add_series(const std::string &name, const std::string &help,
+                        Type type, const std::string &labels, double scale)
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    std::string key = name + "{" + labels + "}";
+    auto it = state->cells.find(key);
+    if (it != state->cells.end())
+        return it->second;
+
+    // 首个序列决定指标的说明、类型和换算系数, Family 注册的序列沿用这些属性
+    auto found = state->descriptors.find(name);
+    if (found == state->descriptors.end())
+        found = state->descriptors
+                    .emplace(name, Descriptor{ help, type, scale, {} })
+                    .first;
+    int width = found->second.type == SUMMARY ? 2 : 1;
+    if (state->next_cell + width > CHUNK * CHUNKS) {
+        WARNING("Metrics: too many series, " + key + " ignored.");
+        return -1;
+    }
+    int cell = state->next_cell;
+    state->next_cell += width;
+    state->cells[key] = cell;
+    found->second.series.push_back(Series{ labels, cell });
+    return cell;
+}
+
+std::shared_ptr<Metrics::Family>
+Metrics::add_family(const std::string &name, const std::string &help,
+                    Type type, const std::string &labels,
+                    const std::string &key_label, double scale, bool hex)
+{
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (state->descriptors.find(name) == state->descriptors.end())
+            state->descriptors.emplace(name,
+                                       Descriptor{ help, type, scale, {} });
+    }
+    return std::shared_ptr<Family>(
+        new Family(this, name, labels, key_label, hex));
+}
+
+int Metrics::add_callback(const std::string &name, const std::string &help,
+                          Type type, std::function<Samples()> callback)
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    int id = state->next_callback++;
+    state->callbacks.push_back(Callback{ id, name, help, type, callback });
+    return id;
+}
+
+void Metrics::remove_callback(int id)
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    for (auto it = state->callbacks.begin(); it != state->callbacks.end();
+         it++) {
+        if (it->id == id) {
+            state->callbacks.erase(it);
+            return;
+        }
+    }
+}
+
+Metrics::Shard *Metrics::local()
+{
+    if (cached_state == state.get())
+        return (Shard *)cached_shard;
+    for (auto &entry : local_shards.entries) {
+        if (entry.first.get() == state.get()) {
+            cached_state = state.get();
+            cached_shard = entry.second;
+            return (Shard *)entry.second;
+        }
+    }
+    Shard *shard = new Shard();
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->shards.push_back(shard);
+    }
+    local_shards.retire = [](void *state, void *shard) {
+        retire(*(State *)state, (Shard *)shard);
+    };
+    local_shards.entries.push_back({ state, shard });
+    cached_state = state.get();
+    cached_shard = shard;
+    return shard;
+}
+
+void Metrics::add(int series, long long n)
+{
+    if (series < 0)
+        return;
+    Shard *shard = local();
+    auto &chunk_ptr = shard->chunks[series / CHUNK];
+    std::atomic<long long> *chunk = chunk_ptr.load(std::memory_order_acquire);
+    if (chunk == nullptr) {
+        chunk = new std::atomic<long long>[CHUNK];
+        for (int i = 0; i < CHUNK; i++) {
+            chunk[i].store(0, std::memory_order_relaxed);
+        }
+        chunk_ptr.store(chunk, std::memory_order_release);
+    }
+    // 分片只由当前线程写入, 读-加-写不需要原子指令
+    auto &cell = chunk[series % CHUNK];
+    cell.store(cell.load(std::memory_order_relaxed) + n,
+               std::memory_order_relaxed);
+}
+
+void Metrics::observe(int series, long long value)
+{
+    if (series < 0)
+        return;
+    add(series, value);
+    add(series + 1, 1);
+}
+
+void Metrics::retire(State &state, Shard *shard)
+{
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if ((int)state.retired.size() < state.next_cell)
+        state.retired.resize(state.next_cell, 0);
+    for (int c = 0; c * CHUNK < state.next_cell; c++) {
+        std::atomic<long long> *chunk = shard->chunks[c].load();
+        if (chunk == nullptr)
+            continue;
+        for (int i = 0; i < CHUNK && c * CHUNK + i < state.next_cell; i++) {
+            state.retired[c * CHUNK + i] += chunk[i].load();
+        }
+    }
+    for (auto it = state.shards.begin(); it != state.shards.end(); it++) {
+        if (*it == shard) {
+            state.shards.erase(it);
+            break;
+        }
+    }
+    delete shard;
+}
+
+std::string Metrics::format(double value)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.15g", value);
+    return buffer;
+}
+
+std::string Metrics::scrape()
+{
+    std::vector<Callback> callbacks;
+    std::stringstream ss;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        std::vector<long long> values(state->next_cell, 0);
+        for (int i = 0; i < state->next_cell && i < (int)state->retired.size();
+             i++) {
+            values[i] = state->retired[i];
+        }
+        for (Shard *shard : state->shards) {
+            for (int c = 0; c * CHUNK < state->next_cell; c++) {
+                std::atomic<long long> *chunk =
+                    shard->chunks[c].load(std::memory_order_acquire);
+                if (chunk == nullptr)
+                    continue;
+                for (int i = 0; i < CHUNK && c * CHUNK + i < state->next_cell;
+                     i++) {
+                    values[c * CHUNK + i] +=
+                        chunk[i].load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        for (auto &item : state->descriptors) {
+            const std::string &name = item.first;
+            const Descriptor &desc = item.second;
+            if (desc.series.empty())
+                continue;
+            static const char *types[] = { "counter", "gauge", "summary" };
+            ss << "# HELP " << name << " " << desc.help << "\n";
+            ss << "# TYPE " << name << " " << types[desc.type] << "\n";
+            for (auto &series : desc.series) {
+                std::string labels =
+                    series.labels.empty() ? "" : "{" + series.labels + "}";
+                if (desc.type == SUMMARY) {
+                    ss << name << "_sum" << labels << " "
+                       << format(values[series.cell] * desc.scale) << "\n";
+                    ss << name << "_count" << labels << " "
+                       << values[series.cell + 1] << "\n";
+                } else {
+                    ss << name << labels << " "
+                       << format(values[series.cell] * desc.scale) << "\n";
+                }
+            }
+        }
+        callbacks = state->callbacks;
+    }
+
+    // 回调可能访问其他对象的锁, 在注册表锁之外调用
+    for (auto &callback : callbacks) {
+        static const char *types[] = { "counter", "gauge", "summary" };
+        ss << "# HELP " << callback.name << " " << callback.help << "\n";
+        ss << "# TYPE " << callback.name << " " << types[callback.type]
+           << "\n";
+        for (auto &sample : callback.callback()) {
+            ss << callback.name
+               << (sample.first.empty() ? "" : "{" + sample.first + "}") << " "
+               << format(sample.second) << "\n";
+        }
+    }
+    return ss.str();
+}
+
+bool Metrics::serve(int port)
+{
+    server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_fd == -1) {
+        ERROR("Metrics: failed to create socket.");
+        return false;
+    }
+    int opt = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in address;
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // 只允许本机抓取
+    address.sin_port = htons(port);
+    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) == -1 ||
+        listen(server_fd, 8) == -1) {
+        ERROR("Metrics: failed to listen on port " + std::to_string(port));
+        close(server_fd);
+        server_fd = -1;
+        return false;
+    }
+
+    server = std::thread([this]() {
+        while (true) {
+            int client = ::accept(server_fd, NULL, NULL);
+            if (client == -1)
+                return; // 监听 socket 已关闭
+            // 连接建立后不发送请求或不读取回复时超时关闭, 不阻塞下一次抓取
+            struct timeval timeout = { TIMEOUT_MS / 1000,
+                                       TIMEOUT_MS % 1000 * 1000 };
+            setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                       sizeof(timeout));
+            setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+                       sizeof(timeout));
+            respond(client);
+            close(client);
+        }
+    });
+    INFO("Metrics: serving on 127.0.0.1:" + std::to_string(port));
+    return true;
+}
+
+void Metrics::respond(int client)
+{
+    // 只需要请求行, 读到头部结束或缓冲区满为止
+    char request[4096];
+    int lenth = 0;
+    while (lenth < (int)sizeof(request) - 1) {
+        int n = read(client, request + lenth, sizeof(request) - 1 - lenth);
+        if (n <= 0)
+            break;
+        lenth += n;
+        request[lenth] = 0;
+        if (strstr(request, "\r\n\r\n") != nullptr)
+            break;
+    }
+    request[lenth] = 0;
+
+    std::string status = "200 OK", body;
+    if (strncmp(request, "GET /metrics", 12) == 0 ||
+        strncmp(request, "GET / ", 6) == 0) {
+        body = scrape();
+    } else {
+        status = "404 Not Found";
+        body = "not found\n";
+    }
+    std::string response =
+        "HTTP/1.1 " + status +
+        "\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+        std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    size_t sent = 0;
+    while (sent < response.size()) {
+        int n = write(client, response.data() + sent, response.size() - sent);
+        if (n <= 0)
+            break;
+        sent += n;
+    }
+}
@@ -0,0 +1,130 @@
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define POINT_TRANSFORM_X86
+#endif
+
+#include "PointTransform.hpp"
+
+PointTransform::PointTransform()
+    : r{ 1, 0, 0, 0, 1, 0, 0, 0, 1 }, t{ 0, 0, 0 }
+{
+}
+
+PointTransform::PointTransform(const Message::TransformData &data)
+{
+    double x = data.Rotation[0], y = data.Rotation[1], z = data.Rotation[2],
+           w = data.Rotation[3];
+    // 单位四元数转旋转矩阵, 先归一化避免传输误差累积
+    double norm = x * x + y * y + z * z + w * w;
+    double s = norm > 0 ? 2.0 / norm : 0;
+    r[0] = 1 - s * (y * y + z * z);
+    r[1] = s * (x * y - z * w);
+    r[2] = s * (x * z + y * w);
+    r[3] = s * (x * y + z * w);
+    r[4] = 1 - s * (x * x + z * z);
+    r[5] = s * (y * z - x * w);
+    r[6] = s * (x * z - y * w);
+    r[7] = s * (y * z + x * w);
+    r[8] = 1 - s * (x * x + y * y);
+    for (int i = 0; i < 3; i++) {
+        t[i] = data.Translation[i];
+    }
+}
+
+PointTransform::PointTransform(const std::vector<Message::TransformData> &chain)
+    : PointTransform()
+{
+    for (auto const &data : chain) {
+        *this = PointTransform(data) * *this;
+    }
+}
+
+PointTransform PointTransform::operator*(const PointTransform &other) const
+{
+    PointTransform result;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            result.r[i * 3 + j] = r[i * 3] * other.r[j] +
+                                  r[i * 3 + 1] * other.r[3 + j] +
+                                  r[i * 3 + 2] * other.r[6 + j];
+        }
+        result.t[i] = r[i * 3] * other.t[0] + r[i * 3 + 1] * other.t[1] +
+                      r[i * 3 + 2] * other.t[2] + t[i];
+    }
+    return result;
+}
+
+void PointTransform::apply(const double *x, const double *y, const double *z,
+                           double *out_x, double *out_y, double *out_z,
+                           size_t n) const
+{
+    static const bool avx2 = has_avx2();
+    if (avx2)
+        apply_avx2(x, y, z, out_x, out_y, out_z, n);
+    else
+        apply_scalar(x, y, z, out_x, out_y, out_z, n);
+}
+
+void PointTransform::apply_scalar(const double *x, const double *y,
+                                  const double *z, double *out_x,
+                                  double *out_y, double *out_z, size_t n) const
+{
+    for (size_t i = 0; i < n; i++) {
+        double px = x[i], py = y[i], pz = z[i];
+        out_x[i] = r[0] * px + r[1] * py + r[2] * pz + t[0];
+        out_y[i] = r[3] * px + r[4] * py + r[5] * pz + t[1];
+        out_z[i] = r[6] * px + r[7] * py + r[8] * pz + t[2];
+    }
+}
+
+#ifdef POINT_TRANSFORM_X86
+__attribute__((target("avx2,fma"))) void
+PointTransform::apply_avx2(const double *x, const double *y, const double *z,
+                           double *out_x, double *out_y, double *out_z,
+                           size_t n) const
+{
+    __m256d m[9], v[3];
+    for (int k = 0; k < 9; k++) {
+        m[k] = _mm256_set1_pd(r[k]);
+    }
+    for (int k = 0; k < 3; k++) {
+        v[k] = _mm256_set1_pd(t[k]);
+    }
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        // 先读入全部输入, 输出与输入相同时也能原地变换
+        __m256d px = _mm256_loadu_pd(x + i);
+        __m256d py = _mm256_loadu_pd(y + i);
+        __m256d pz = _mm256_loadu_pd(z + i);
+        __m256d ox = _mm256_fmadd_pd(
+            m[0], px, _mm256_fmadd_pd(m[1], py, _mm256_fmadd_pd(m[2], pz, v[0])));
+        __m256d oy = _mm256_fmadd_pd(
+            m[3], px, _mm256_fmadd_pd(m[4], py, _mm256_fmadd_pd(m[5], pz, v[1])));
+        __m256d oz = _mm256_fmadd_pd(
+            m[6], px, _mm256_fmadd_pd(m[7], py, _mm256_fmadd_pd(m[8], pz, v[2])));
+        _mm256_storeu_pd(out_x + i, ox);
+        _mm256_storeu_pd(out_y + i, oy);
+        _mm256_storeu_pd(out_z + i, oz);
+    }
+    // 不足 4 个的剩余点
+    apply_scalar(x + i, y + i, z + i, out_x + i, out_y + i, out_z + i, n - i);
+}
+
+bool PointTransform::has_avx2()
+{
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+#else
+void PointTransform::apply_avx2(const double *x, const double *y,
+                                const double *z, double *out_x, double *out_y,
+                                double *out_z, size_t n) const
+{
+    apply_scalar(x, y, z, out_x, out_y, out_z, n);
+}
+
+bool PointTransform::has_avx2()
+{
+    return false;
+}
+#endif
@@ -0,0 +1,132 @@
+#include <algorithm>
+
+#include "PoseStore.hpp"
+
+#include <PHOENIX/Utils/Info/Info.hpp>
+
+PoseStore::PoseStore(const std::string &path, size_t capacity,
+                     std::chrono::milliseconds interval)
+    : received(0), written(0), dropped(0)
+{
+    this->capacity = capacity < 1 ? 1 : capacity;
+    this->interval = interval;
+    file.open(path, std::ios::binary | std::ios::app);
+    if (!file.is_open())
+        ERROR("Failed to open " + path);
+    active = make_block();
+    spare = make_block();
+    writer = std::thread(&PoseStore::flush, this);
+}
+
+PoseStore::~PoseStore()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopped = true;
+    }
+    cv.notify_one();
+    writer.join();
+}
+
+std::unique_ptr<PoseStore::Block> PoseStore::make_block()
+{
+    auto block = std::make_unique<Block>();
+    block->rows = 0;
+    block->stamp.resize(capacity);
+    block->client.resize(capacity);
+    block->kind.resize(capacity);
+    block->target.resize(capacity);
+    for (auto &column : block->values) {
+        column.resize(capacity);
+    }
+    return block;
+}
+
+size_t PoseStore::append(int client, Kind kind,
+                         const Message::PoseSample *samples, size_t count)
+{
+    size_t n;
+    bool half;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Block &b = *active;
+        n = std::min(count, capacity - b.rows);
+        for (size_t i = 0; i < n; i++) {
+            size_t row = b.rows + i;
+            const Message::PoseSample &s = samples[i];
+            b.stamp[row] = s.Stamp;
+            b.client[row] = client;
+            b.kind[row] = kind;
+            b.target[row] = s.Target;
+            for (int k = 0; k < 3; k++) {
+                b.values[k][row] = s.Position[k];
+            }
+            for (int k = 0; k < 4; k++) {
+                b.values[3 + k][row] = s.Rotation[k];
+            }
+        }
+        b.rows += n;
+        half = b.rows >= capacity / 2;
+    }
+    received += n;
+    dropped += count - n;
+    if (half)
+        cv.notify_one();
+    return n;
+}
+
+void PoseStore::write(const Block &block)
+{
+    if (!file.is_open())
+        return;
+    BlockHeader header = { BLOCK_MAGIC, 1, block.rows };
+    file.write((const char *)&header, sizeof(header));
+    file.write((const char *)block.stamp.data(),
+               block.rows * sizeof(block.stamp[0]));
+    file.write((const char *)block.client.data(),
+               block.rows * sizeof(block.client[0]));
+    file.write((const char *)block.kind.data(),
+               block.rows * sizeof(block.kind[0]));
+    file.write((const char *)block.target.data(),
+               block.rows * sizeof(block.target[0]));
+    for (auto const &column : block.values) {
+        file.write((const char *)column.data(), block.rows * sizeof(double));
+    }
+    file.flush();
+}
+
+void PoseStore::flush()
+{
+    while (true) {
+        std::unique_ptr<Block> full;
+        bool stop;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait_for(lock, interval, [&]() {
+                return stopped || active->rows >= capacity / 2;
+            });
+            stop = stopped;
+            if (active->rows > 0) {
+                // 交换后接收线程立即写入空闲块, 写文件不持有锁
+                full = std::move(active);
+                active = std::move(spare);
+            }
+        }
+        if (full != nullptr) {
+            write(*full);
+            written += full->rows;
+            full->rows = 0;
+            std::lock_guard<std::mutex> lock(mutex);
+            spare = std::move(full);
+        }
+        if (stop)
+            return;
+    }
+}
+
+std::string PoseStore::get_stats()
+{
+    return "received: " + std::to_string(received.load()) +
+           ", written: " + std::to_string(written.load()) +
+           ", dropped: " + std::to_string(dropped.load());
+}
@@ -0,0 +1,97 @@
+#include "RequestTable.hpp"
+
+RequestTable::RequestTable()
+{
+    timer = std::thread(&RequestTable::run, this);
+}
+
+RequestTable::~RequestTable()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopped = true;
+        for (auto &p : pending) {
+            p.second.promise.set_value(Reply{ false, 0, {} });
+        }
+        pending.clear();
+    }
+    cv.notify_all();
+    timer.join();
+}
+
+std::future<RequestTable::Reply>
+RequestTable::add(unsigned int &id, std::chrono::milliseconds timeout)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    // 跳过仍未完成的 ID, 计数回绕后不会覆盖旧请求
+    do {
+        id = ID_BASE + counter;
+        counter = (counter + 1) % ID_COUNT;
+    } while (pending.find(id) != pending.end());
+
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    Pending &p = pending[id];
+    p.deadline = deadline;
+    // 新请求最早超时时唤醒计时线程重新计算等待时间
+    if (deadlines.emplace(deadline, id) == deadlines.begin())
+        cv.notify_one();
+    return p.promise.get_future();
+}
+
+bool RequestTable::complete(unsigned int id, unsigned short type,
+                            const unsigned char *data, unsigned int lenth)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = pending.find(id);
+    if (it == pending.end())
+        return false;
+    it->second.promise.set_value(
+        Reply{ true, type, std::vector<unsigned char>(data, data + lenth) });
+    pending.erase(it);
+    return true;
+}
+
+void RequestTable::fail(unsigned int id)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = pending.find(id);
+    if (it == pending.end())
+        return;
+    it->second.promise.set_value(Reply{ false, 0, {} });
+    pending.erase(it);
+}
+
+void RequestTable::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopped) {
+        if (deadlines.empty()) {
+            cv.wait(lock);
+            continue;
+        }
+        auto next = deadlines.begin()->first;
+        cv.wait_until(lock, next);
+        auto now = std::chrono::steady_clock::now();
+        while (!deadlines.empty() && deadlines.begin()->first <= now) {
+            auto it = pending.find(deadlines.begin()->second);
+            // 同一 ID 可能已完成并被重新分配, 只处理超时时刻一致的请求
+            if (it != pending.end() &&
+                it->second.deadline == deadlines.begin()->first) {
+                it->second.promise.set_value(Reply{ false, 0, {} });
+                pending.erase(it);
+            }
+            deadlines.erase(deadlines.begin());
+        }
+    }
+}
+
+bool RequestTable::is_request_id(unsigned int id)
+{
+    return id >= ID_BASE && id - ID_BASE < ID_COUNT;
+}
+
+size_t RequestTable::get_pending()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return pending.size();
+}
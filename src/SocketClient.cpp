@@ -1,3 +1,4 @@
+#include <cerrno>
 #include <thread>
 
 #include "SocketClient.hpp"
@@ -58,7 +59,29 @@ void SocketClient::disconnect()
 
 int SocketClient::send(const char *message, int lenth)
 {
-    return write(this->client_fd, message, lenth);
+    int ret = 0;
+    {
+        std::lock_guard<std::mutex> lock(send_mutex);
+        while (ret < lenth) {
+            int n = write(this->client_fd, message + ret, lenth - ret);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                ret = -1;
+                break;
+            }
+            ret += n;
+        }
+    }
+    if (metrics != nullptr) {
+        if (ret < 0) {
+            metrics->add(send_errors, 1);
+        } else {
+            metrics->add(bytes_sent, ret);
+            metrics->add(messages_sent, 1);
+        }
+    }
+    return ret;
 }
 
 void SocketClient::set_on_message(std::function<void(const char *)> on_message)
@@ -95,6 +118,12 @@ void SocketClient::receive()
             }
             lenth += valread;
         }
+        if (metrics != nullptr) {
+            metrics->add(bytes_received, lenth);
+            metrics->add(messages_received, 1);
+        }
+        if (recorder != nullptr)
+            recorder->append(port, buffer, lenth);
 
         if (this->on_message != nullptr) { // 消息处理函数
             this->on_message(buffer);
@@ -106,4 +135,31 @@ void SocketClient::join()
 {
     while (true) {
     }
-}
\ No newline at end of file
+}
+
+void SocketClient::set_metrics(std::shared_ptr<Metrics> metrics)
+{
+    this->metrics = metrics;
+    std::string labels = "server=\"" + std::string(address) + ":" +
+                         std::to_string(port) + "\"";
+    bytes_sent = metrics->add_series("socket_bytes_sent_total",
+                                     "Bytes written to the server.",
+                                     Metrics::COUNTER, labels);
+    bytes_received = metrics->add_series("socket_bytes_received_total",
+                                         "Bytes read from the server.",
+                                         Metrics::COUNTER, labels);
+    messages_sent = metrics->add_series("socket_messages_sent_total",
+                                        "Message buffers written to the server.",
+                                        Metrics::COUNTER, labels);
+    messages_received = metrics->add_series(
+        "socket_messages_received_total", "Message buffers read from the server.",
+        Metrics::COUNTER, labels);
+    send_errors = metrics->add_series("socket_send_errors_total",
+                                      "Failed writes to the server.",
+                                      Metrics::COUNTER, labels);
+}
+
+void SocketClient::set_recorder(std::shared_ptr<StreamRecorder> recorder)
+{
+    this->recorder = recorder;
+}
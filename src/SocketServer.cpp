@@ -1,4 +1,10 @@
+#include <cerrno>
+
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+
 #include "SocketServer.hpp"
+#include "Log.hpp"
 
 #include <PHOENIX/Utils/Info/Info.hpp>
 
@@ -52,15 +58,27 @@ void SocketServer::join()
 
 int SocketServer::send(int client, const char *message, int lenth)
 {
-    if (clients.find(client) == clients.end()) {
-        WARNING("Client " + std::to_string(client) + " not found.");
-        return -2;
+    int fd;
+    std::shared_ptr<std::mutex> mutex;
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        auto it = clients.find(client);
+        if (it == clients.end()) {
+            LOG_WARNING("Client {} not found.", client);
+            return -2;
+        }
+        fd = it->second;
+        mutex = write_mutexes[client];
     }
-    int ret = 0;
-    ret = write(clients[client], message, lenth);
+    int ret = write_all(fd, *mutex, message, lenth);
     if (ret < 0) {
-        ERROR("Failed to send message to Client" + std::to_string(client));
+        LOG_ERROR("Failed to send message to Client {}", client);
+        if (metrics != nullptr)
+            send_errors->add(client, 1);
         disconnect(client);
+    } else if (metrics != nullptr) {
+        bytes_sent->add(client, ret);
+        messages_sent->add(client, 1);
     }
     return ret;
 }
@@ -69,24 +87,53 @@ int SocketServer::broadcast(const char *message, int lenth)
 {
     int ret = 0;
     std::vector<std::thread> tt;
+    std::map<int, int> targets;
+    std::map<int, std::shared_ptr<std::mutex>> mutexes;
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        targets = clients;
+        mutexes = write_mutexes;
+    }
 
-    for (auto const &client : clients) {
-        tt.push_back(std::thread([this, client, message, lenth]() {
-            int ret = write(client.second, message, lenth);
+    for (auto const &client : targets) {
+        auto mutex = mutexes[client.first];
+        tt.push_back(std::thread([this, client, mutex, message, lenth]() {
+            int ret = write_all(client.second, *mutex, message, lenth);
             if (ret < 0) {
-                ERROR("Failed to send message to Client" +
-                      std::to_string(client.first));
+                LOG_ERROR("Failed to send message to Client {}",
+                          client.first);
+                if (metrics != nullptr)
+                    send_errors->add(client.first, 1);
                 disconnect(client.first);
+            } else if (metrics != nullptr) {
+                bytes_sent->add(client.first, ret);
+                messages_sent->add(client.first, 1);
             }
         }));
     }
     for (auto &t : tt) {
         t.join();
     }
-    ret = clients.size() == 0 ? -1 : 0;
+    ret = targets.size() == 0 ? -1 : 0;
     return ret;
 }
 
+int SocketServer::write_all(int fd, std::mutex &mutex, const char *message,
+                            int lenth)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    int sent = 0;
+    while (sent < lenth) {
+        int ret = write(fd, message + sent, lenth - sent);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+            return -1;
+        sent += ret;
+    }
+    return sent;
+}
+
 void SocketServer::set_on_message(
     std::function<void(int, const char *)> on_message)
 {
@@ -113,17 +160,24 @@ void SocketServer::accept()
         }
         // 查找可用的 client_id
         int client_id = 0;
-        while (clients.find(client_id) != clients.end()) {
-            client_id++;
+        {
+            std::lock_guard<std::mutex> lock(clients_mutex);
+            while (clients.find(client_id) != clients.end()) {
+                client_id++;
+            }
+            clients[client_id] = client_fd;
+            write_mutexes[client_id] = std::make_shared<std::mutex>();
         }
-        clients[client_id] = client_fd;
 
         if (this->on_connect != NULL) { // 调用连接处理函数
             this->on_connect(client_id);
         }
         // 创建并分离消息接收线程
         std::thread receive_thread(&SocketServer::receive, this, client_id);
-        receive_threads[client_id] = receive_thread.native_handle();
+        {
+            std::lock_guard<std::mutex> lock(clients_mutex);
+            receive_threads[client_id] = receive_thread.native_handle();
+        }
         receive_thread.detach();
         client_id++; //? 与上面代码重复, 冗余代码
     }
@@ -131,13 +185,25 @@ void SocketServer::accept()
 
 void SocketServer::receive(int client)
 {
-    int cli = clients[client];
+    int cli;
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        auto it = clients.find(client);
+        if (it == clients.end())
+            return; // 连接回调中已断开
+        cli = it->second;
+    }
 
     while (true) {
         char buffer[10240] = { 0 };
         int lenth = read(cli, buffer, 10240);
-        if (lenth <= 0 || std::string(buffer) == "/disconnect" ||
-            clients.find(client) == clients.end()) {
+        bool connected;
+        {
+            std::lock_guard<std::mutex> lock(clients_mutex);
+            auto it = clients.find(client);
+            connected = it != clients.end() && it->second == cli;
+        }
+        if (lenth <= 0 || std::string(buffer) == "/disconnect" || !connected) {
             disconnect(client);
             break;
         }
@@ -148,6 +214,10 @@ void SocketServer::receive(int client)
             }
             lenth += valread;
         }
+        if (metrics != nullptr) {
+            bytes_received->add(client, lenth);
+            messages_received->add(client, 1);
+        }
 
         if (this->on_message != NULL) { // 调用消息处理函数
             this->on_message(client, buffer);
@@ -157,8 +227,17 @@ void SocketServer::receive(int client)
 
 void SocketServer::disconnect(int client)
 {
-    close(clients[client]); // 关闭客户端连接
-    clients.erase(client); // 删除客户端
+    int fd;
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        auto it = clients.find(client);
+        if (it == clients.end())
+            return; // 已由其他线程断开
+        fd = it->second;
+        clients.erase(it); // 删除客户端
+        write_mutexes.erase(client);
+    }
+    close(fd); // 关闭客户端连接
 
     if (this->on_disconnect != NULL) { // 调用断开连接处理函数
         this->on_disconnect(client);
@@ -168,8 +247,73 @@ void SocketServer::disconnect(int client)
 std::string SocketServer::get_clients()
 {
     std::string clients_str = "";
+    std::lock_guard<std::mutex> lock(clients_mutex);
     for (auto const &client : clients) {
         clients_str += std::to_string(client.first) + " ";
     }
     return clients_str;
-}
\ No newline at end of file
+}
+
+std::vector<int> SocketServer::get_client_ids()
+{
+    std::vector<int> ids;
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    for (auto const &client : clients) {
+        ids.push_back(client.first);
+    }
+    return ids;
+}
+
+int SocketServer::get_send_queue(int client)
+{
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    auto it = clients.find(client);
+    if (it == clients.end()) {
+        return -1;
+    }
+    int queue = 0;
+    if (ioctl(it->second, SIOCOUTQ, &queue) < 0) {
+        return -1;
+    }
+    return queue;
+}
+
+void SocketServer::set_metrics(std::shared_ptr<Metrics> metrics)
+{
+    this->metrics = metrics;
+    std::string labels = "port=\"" + std::to_string(port) + "\"";
+    bytes_sent = metrics->add_family("socket_bytes_sent_total",
+                                     "Bytes written to each client.",
+                                     Metrics::COUNTER, labels, "client");
+    bytes_received = metrics->add_family("socket_bytes_received_total",
+                                         "Bytes read from each client.",
+                                         Metrics::COUNTER, labels, "client");
+    messages_sent = metrics->add_family(
+        "socket_messages_sent_total", "Message buffers written to each client.",
+        Metrics::COUNTER, labels, "client");
+    messages_received = metrics->add_family(
+        "socket_messages_received_total",
+        "Message buffers read from each client.", Metrics::COUNTER, labels,
+        "client");
+    send_errors = metrics->add_family(
+        "socket_send_errors_total",
+        "Failed writes, each one drops the client.", Metrics::COUNTER, labels,
+        "client");
+    metrics->add_callback(
+        "socket_send_queue_bytes", "Unacknowledged bytes in each send queue.",
+        Metrics::GAUGE, [this, labels]() {
+            Metrics::Samples samples;
+            for (int client : get_client_ids()) {
+                samples.push_back({ labels + ",client=\"" +
+                                        std::to_string(client) + "\"",
+                                    (double)get_send_queue(client) });
+            }
+            return samples;
+        });
+    metrics->add_callback("socket_clients", "Connected clients.",
+                          Metrics::GAUGE, [this, labels]() {
+                              return Metrics::Samples{
+                                  { labels, (double)get_client_ids().size() }
+                              };
+                          });
+}
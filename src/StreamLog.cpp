@@ -0,0 +1,225 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "StreamLog.hpp"
+
+#include <PHOENIX/Utils/Info/Info.hpp>
+
+namespace {
+/**
+ * @brief 一条记录占用的字节数, 按 8 字节对齐
+ *
+ */
+size_t record_size(unsigned int lenth)
+{
+    return (sizeof(StreamLog::RecordHeader) + lenth + 7) & ~(size_t)7;
+}
+} // namespace
+
+std::string StreamLog::segment_path(const std::string &prefix,
+                                    unsigned int index)
+{
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), ".%06u.log", index);
+    return prefix + buffer;
+}
+
+StreamRecorder::StreamRecorder(const std::string &prefix,
+                               size_t segment_size)
+    : prefix(prefix), segment_size(segment_size)
+{
+    // 至少容纳分段头、一条完整的应用层消息和结束标记
+    size_t minimum = sizeof(StreamLog::SegmentHeader) + record_size(10240) +
+                     sizeof(StreamLog::RecordHeader);
+    if (this->segment_size < minimum)
+        this->segment_size = minimum;
+    std::lock_guard<std::mutex> lock(mutex);
+    failed = !open_segment();
+}
+
+StreamRecorder::~StreamRecorder()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    close_segment();
+}
+
+bool StreamRecorder::open_segment()
+{
+    std::string path = StreamLog::segment_path(prefix, index);
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        ERROR("StreamRecorder: failed to create " + path);
+        return false;
+    }
+    // 预先分配磁盘空间, 写入映射区域时不会因磁盘已满收到 SIGBUS
+    if (posix_fallocate(fd, 0, segment_size) != 0 &&
+        ftruncate(fd, segment_size) == -1) {
+        ERROR("StreamRecorder: failed to allocate " + path);
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    void *p = mmap(nullptr, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd, 0);
+    if (p == MAP_FAILED) {
+        ERROR("StreamRecorder: failed to map " + path);
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    map = (char *)p;
+    madvise(map, segment_size, MADV_SEQUENTIAL);
+
+    StreamLog::SegmentHeader header;
+    header.Magic = StreamLog::MAGIC;
+    header.Version = StreamLog::VERSION;
+    header.Index = index;
+    header.Reserved = 0;
+    header.StartTime =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch())
+            .count();
+    memcpy(map, &header, sizeof(header));
+    used = sizeof(header);
+    DEBUG("StreamRecorder: recording to " + path);
+    return true;
+}
+
+void StreamRecorder::close_segment()
+{
+    if (map == nullptr)
+        return;
+    // 截断前写入结束标记, 截断失败时读取也能在此结束
+    memset(map + used, 0, sizeof(StreamLog::RecordHeader));
+    munmap(map, segment_size);
+    map = nullptr;
+    if (ftruncate(fd, used + sizeof(StreamLog::RecordHeader)) == -1)
+        WARNING("StreamRecorder: failed to truncate segment " +
+                std::to_string(index));
+    close(fd);
+    fd = -1;
+}
+
+bool StreamRecorder::append(int source, const char *data, unsigned int lenth)
+{
+    size_t size = record_size(lenth);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (failed)
+        return false;
+    // 保留一个记录头的空间作为结束标记
+    if (used + size + sizeof(StreamLog::RecordHeader) > segment_size) {
+        if (size + sizeof(StreamLog::SegmentHeader) +
+                sizeof(StreamLog::RecordHeader) >
+            segment_size)
+            return false; // 单条记录超过分段大小
+        close_segment();
+        index++;
+        if (!open_segment()) {
+            failed = true;
+            return false;
+        }
+    }
+
+    StreamLog::RecordHeader header;
+    header.Time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now().time_since_epoch())
+                      .count();
+    header.Source = source;
+    header.Lenth = lenth;
+    memcpy(map + used, &header, sizeof(header));
+    memcpy(map + used + sizeof(header), data, lenth);
+    used += size;
+    records.store(records.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+    bytes.store(bytes.load(std::memory_order_relaxed) + lenth,
+                std::memory_order_relaxed);
+    return true;
+}
+
+StreamReader::StreamReader(const std::string &prefix) : prefix(prefix)
+{
+    opened = open_segment(0);
+    if (!opened)
+        ERROR("StreamReader: failed to open " +
+              StreamLog::segment_path(prefix, 0));
+}
+
+StreamReader::~StreamReader()
+{
+    close_segment();
+}
+
+bool StreamReader::open_segment(unsigned int index)
+{
+    std::string path = StreamLog::segment_path(prefix, index);
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) == -1 ||
+        (size_t)st.st_size < sizeof(StreamLog::SegmentHeader)) {
+        close(fd);
+        return false;
+    }
+    void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return false;
+    StreamLog::SegmentHeader header;
+    memcpy(&header, p, sizeof(header));
+    if (header.Magic != StreamLog::MAGIC ||
+        header.Version != StreamLog::VERSION) {
+        WARNING("StreamReader: " + path + " is not a stream log.");
+        munmap(p, st.st_size);
+        return false;
+    }
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+    map = (const char *)p;
+    size = st.st_size;
+    offset = sizeof(header);
+    this->index = index;
+    return true;
+}
+
+void StreamReader::close_segment()
+{
+    if (map == nullptr)
+        return;
+    munmap((void *)map, size);
+    map = nullptr;
+}
+
+bool StreamReader::next(Record &record)
+{
+    while (map != nullptr) {
+        StreamLog::RecordHeader header;
+        if (offset + sizeof(header) <= size) {
+            memcpy(&header, map + offset, sizeof(header));
+            if (header.Lenth != 0 &&
+                offset + sizeof(header) + header.Lenth <= size) {
+                record.time = header.Time;
+                record.source = header.Source;
+                record.lenth = header.Lenth;
+                record.data = map + offset + sizeof(header);
+                offset += record_size(header.Lenth);
+                return true;
+            }
+        }
+        // 当前分段已读完, 继续下一个分段
+        close_segment();
+        open_segment(index + 1);
+    }
+    return false;
+}
+
+void StreamReader::rewind()
+{
+    close_segment();
+    open_segment(0);
+}
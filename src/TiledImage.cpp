@@ -0,0 +1,138 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include "TiledImage.hpp"
+
+bool TiledImage::encode(const cv::Mat &img, unsigned int tile_rows,
+                        unsigned int tile_cols, int quality,
+                        std::vector<unsigned char> &data)
+{
+    if (img.empty() || tile_rows == 0 || tile_cols == 0 ||
+        (img.channels() != 1 && img.channels() != 3))
+        return false;
+    // 分块不小于 8x8 (jpg 最小编码单元)
+    tile_rows = std::max(1u, std::min<unsigned int>(
+                                 std::min(tile_rows, MAX_TILES), img.rows / 8));
+    tile_cols = std::max(1u, std::min<unsigned int>(
+                                 std::min(tile_cols, MAX_TILES), img.cols / 8));
+
+    unsigned int count = tile_rows * tile_cols;
+    std::vector<Message::ImageTileHeader> tiles(count);
+    std::vector<std::vector<unsigned char>> encoded(count);
+    for (unsigned int r = 0; r < tile_rows; r++) {
+        for (unsigned int c = 0; c < tile_cols; c++) {
+            auto &tile = tiles[r * tile_cols + c];
+            tile.X = img.cols * c / tile_cols;
+            tile.Y = img.rows * r / tile_rows;
+            tile.Width = img.cols * (c + 1) / tile_cols - tile.X;
+            tile.Height = img.rows * (r + 1) / tile_rows - tile.Y;
+        }
+    }
+
+    std::vector<int> params;
+    if (quality >= 0)
+        params = { cv::IMWRITE_JPEG_QUALITY, quality };
+    std::atomic<bool> ok(true);
+    cv::parallel_for_(cv::Range(0, count), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; i++) {
+            cv::Rect rect(tiles[i].X, tiles[i].Y, tiles[i].Width,
+                          tiles[i].Height);
+            if (!cv::imencode(".jpg", img(rect), encoded[i], params))
+                ok = false;
+        }
+    });
+    if (!ok)
+        return false;
+
+    // 头部 + 分块表 + 各分块数据
+    size_t offset = sizeof(Message::TiledImageHeader) +
+                    count * sizeof(Message::ImageTileHeader);
+    size_t total = offset;
+    for (auto &e : encoded) {
+        total += e.size();
+    }
+    data.resize(total);
+
+    Message::TiledImageHeader header;
+    header.Magic = Message::TILED_IMAGE_MAGIC;
+    header.Rows = img.rows;
+    header.Cols = img.cols;
+    header.Channels = img.channels();
+    header.TileCount = count;
+    memcpy(data.data(), &header, sizeof(header));
+
+    for (unsigned int i = 0; i < count; i++) {
+        tiles[i].Offset = offset;
+        tiles[i].Lenth = encoded[i].size();
+        memcpy(data.data() + offset, encoded[i].data(), encoded[i].size());
+        offset += encoded[i].size();
+    }
+    memcpy(data.data() + sizeof(header), tiles.data(),
+           count * sizeof(Message::ImageTileHeader));
+    return true;
+}
+
+bool TiledImage::is_tiled(const unsigned char *data, unsigned int lenth)
+{
+    if (lenth < sizeof(Message::TiledImageHeader))
+        return false;
+    return ((const Message::TiledImageHeader *)data)->Magic ==
+           Message::TILED_IMAGE_MAGIC;
+}
+
+bool TiledImage::decode(const unsigned char *data, unsigned int lenth,
+                        cv::Mat &dst)
+{
+    if (!is_tiled(data, lenth))
+        return false;
+    auto header = (const Message::TiledImageHeader *)data;
+    if (header->Channels != 1 && header->Channels != 3)
+        return false;
+    // 数据区来自网络, 限制图像尺寸和分块数, 避免按伪造的头部分配过大的图像
+    if (header->Rows == 0 || header->Cols == 0 ||
+        header->Rows > MAX_SIDE || header->Cols > MAX_SIDE ||
+        header->TileCount == 0 || header->TileCount > MAX_TILES * MAX_TILES)
+        return false;
+    if (sizeof(Message::TiledImageHeader) +
+            (size_t)header->TileCount * sizeof(Message::ImageTileHeader) >
+        lenth)
+        return false;
+    auto tiles = (const Message::ImageTileHeader *)(data + sizeof(*header));
+    // 先校验所有分块, 避免解码线程越界访问; 先比较再相减, 无符号加法不会回绕
+    for (unsigned int i = 0; i < header->TileCount; i++) {
+        if (tiles[i].Offset > lenth || tiles[i].Lenth > lenth - tiles[i].Offset ||
+            tiles[i].Width == 0 || tiles[i].Height == 0 ||
+            tiles[i].Width > header->Cols ||
+            tiles[i].X > header->Cols - tiles[i].Width ||
+            tiles[i].Height > header->Rows ||
+            tiles[i].Y > header->Rows - tiles[i].Height)
+            return false;
+    }
+
+    int type = header->Channels == 3 ? CV_8UC3 : CV_8UC1;
+    int flags =
+        header->Channels == 3 ? cv::IMREAD_COLOR : cv::IMREAD_GRAYSCALE;
+    dst.create(header->Rows, header->Cols, type); // 尺寸不变时不重新分配
+
+    std::atomic<bool> ok(true);
+    cv::parallel_for_(
+        cv::Range(0, header->TileCount), [&](const cv::Range &range) {
+            for (int i = range.start; i < range.end; i++) {
+                cv::Rect rect(tiles[i].X, tiles[i].Y, tiles[i].Width,
+                              tiles[i].Height);
+                cv::Mat buf(1, tiles[i].Lenth, CV_8U,
+                            (void *)(data + tiles[i].Offset));
+                cv::Mat roi = dst(rect);
+                // 直接解码到 dst 对应区域, 尺寸不符时 roi 会被重新分配
+                cv::Mat out = cv::imdecode(buf, flags, &roi);
+                if (out.empty() || out.size() != rect.size()) {
+                    ok = false;
+                    continue;
+                }
+                if (out.data != dst(rect).data)
+                    out.copyTo(dst(rect));
+            }
+        });
+    return ok;
+}
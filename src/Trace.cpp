@@ -0,0 +1,138 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "Trace.hpp"
+
+namespace {
+std::mutex rings_mutex; ///< 保护 rings 和 free_rings
+std::vector<void *> rings; ///< 所有缓冲区, 不释放
+std::vector<void *> free_rings; ///< 持有线程已退出的缓冲区
+
+/**
+ * @brief 线程退出时把缓冲区放回空闲列表
+ *
+ */
+struct LocalRing {
+    void *ring = nullptr;
+
+    ~LocalRing()
+    {
+        if (ring == nullptr)
+            return;
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        free_rings.push_back(ring);
+    }
+};
+
+thread_local LocalRing local_ring;
+} // namespace
+
+long long Trace::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+Trace::Ring *Trace::local()
+{
+    if (local_ring.ring != nullptr)
+        return (Ring *)local_ring.ring;
+    Ring *ring = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        if (!free_rings.empty()) {
+            ring = (Ring *)free_rings.back();
+            free_rings.pop_back();
+        } else {
+            ring = new Ring();
+            rings.push_back(ring);
+        }
+    }
+    ring->tid = (int)syscall(SYS_gettid);
+    local_ring.ring = ring;
+    return ring;
+}
+
+void Trace::record(const char *name, unsigned int id, long long begin,
+                   long long end)
+{
+    Ring *ring = local();
+    unsigned long head = ring->head.load(std::memory_order_relaxed);
+    Event &event = ring->events[head % CAPACITY];
+    event.name.store(name, std::memory_order_relaxed);
+    event.id.store(id, std::memory_order_relaxed);
+    event.tid.store(ring->tid, std::memory_order_relaxed);
+    event.begin.store(begin, std::memory_order_relaxed);
+    event.end.store(end, std::memory_order_relaxed);
+    // 发布后导出线程才会读取该区间
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+int Trace::dump(const std::string &path)
+{
+    std::vector<Ring *> all;
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        for (void *ring : rings) {
+            all.push_back((Ring *)ring);
+        }
+    }
+
+    FILE *file = fopen(path.c_str(), "w");
+    if (file == nullptr)
+        return -1;
+    int pid = getpid();
+    std::string process = "process";
+    std::ifstream comm("/proc/self/comm");
+    std::getline(comm, process);
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    fprintf(file,
+            "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,"
+            "\"args\":{\"name\":\"%s\"}}",
+            pid, process.c_str());
+    int count = 0;
+    for (Ring *ring : all) {
+        // 复制后再检查 head, 复制期间被覆盖或正在写入的区间丢弃
+        unsigned long end = ring->head.load(std::memory_order_acquire);
+        unsigned long begin = end > CAPACITY ? end - CAPACITY : 0;
+        std::vector<std::tuple<const char *, unsigned int, int, long long,
+                               long long>>
+            events;
+        for (unsigned long i = begin; i < end; i++) {
+            Event &e = ring->events[i % CAPACITY];
+            events.emplace_back(e.name.load(std::memory_order_relaxed),
+                                e.id.load(std::memory_order_relaxed),
+                                e.tid.load(std::memory_order_relaxed),
+                                e.begin.load(std::memory_order_relaxed),
+                                e.end.load(std::memory_order_relaxed));
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        unsigned long after = ring->head.load(std::memory_order_relaxed);
+        unsigned long valid = after >= CAPACITY ? after - CAPACITY + 1 : 0;
+        for (unsigned long i = std::max(begin, valid); i < end; i++) {
+            auto &e = events[i - begin];
+            fprintf(file,
+                    ",\n{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"X\","
+                    "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,"
+                    "\"args\":{\"id\":%u}}",
+                    std::get<0>(e), std::get<3>(e) / 1e3,
+                    (std::get<4>(e) - std::get<3>(e)) / 1e3, pid,
+                    std::get<2>(e), std::get<1>(e));
+            count++;
+        }
+    }
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    if (fclose(file) != 0)
+        return -1;
+    return count;
+}
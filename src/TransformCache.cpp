@@ -0,0 +1,100 @@
+#include <cstring>
+
+#include "TransformCache.hpp"
+
+TransformCache::TransformCache()
+{
+    for (auto &entry : entries) {
+        entry.from[0] = '\0';
+        entry.to[0] = '\0';
+        entry.seq.store(0, std::memory_order_relaxed);
+        entry.stamp.store(0, std::memory_order_relaxed);
+    }
+}
+
+int TransformCache::add(const std::string &from, const std::string &to)
+{
+    if (count >= MAX_ENTRIES)
+        return -1;
+    Entry &entry = entries[count];
+    strncpy(entry.from, from.c_str(), sizeof(entry.from) - 1);
+    entry.from[sizeof(entry.from) - 1] = '\0';
+    strncpy(entry.to, to.c_str(), sizeof(entry.to) - 1);
+    entry.to[sizeof(entry.to) - 1] = '\0';
+    return count++;
+}
+
+unsigned int TransformCache::get_id(int index)
+{
+    return ID_BASE + index;
+}
+
+Message::TransformSubscribeData
+TransformCache::subscription(int index, unsigned int policy,
+                             double rate) const
+{
+    Message::TransformSubscribeData data;
+    memset(&data, 0, sizeof(data));
+    memcpy(data.From, entries[index].from, sizeof(data.From));
+    memcpy(data.To, entries[index].to, sizeof(data.To));
+    data.Policy = policy;
+    data.Rate = rate;
+    return data;
+}
+
+bool TransformCache::update(unsigned int id,
+                            const Message::TransformData &data)
+{
+    if (id < ID_BASE || id - ID_BASE >= (unsigned int)count)
+        return false;
+    Entry &entry = entries[id - ID_BASE];
+
+    unsigned int seq = entry.seq.load(std::memory_order_relaxed);
+    // 序号变为奇数, 读者看到后会重读
+    entry.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int i = 0; i < 3; i++) {
+        entry.values[i].store(data.Translation[i], std::memory_order_relaxed);
+    }
+    for (int i = 0; i < 4; i++) {
+        entry.values[3 + i].store(data.Rotation[i], std::memory_order_relaxed);
+    }
+    entry.stamp.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now().time_since_epoch())
+                          .count(),
+                      std::memory_order_relaxed);
+    entry.seq.store(seq + 2, std::memory_order_release);
+    return true;
+}
+
+bool TransformCache::get(int index, Message::TransformData &data,
+                         std::chrono::steady_clock::time_point *stamp) const
+{
+    if (index < 0 || index >= count)
+        return false;
+    const Entry &entry = entries[index];
+
+    while (true) {
+        unsigned int begin = entry.seq.load(std::memory_order_acquire);
+        if (begin == 0)
+            return false; // 尚未收到推送
+        if (begin & 1)
+            continue; // 正在写入
+        for (int i = 0; i < 3; i++) {
+            data.Translation[i] =
+                entry.values[i].load(std::memory_order_relaxed);
+        }
+        for (int i = 0; i < 4; i++) {
+            data.Rotation[i] =
+                entry.values[3 + i].load(std::memory_order_relaxed);
+        }
+        long long ns = entry.stamp.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (entry.seq.load(std::memory_order_relaxed) == begin) {
+            if (stamp != nullptr)
+                *stamp = std::chrono::steady_clock::time_point(
+                    std::chrono::nanoseconds(ns));
+            return true;
+        }
+    }
+}
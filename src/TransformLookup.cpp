@@ -0,0 +1,634 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <queue>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <eigen3/Eigen/Eigen>
+#include <eigen3/Eigen/Geometry>
+
+#include <boost/json.hpp>
+#include <boost/json/src.hpp>
+
+#include "TransformLookup.hpp"
+
+#include <PHOENIX/Utils/Info/Info.hpp>
+
+TransformLookup::TransformLookup(bool cache_enabled, int history)
+    : hits(0), misses(0), reloads(0), last_structural(0), stopped(false)
+{
+    this->cache_enabled = cache_enabled;
+    history_size = history < 2 ? 2 : history;
+    std::atomic_store(&snapshot, std::shared_ptr<const Snapshot>(
+                                     std::make_shared<Snapshot>()));
+}
+
+TransformLookup::~TransformLookup()
+{
+    unwatch();
+}
+
+bool TransformLookup::parse(const std::string &path,
+                            std::vector<Definition> &defs)
+{
+    std::ifstream ifs(path);
+    if (!ifs.is_open()) {
+        ERROR("Failed to open " + path);
+        return false;
+    }
+    std::string jsonstr((std::istreambuf_iterator<char>(ifs)),
+                        std::istreambuf_iterator<char>());
+    try {
+        boost::json::value jv = boost::json::parse(jsonstr);
+        boost::json::object jo = jv.as_object();
+        auto transforms = jo.at("transform").as_array();
+        for (auto &tf : transforms) {
+            auto from = tf.at("from").as_string().c_str();
+            auto to = tf.at("to").as_string().c_str();
+            auto translation = tf.at("translation").as_array();
+            auto rotation = tf.at("rotation").as_array();
+            PHOENIX::Transform transform(
+                Eigen::Vector3d(translation.at(0).as_double(),
+                                translation.at(1).as_double(),
+                                translation.at(2).as_double()),
+                Eigen::Vector3d(rotation.at(2).as_double(),
+                                rotation.at(1).as_double(),
+                                rotation.at(0).as_double()));
+            defs.emplace_back(
+                from, to, Pose{ transform.translation, transform.rotation });
+        }
+    } catch (std::exception &e) {
+        ERROR("Failed to parse " + path + ": " + e.what());
+        return false;
+    }
+    return true;
+}
+
+bool TransformLookup::load(const std::string &path)
+{
+    std::vector<Definition> defs;
+    if (!parse(path, defs))
+        return false;
+    return apply(defs, true) >= 0;
+}
+
+bool TransformLookup::watch(const std::string &path, ReloadFunction on_reload)
+{
+    if (watcher.joinable())
+        return false;
+    // 监视所在目录而不是文件本身, 编辑器保存时常常先写临时文件再重命名覆盖
+    auto slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : path.substr(0, slash);
+    inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (inotify_fd < 0 ||
+        inotify_add_watch(inotify_fd, dir.c_str(),
+                          IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        ERROR("Failed to watch " + path);
+        return false;
+    }
+    stopped = false;
+    watcher = std::thread(&TransformLookup::monitor, this, path, on_reload);
+    return true;
+}
+
+void TransformLookup::unwatch()
+{
+    stopped = true;
+    if (watcher.joinable())
+        watcher.join();
+    if (inotify_fd >= 0)
+        close(inotify_fd);
+    inotify_fd = -1;
+}
+
+void TransformLookup::monitor(std::string path, ReloadFunction on_reload)
+{
+    auto slash = path.rfind('/');
+    std::string file =
+        slash == std::string::npos ? path : path.substr(slash + 1);
+    alignas(struct inotify_event) char buffer[4096];
+
+    while (!stopped) {
+        struct pollfd pfd = { inotify_fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 200) <= 0)
+            continue; // 超时后检查是否停止
+        ssize_t len = read(inotify_fd, buffer, sizeof(buffer));
+        if (len <= 0)
+            continue;
+
+        bool modified = false;
+        for (char *p = buffer; p < buffer + len;) {
+            auto event = (struct inotify_event *)p;
+            if (event->len > 0 && file == event->name)
+                modified = true;
+            p += sizeof(struct inotify_event) + event->len;
+        }
+        if (!modified)
+            continue;
+
+        // 解析失败时保留旧快照
+        std::vector<Definition> defs;
+        if (!parse(path, defs))
+            continue;
+        int changed = apply(defs, true);
+        if (changed < 0)
+            continue;
+        reloads++;
+        INFO("Reloaded " + path + ", " + std::to_string(changed) +
+             " edge(s) changed");
+        if (changed > 0 && on_reload)
+            on_reload(changed);
+    }
+}
+
+void TransformLookup::set_transform(const std::string &from,
+                                    const std::string &to,
+                                    const PHOENIX::Transform &tf)
+{
+    apply({ Definition(from, to, Pose{ tf.translation, tf.rotation }) },
+          false);
+}
+
+bool TransformLookup::publish(std::string_view from, std::string_view to,
+                              const Message::TransformData &data,
+                              long long stamp)
+{
+    Pose pose{ Eigen::Vector3d(data.Translation[0], data.Translation[1],
+                               data.Translation[2]),
+               Eigen::Quaterniond(data.Rotation[3], data.Rotation[0],
+                                  data.Rotation[1], data.Rotation[2]) };
+    auto find_edge = [&](const Snapshot &snap, int a, int b) {
+        if (a < 0 || b < 0)
+            return -1;
+        for (auto &adj : snap.adjacency[a]) {
+            if (adj.first == b)
+                return adj.second;
+        }
+        return -1;
+    };
+    auto snap = std::atomic_load(&snapshot);
+    int a = find(from);
+    int b = find(to);
+    if (a < 0 || b < 0) {
+        WARNING("Transform publish to unknown frame " + std::string(from) +
+                " -> " + std::string(to) + " ignored");
+        return false;
+    }
+    int edge = find_edge(*snap, a, b);
+    if (edge < 0) {
+        // 新的边会重建整个快照, 限制其频率
+        long long now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now().time_since_epoch())
+                            .count();
+        long long last = last_structural.load(std::memory_order_relaxed);
+        if (now - last < STRUCTURAL_INTERVAL_MS * 1000000LL ||
+            !last_structural.compare_exchange_strong(last, now))
+            return false;
+        // 新的边先以该采样作为静态值加入快照
+        if (apply({ Definition(std::string(from), std::string(to), pose) },
+                  false) < 0)
+            return false;
+        snap = std::atomic_load(&snapshot);
+        a = find(from);
+        b = find(to);
+        edge = find_edge(*snap, a, b);
+        if (edge < 0)
+            return false;
+    }
+    auto const &e = snap->edges[edge];
+    if (e.a != a) { // 采样方向与边相反
+        pose.rotation = pose.rotation.inverse();
+        pose.translation = -(pose.rotation * pose.translation);
+    }
+
+    History &h = *e.history;
+    std::lock_guard<std::mutex> lock(h.writer);
+    size_t head = h.head.load(std::memory_order_relaxed);
+    size_t count = h.count.load(std::memory_order_relaxed);
+    if (count > 0 &&
+        stamp < h.slots[(head + count - 1) % h.capacity].stamp.load(
+                    std::memory_order_relaxed))
+        return false; // 乱序的旧数据
+
+    unsigned long seq = h.seq.load(std::memory_order_relaxed);
+    // 序号变为奇数, 查询看到后会重读
+    h.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    Slot &slot = h.slots[(head + count) % h.capacity];
+    if (count < h.capacity) {
+        h.count.store(count + 1, std::memory_order_relaxed);
+    } else { // 覆盖最早的采样
+        h.head.store((head + 1) % h.capacity, std::memory_order_relaxed);
+    }
+    slot.stamp.store(stamp, std::memory_order_relaxed);
+    for (int i = 0; i < 3; i++) {
+        slot.values[i].store(pose.translation[i], std::memory_order_relaxed);
+    }
+    for (int i = 0; i < 4; i++) {
+        slot.values[3 + i].store(pose.rotation.coeffs()[i],
+                                 std::memory_order_relaxed);
+    }
+    h.seq.store(seq + 2, std::memory_order_release);
+    return true;
+}
+
+std::shared_ptr<TransformLookup::History> TransformLookup::make_history()
+{
+    auto history = std::make_shared<History>();
+    history->slots.reset(new Slot[history_size]);
+    history->capacity = history_size;
+    return history;
+}
+
+int TransformLookup::apply(const std::vector<Definition> &defs, bool replace)
+{
+    std::lock_guard<std::mutex> lock(writer);
+    auto old = std::atomic_load(&snapshot);
+
+    // 复制旧快照的名称和边, 保持坐标系 ID 和边下标不变
+    auto snap = std::make_shared<Snapshot>();
+    snap->names = old->names;
+    snap->edges = old->edges;
+    for (size_t i = 0; i < snap->names.size(); i++) {
+        snap->ids[snap->names[i]] = i;
+    }
+    auto intern = [&](const std::string &name) {
+        auto it = snap->ids.find(name);
+        if (it != snap->ids.end())
+            return it->second;
+        snap->names.push_back(name);
+        int id = snap->names.size() - 1;
+        snap->ids[snap->names.back()] = id;
+        return id;
+    };
+
+    int changed = 0;
+    std::vector<bool> seen(snap->edges.size(), false);
+    for (auto const &def : defs) {
+        int a = intern(std::get<0>(def));
+        int b = intern(std::get<1>(def));
+        auto const &pose = std::get<2>(def);
+
+        int edge = -1;
+        for (size_t i = 0; i < snap->edges.size(); i++) {
+            auto const &e = snap->edges[i];
+            if ((e.a == a && e.b == b) || (e.a == b && e.b == a))
+                edge = i;
+        }
+        if (edge < 0) {
+            snap->edges.push_back(Edge{ a, b, 1, false, pose, make_history() });
+            seen.push_back(true);
+            changed++;
+            continue;
+        }
+        seen[edge] = true;
+        Edge &e = snap->edges[edge];
+        if (!e.removed && e.a == a && e.b == b &&
+            e.pose.translation == pose.translation &&
+            e.pose.rotation.coeffs() == pose.rotation.coeffs())
+            continue;
+        // 版本号变化使经过这条边的缓存失效, 其他缓存不受影响
+        if (e.a != a) // 方向改变后历史采样不再适用
+            e.history = make_history();
+        e = Edge{ a, b, e.version + 1, false, pose, e.history };
+        changed++;
+    }
+    if (replace) {
+        for (size_t i = 0; i < snap->edges.size(); i++) {
+            if (!seen[i] && !snap->edges[i].removed) {
+                snap->edges[i].removed = true;
+                snap->edges[i].version++;
+                changed++;
+            }
+        }
+    }
+    if (changed == 0 && snap->names.size() == old->names.size())
+        return 0;
+
+    snap->adjacency.resize(snap->names.size());
+    snap->parent.assign(snap->names.size(), -1);
+    for (size_t i = 0; i < snap->edges.size(); i++) {
+        auto const &e = snap->edges[i];
+        if (e.removed)
+            continue;
+        if (snap->parent[e.b] >= 0) {
+            WARNING("Frame " + snap->names[e.b] +
+                    " would have two parents, transform update ignored");
+            return -1;
+        }
+        snap->adjacency[e.a].push_back({ e.b, (int)i });
+        snap->adjacency[e.b].push_back({ e.a, (int)i });
+        snap->parent[e.b] = i;
+    }
+    // 每个坐标系最多一个父坐标系时, 沿父坐标系走 names.size() 步仍未到根说明存在环
+    for (size_t i = 0; i < snap->names.size(); i++) {
+        int node = i;
+        size_t steps = 0;
+        while (snap->parent[node] >= 0 && steps++ < snap->names.size()) {
+            node = snap->edges[snap->parent[node]].a;
+        }
+        if (snap->parent[node] >= 0) {
+            WARNING("Transform update would create a cycle through " +
+                    snap->names[i] + ", ignored");
+            return -1;
+        }
+    }
+    std::atomic_store(&snapshot, std::shared_ptr<const Snapshot>(snap));
+    return changed;
+}
+
+int TransformLookup::find(std::string_view name)
+{
+    auto snap = std::atomic_load(&snapshot);
+    auto it = snap->ids.find(name);
+    return it == snap->ids.end() ? -1 : it->second;
+}
+
+bool TransformLookup::find_path(const Snapshot &snap, int from, int to,
+                                std::vector<int> &path)
+{
+    path.clear();
+    if (from == to)
+        return true;
+    // 广度优先搜索, 记录到达每个坐标系经过的边
+    std::vector<int> via(snap.names.size(), -1);
+    std::vector<int> prev(snap.names.size(), -1);
+    std::queue<int> q;
+    q.push(from);
+    prev[from] = from;
+    while (!q.empty()) {
+        int node = q.front();
+        q.pop();
+        if (node == to)
+            break;
+        for (auto &adj : snap.adjacency[node]) {
+            if (prev[adj.first] >= 0)
+                continue;
+            prev[adj.first] = node;
+            via[adj.first] = adj.second;
+            q.push(adj.first);
+        }
+    }
+    if (prev[to] < 0)
+        return false;
+    for (int node = to; node != from; node = prev[node]) {
+        path.push_back(via[node]);
+    }
+    std::reverse(path.begin(), path.end());
+    return true;
+}
+
+unsigned long TransformLookup::get_version(const Edge &edge)
+{
+    // 两个计数都只增不减, 和变化即说明其中之一变化
+    return edge.version + edge.history->seq.load(std::memory_order_acquire);
+}
+
+bool TransformLookup::valid(const Snapshot &snap, const CacheEntry &entry)
+{
+    for (size_t i = 0; i < entry.edges.size(); i++) {
+        if (get_version(snap.edges[entry.edges[i]]) != entry.versions[i])
+            return false;
+    }
+    return true;
+}
+
+bool TransformLookup::sample(const Edge &edge, long long stamp, Pose &pose)
+{
+    const History &h = *edge.history;
+    auto read = [&](size_t head, size_t i, Pose &out) {
+        const Slot &slot = h.slots[(head + i) % h.capacity];
+        for (int k = 0; k < 3; k++) {
+            out.translation[k] = slot.values[k].load(std::memory_order_relaxed);
+        }
+        for (int k = 0; k < 4; k++) {
+            out.rotation.coeffs()[k] =
+                slot.values[3 + k].load(std::memory_order_relaxed);
+        }
+    };
+    auto stamp_at = [&](size_t head, size_t i) {
+        return h.slots[(head + i) % h.capacity].stamp.load(
+            std::memory_order_relaxed);
+    };
+
+    while (true) {
+        unsigned long begin = h.seq.load(std::memory_order_acquire);
+        if (begin & 1)
+            continue; // 正在写入
+        size_t head = h.head.load(std::memory_order_relaxed);
+        size_t count = h.count.load(std::memory_order_relaxed);
+        bool found = true;
+        if (count == 0) { // 没有采样, 使用静态值
+            pose = edge.pose;
+        } else if (stamp == 0 || stamp >= stamp_at(head, count - 1)) {
+            read(head, count - 1, pose);
+        } else if (stamp < stamp_at(head, 0)) {
+            found = false; // 已经不在历史范围内
+        } else {
+            // 二分查找第一个晚于 stamp 的采样
+            size_t lo = 1, hi = count - 1;
+            while (lo < hi) {
+                size_t mid = (lo + hi) / 2;
+                if (stamp_at(head, mid) > stamp)
+                    hi = mid;
+                else
+                    lo = mid + 1;
+            }
+            long long t0 = stamp_at(head, lo - 1);
+            long long t1 = stamp_at(head, lo);
+            Pose p0, p1;
+            read(head, lo - 1, p0);
+            read(head, lo, p1);
+            double ratio = t1 == t0 ? 0 : (double)(stamp - t0) / (t1 - t0);
+            pose.translation =
+                p0.translation + ratio * (p1.translation - p0.translation);
+            pose.rotation = p0.rotation.slerp(ratio, p1.rotation);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (h.seq.load(std::memory_order_relaxed) == begin)
+            return found;
+    }
+}
+
+bool TransformLookup::compose(const Snapshot &snap, int from,
+                              const std::vector<int> &path, long long stamp,
+                              Message::TransformData &data)
+{
+    // result 把 from 坐标系中的点变换到当前坐标系 node
+    Pose result{ Eigen::Vector3d::Zero(), Eigen::Quaterniond::Identity() };
+    int node = from;
+    for (int i : path) {
+        auto const &e = snap.edges[i];
+        Pose pose;
+        if (!sample(e, stamp, pose))
+            return false;
+        if (e.a == node) { // 从父坐标系走向子坐标系, 使用逆变换
+            pose.rotation = pose.rotation.inverse();
+            pose.translation = -(pose.rotation * pose.translation);
+            node = e.b;
+        } else {
+            node = e.a;
+        }
+        result.translation = pose.rotation * result.translation + pose.translation;
+        result.rotation = pose.rotation * result.rotation;
+    }
+    data = to_data(result);
+    return true;
+}
+
+Message::TransformData TransformLookup::to_data(const Pose &pose)
+{
+    Eigen::Quaterniond rotation = pose.rotation.normalized();
+    return Message::TransformData{ { pose.translation.x(),
+                                     pose.translation.y(),
+                                     pose.translation.z() },
+                                   { rotation.x(), rotation.y(), rotation.z(),
+                                     rotation.w() } };
+}
+
+bool TransformLookup::lookup(int from, int to, Message::TransformData &data)
+{
+    // 整个查询使用同一个快照, 重新加载只替换指针, 不阻塞查询
+    auto snap = std::atomic_load(&snapshot);
+    if (from < 0 || to < 0 || from >= (int)snap->names.size() ||
+        to >= (int)snap->names.size())
+        return false;
+    unsigned long long key = ((unsigned long long)from << 32) | (unsigned)to;
+
+    if (cache_enabled) {
+        std::shared_lock<std::shared_mutex> lock(cache_mutex);
+        auto it = cache.find(key);
+        if (it != cache.end() && valid(*snap, it->second)) {
+            data = it->second.data;
+            hits++;
+            return true;
+        }
+    }
+    misses++;
+
+    CacheEntry entry;
+    if (!find_path(*snap, from, to, entry.edges))
+        return false;
+    // 先记录版本号再计算, 计算期间加入的采样会使该条目在下次查询时失效
+    for (int edge : entry.edges) {
+        entry.versions.push_back(get_version(snap->edges[edge]));
+    }
+    if (!compose(*snap, from, entry.edges, 0, entry.data))
+        return false;
+    data = entry.data;
+    if (cache_enabled) {
+        std::unique_lock<std::shared_mutex> lock(cache_mutex);
+        cache[key] = entry;
+    }
+    return true;
+}
+
+bool TransformLookup::lookup(std::string_view from, std::string_view to,
+                             Message::TransformData &data)
+{
+    return lookup(find(from), find(to), data);
+}
+
+bool TransformLookup::lookup(int from, int to, long long stamp,
+                             Message::TransformData &data)
+{
+    // 指定时刻的查询不经过缓存
+    auto snap = std::atomic_load(&snapshot);
+    if (from < 0 || to < 0 || from >= (int)snap->names.size() ||
+        to >= (int)snap->names.size())
+        return false;
+    std::vector<int> path;
+    if (!find_path(*snap, from, to, path))
+        return false;
+    return compose(*snap, from, path, stamp, data);
+}
+
+bool TransformLookup::lookup(std::string_view from, std::string_view to,
+                             long long stamp, Message::TransformData &data)
+{
+    return lookup(find(from), find(to), stamp, data);
+}
+
+int TransformLookup::lookup(const std::vector<std::pair<int, int>> &pairs,
+                            long long stamp,
+                            Message::TransformBatchResult *results)
+{
+    auto snap = std::atomic_load(&snapshot);
+    int frames = snap->names.size();
+    // 每个坐标系到根坐标系的位姿, 本次批量查询内只计算一次
+    enum { UNKNOWN, RESOLVED, FAILED };
+    std::vector<char> state(frames, UNKNOWN);
+    std::vector<int> root(frames);
+    std::vector<Pose> poses(frames);
+
+    auto resolve = [&](int frame) {
+        // 向上找到已计算的祖先或根坐标系, 再沿途向下计算
+        std::vector<int> chain;
+        int node = frame;
+        while (state[node] == UNKNOWN && snap->parent[node] >= 0 &&
+               (int)chain.size() < frames) {
+            chain.push_back(node);
+            node = snap->edges[snap->parent[node]].a;
+        }
+        if (state[node] == UNKNOWN) {
+            if (snap->parent[node] >= 0) { // 存在环
+                state[node] = FAILED;
+            } else {
+                state[node] = RESOLVED;
+                root[node] = node;
+                poses[node] = Pose{ Eigen::Vector3d::Zero(),
+                                    Eigen::Quaterniond::Identity() };
+            }
+        }
+        for (auto it = chain.rbegin(); it != chain.rend(); it++) {
+            int child = *it;
+            int parent = snap->edges[snap->parent[child]].a;
+            Pose edge;
+            if (state[parent] == FAILED ||
+                !sample(snap->edges[snap->parent[child]], stamp, edge)) {
+                state[child] = FAILED;
+                continue;
+            }
+            const Pose &p = poses[parent];
+            poses[child] =
+                Pose{ p.rotation * edge.translation + p.translation,
+                      p.rotation * edge.rotation };
+            root[child] = root[parent];
+            state[child] = RESOLVED;
+        }
+        return state[frame] == RESOLVED;
+    };
+
+    int found = 0;
+    for (size_t i = 0; i < pairs.size(); i++) {
+        int from = pairs[i].first, to = pairs[i].second;
+        results[i].Valid = 0;
+        if (from < 0 || to < 0 || from >= frames || to >= frames)
+            continue;
+        if (!resolve(from) || !resolve(to) || root[from] != root[to])
+            continue;
+        // 根坐标系中的位姿相减: T(to <- from) = T(root <- to)^-1 * T(root <- from)
+        Eigen::Quaterniond inverse = poses[to].rotation.inverse();
+        results[i].Transform = to_data(Pose{
+            inverse * (poses[from].translation - poses[to].translation),
+            inverse * poses[from].rotation });
+        results[i].Valid = 1;
+        found++;
+    }
+    return found;
+}
+
+std::string TransformLookup::get_stats()
+{
+    auto snap = std::atomic_load(&snapshot);
+    std::shared_lock<std::shared_mutex> lock(cache_mutex);
+    return "frames: " + std::to_string(snap->names.size()) +
+           ", edges: " + std::to_string(snap->edges.size()) +
+           ", cached pairs: " + std::to_string(cache.size()) +
+           ", hits: " + std::to_string(hits.load()) +
+           ", misses: " + std::to_string(misses.load()) +
+           ", reloads: " + std::to_string(reloads.load());
+}
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "TransformPublisher.hpp"
+
+TransformPublisher::TransformPublisher(LookupFunction lookup,
+                                       SendFunction send)
+{
+    this->lookup = lookup;
+    this->send = send;
+    publisher = std::thread(&TransformPublisher::publish, this);
+}
+
+TransformPublisher::~TransformPublisher()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopped = true;
+    }
+    cv.notify_all();
+    publisher.join();
+}
+
+void TransformPublisher::subscribe(int client, unsigned int id,
+                                   const Message::TransformSubscribeData &data)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // 同一客户端的同一订阅 ID 视为修改订阅
+        subscriptions.erase(
+            std::remove_if(subscriptions.begin(), subscriptions.end(),
+                           [&](const Subscription &sub) {
+                               return sub.client == client && sub.id == id;
+                           }),
+            subscriptions.end());
+        if (data.Policy == Message::PUSH_CANCEL)
+            return;
+
+        Subscription sub;
+        sub.client = client;
+        sub.id = id;
+        sub.from = std::string(data.From, strnlen(data.From, sizeof(data.From)));
+        sub.to = std::string(data.To, strnlen(data.To, sizeof(data.To)));
+        sub.policy = data.Policy;
+        sub.period = std::chrono::steady_clock::duration::zero();
+        if (data.Policy == Message::PUSH_RATE && data.Rate > 0)
+            sub.period = std::chrono::duration_cast<
+                std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(1.0 / data.Rate));
+        else
+            sub.policy = Message::PUSH_ON_CHANGE;
+        sub.next = std::chrono::steady_clock::now();
+        sub.sent = false;
+        subscriptions.push_back(sub);
+        changed = true; // 新订阅立即推送一次当前值
+    }
+    cv.notify_one();
+}
+
+void TransformPublisher::remove(int client)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    subscriptions.erase(std::remove_if(subscriptions.begin(),
+                                       subscriptions.end(),
+                                       [&](const Subscription &sub) {
+                                           return sub.client == client;
+                                       }),
+                        subscriptions.end());
+}
+
+void TransformPublisher::notify()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        changed = true;
+    }
+    cv.notify_one();
+}
+
+std::string TransformPublisher::get_subscriptions()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string str = "";
+    char line[256];
+    for (auto const &sub : subscriptions) {
+        if (sub.policy == Message::PUSH_RATE)
+            snprintf(line, sizeof(line), "Client %d #%u: %s -> %s, %.1f Hz\n",
+                     sub.client, sub.id, sub.from.c_str(), sub.to.c_str(),
+                     1.0 / std::chrono::duration<double>(sub.period).count());
+        else
+            snprintf(line, sizeof(line), "Client %d #%u: %s -> %s, on change\n",
+                     sub.client, sub.id, sub.from.c_str(), sub.to.c_str());
+        str += line;
+    }
+    return str;
+}
+
+void TransformPublisher::publish()
+{
+    typedef struct {
+        int client;
+        unsigned int id;
+        Message::TransformData data;
+    } Push;
+
+    while (true) {
+        std::vector<Push> pushes;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            // 等到最早的定频推送时间, 或者被新订阅/坐标变换变化唤醒
+            bool timed = false;
+            auto wake = std::chrono::steady_clock::time_point();
+            for (auto const &sub : subscriptions) {
+                if (sub.policy == Message::PUSH_RATE &&
+                    (!timed || sub.next < wake)) {
+                    wake = sub.next;
+                    timed = true;
+                }
+            }
+            auto ready = [&]() {
+                return stopped || changed ||
+                       (timed && std::chrono::steady_clock::now() >= wake);
+            };
+            if (timed)
+                cv.wait_until(lock, wake, ready);
+            else
+                cv.wait(lock, ready);
+            if (stopped)
+                return;
+
+            bool check_change = changed;
+            changed = false;
+            auto now = std::chrono::steady_clock::now();
+            for (auto &sub : subscriptions) {
+                bool due = sub.policy == Message::PUSH_RATE ? now >= sub.next :
+                                                              check_change;
+                if (!due)
+                    continue;
+
+                Message::TransformData data;
+                if (!lookup(sub.from, sub.to, data))
+                    continue;
+                if (sub.policy == Message::PUSH_RATE) {
+                    sub.next += sub.period;
+                    if (sub.next < now) // 推送落后时不补发
+                        sub.next = now + sub.period;
+                } else if (sub.sent &&
+                           memcmp(&data, &sub.last, sizeof(data)) == 0) {
+                    continue; // 没有变化
+                }
+                sub.last = data;
+                sub.sent = true;
+                pushes.push_back(Push{ sub.client, sub.id, data });
+            }
+        }
+        // 在锁外发送, 发送失败导致的断开回调会调用 remove
+        for (auto &push : pushes) {
+            send(push.client, push.id, push.data);
+        }
+    }
+}
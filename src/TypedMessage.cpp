@@ -0,0 +1,15 @@
+#include "TypedMessage.hpp"
+#include "Log.hpp"
+
+bool MessageDispatcher::dispatch(unsigned short type, const unsigned char *data,
+                                 unsigned int lenth, unsigned int dataID,
+                                 int from)
+{
+    int index = MessageSchema::index_of(type);
+    if (index < 0 || handlers[index] == nullptr)
+        return false;
+    if (!handlers[index](data, lenth, dataID, from))
+        LOG_WARNING("Invalid {x} message from {}: {} bytes.", type, from,
+                    lenth);
+    return true;
+}
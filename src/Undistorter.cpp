@@ -0,0 +1,175 @@
+#include <cstring>
+
+#include "Undistorter.hpp"
+
+#include <PHOENIX/Utils/Info/Info.hpp>
+
+Undistorter::Undistorter(int step)
+{
+    this->step = step < 1 ? 1 : step;
+}
+
+bool Undistorter::set_camera_info(const Message::CameraInfoData &info)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (has_info && memcmp(&this->info, &info, sizeof(info)) == 0)
+        return false; // 内参没有变化, 保留映射表
+    this->info = info;
+    has_info = true;
+    warned = false;
+    maps.clear();
+    return true;
+}
+
+bool Undistorter::get_camera_info(Message::CameraInfoData &info)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (has_info)
+        info = this->info;
+    return has_info;
+}
+
+void Undistorter::set_roi(const cv::Rect &roi)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (roi == this->roi)
+        return;
+    this->roi = roi;
+    maps.clear();
+}
+
+std::shared_ptr<const Undistorter::Maps> Undistorter::get(cv::Size size)
+{
+    Message::CameraInfoData current;
+    cv::Rect region;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < maps.size(); i++) {
+            if (maps[i]->size != size)
+                continue;
+            auto m = maps[i];
+            maps.erase(maps.begin() + i);
+            maps.insert(maps.begin(), m);
+            return m;
+        }
+        if (!has_info)
+            return nullptr;
+        if (info.Width == 0 || info.Height == 0) {
+            // 不知道内参对应的分辨率, 无法换算到接收到的图像
+            if (!warned)
+                WARNING("Camera info has no calibrated resolution, "
+                        "undistortion disabled.");
+            warned = true;
+            return nullptr;
+        }
+        current = info;
+        region = roi;
+    }
+    auto m = std::make_shared<Maps>();
+    m->info = current;
+
+    // 在锁外计算, 不阻塞接收线程更新内参
+    m->size = size;
+    // 与服务器端相同, ROI 按标定分辨率的图像范围裁剪, 为空时使用完整图像
+    cv::Rect full(0, 0, current.Width, current.Height);
+    m->roi = region.area() > 0 ? region & full : full;
+    if (m->roi.area() == 0)
+        m->roi = full;
+    // 裁剪平移主点, 缩放按像素中心对齐 (与 cv::resize 一致)
+    double sx = (double)size.width / m->roi.width;
+    double sy = (double)size.height / m->roi.height;
+    const double *k = current.CameraMatrix;
+    double adjusted[9] = { k[0] * sx,
+                           k[1] * sx,
+                           (k[2] - m->roi.x + 0.5) * sx - 0.5,
+                           0.0,
+                           k[4] * sy,
+                           (k[5] - m->roi.y + 0.5) * sy - 0.5,
+                           0.0,
+                           0.0,
+                           1.0 };
+    memcpy(m->camera, adjusted, sizeof(adjusted));
+    cv::Mat camera(3, 3, CV_64F, m->camera);
+    cv::Mat dist(1, 5, CV_64F, m->info.DistortionCoefficients);
+    cv::initUndistortRectifyMap(camera, dist, cv::Mat(), camera, size,
+                                CV_16SC2, m->map1, m->map2);
+
+    m->cols = size.width / step + 2;
+    m->rows = size.height / step + 2;
+    std::vector<cv::Point2f> grid;
+    grid.reserve(m->cols * m->rows);
+    for (int r = 0; r < m->rows; r++) {
+        for (int c = 0; c < m->cols; c++) {
+            grid.push_back(cv::Point2f(c * step, r * step));
+        }
+    }
+    cv::undistortPoints(grid, m->lut, camera, dist, cv::Mat(), camera);
+    INFO("Undistortion maps rebuilt for " + std::to_string(size.width) + "x" +
+         std::to_string(size.height));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    // 计算期间内参或 ROI 可能再次变化, 只保存与当前设置一致的结果
+    if (has_info && memcmp(&info, &current, sizeof(info)) == 0 &&
+        roi == region) {
+        maps.insert(maps.begin(), m);
+        if (maps.size() > MAX_MAPS)
+            maps.pop_back();
+    }
+    return m;
+}
+
+bool Undistorter::undistort(const cv::Mat &src, cv::Mat &dst)
+{
+    auto m = get(src.size());
+    if (m == nullptr)
+        return false;
+    cv::remap(src, dst, m->map1, m->map2, cv::INTER_LINEAR,
+              cv::BORDER_CONSTANT);
+    return true;
+}
+
+bool Undistorter::undistort_points(const std::vector<cv::Point2f> &points,
+                                   std::vector<cv::Point2f> &undistorted,
+                                   cv::Size size)
+{
+    auto m = get(size);
+    if (m == nullptr)
+        return false;
+
+    undistorted.resize(points.size());
+    std::vector<cv::Point2f> outside;
+    std::vector<size_t> outside_index;
+    for (size_t i = 0; i < points.size(); i++) {
+        float gx = points[i].x / step;
+        float gy = points[i].y / step;
+        int c = (int)gx, r = (int)gy;
+        if (gx < 0 || gy < 0 || c + 1 >= m->cols || r + 1 >= m->rows) {
+            outside.push_back(points[i]);
+            outside_index.push_back(i);
+            continue;
+        }
+        // 网格内双线性插值
+        float fx = gx - c, fy = gy - r;
+        const cv::Point2f &p00 = m->lut[r * m->cols + c];
+        const cv::Point2f &p01 = m->lut[r * m->cols + c + 1];
+        const cv::Point2f &p10 = m->lut[(r + 1) * m->cols + c];
+        const cv::Point2f &p11 = m->lut[(r + 1) * m->cols + c + 1];
+        undistorted[i].x = (p00.x * (1 - fx) + p01.x * fx) * (1 - fy) +
+                           (p10.x * (1 - fx) + p11.x * fx) * fy;
+        undistorted[i].y = (p00.y * (1 - fx) + p01.y * fx) * (1 - fy) +
+                           (p10.y * (1 - fx) + p11.y * fx) * fy;
+    }
+    if (!outside.empty()) {
+        Message::CameraInfoData info = m->info;
+        double k[9];
+        memcpy(k, m->camera, sizeof(k));
+        cv::Mat camera(3, 3, CV_64F, k);
+        cv::Mat dist(1, 5, CV_64F, info.DistortionCoefficients);
+        std::vector<cv::Point2f> result;
+        cv::undistortPoints(outside, result, camera, dist, cv::Mat(), camera);
+        for (size_t i = 0; i < outside_index.size() && i < result.size(); i++) {
+            undistorted[outside_index[i]] = result[i];
+        }
+    }
+    return true;
+}
@@ -0,0 +1,393 @@
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SocketServer.hpp"
+#include "SocketClient.hpp"
+#include "Message.hpp"
+#include "Application.hpp"
+#include "PoseStore.hpp"
+#include "Tool.hpp"
+
+#include <PHOENIX/Utils/Info/Info.hpp>
+
+// 测试的数据区大小, 从单个小包到多帧原始图像
+static const unsigned int SIZES[] = { 20,     1024,    10218,  65536,
+                                      524288, 2097152 };
+
+/**
+ * @brief 重复运行至少 min_time, 返回平均每次耗时
+ *
+ * @param run 被测函数
+ * @param min_time 最短测试时间, 单位秒
+ * @return double 平均每次耗时, 单位纳秒
+ */
+double measure(std::function<void()> run, double min_time = 0.2)
+{
+    run(); // 预热
+    unsigned long iterations = 0;
+    auto begin = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    do {
+        run();
+        iterations++;
+        elapsed = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - begin)
+                      .count();
+    } while (elapsed < min_time);
+    return elapsed * 1e9 / iterations;
+}
+
+/**
+ * @brief 把数据区按 encode_and_send 的方式分包
+ *
+ * @param type 消息类型
+ * @param dataID 消息 ID
+ * @param data 数据区
+ * @param total_lenth 数据总长度
+ * @param fragments 分包结果
+ */
+void fragment(unsigned short type, unsigned int dataID,
+              const unsigned char *data, unsigned int total_lenth,
+              std::vector<Message> &fragments)
+{
+    fragments.clear();
+    unsigned int offset = 0;
+    do {
+        Message message(type);
+        message.set_dataID(dataID);
+        message.set_dataTotalLenth(total_lenth);
+        message.set_offset(offset);
+        unsigned int lenth =
+            total_lenth - offset > 10218 ? 10218 : total_lenth - offset;
+        message.set_data((const char *)(data + offset), lenth);
+        fragments.push_back(message);
+        offset += lenth;
+    } while (offset < total_lenth);
+}
+
+/**
+ * @brief Message 构造、分包和 receive_and_decode 重组
+ *
+ */
+void bench_message()
+{
+    char buffer[sizeof(Message::MessageBuffer)];
+    Message source(Message::MessageType::STRING_MSG);
+    memcpy(buffer, source.get_buffer(), sizeof(buffer));
+
+    double ns = measure([]() { Message message(Message::MessageType::IMAGE_MSG); });
+    printf("{\"bench\":\"message_construct\",\"ns_per_op\":%.1f}\n", ns);
+    ns = measure([&]() { Message message(buffer); });
+    printf("{\"bench\":\"message_from_buffer\",\"ns_per_op\":%.1f}\n", ns);
+
+    std::shared_ptr<SocketClient> socket =
+        std::make_shared<SocketClient>("127.0.0.1", 0);
+    Application<SocketClient> app(socket);
+    std::vector<Message> fragments;
+    for (unsigned int size : SIZES) {
+        std::vector<unsigned char> data(size, 0x5A);
+        ns = measure([&]() {
+            fragment(Message::MessageType::IMAGE_MSG, 1, data.data(), size,
+                     fragments);
+        });
+        printf("{\"bench\":\"fragment\",\"size\":%u,\"fragments\":%zu,"
+               "\"ns_per_op\":%.1f,\"mb_per_second\":%.1f}\n",
+               size, fragments.size(), ns, size / ns * 1e3);
+
+        ns = measure([&]() {
+            unsigned char *m = nullptr;
+            for (auto &message : fragments) {
+                m = app.receive_and_decode(message);
+            }
+            delete[] m;
+        });
+        printf("{\"bench\":\"reassemble\",\"size\":%u,\"fragments\":%zu,"
+               "\"ns_per_op\":%.1f,\"mb_per_second\":%.1f}\n",
+               size, fragments.size(), ns, size / ns * 1e3);
+    }
+}
+
+/**
+ * @brief 本地回环端到端测试: 服务器向 N 个客户端发送的吞吐量, 以及客户端请求的往返延迟
+ *
+ * @param port 端口
+ * @param clients 客户端数
+ */
+void bench_loopback(int port, int clients)
+{
+    std::shared_ptr<SocketServer> server = std::make_shared<SocketServer>(port);
+    Application<SocketServer> server_app(server);
+    // 原样回传整个消息缓冲, 客户端的请求层据此匹配回复
+    server->set_on_message([&server](int client, const char *message) {
+        server->send(client, message, sizeof(Message::MessageBuffer));
+    });
+    server->start();
+
+    std::vector<std::shared_ptr<SocketClient>> sockets;
+    std::vector<std::shared_ptr<Application<SocketClient>>> apps;
+    std::vector<std::atomic<unsigned long>> received(clients);
+    for (int i = 0; i < clients; i++) {
+        sockets.push_back(std::make_shared<SocketClient>("127.0.0.1", port));
+        apps.push_back(std::make_shared<Application<SocketClient>>(sockets[i]));
+        received[i] = 0;
+        auto app = apps[i];
+        auto counter = &received[i];
+        sockets[i]->set_on_message([app, counter](const char *message) {
+            Message msg(message);
+            unsigned char *m = app->receive_and_decode(msg);
+            if (m == nullptr)
+                return;
+            *counter += msg.get_dataTotalLenth();
+            delete[] m;
+        });
+        sockets[i]->connect();
+    }
+    while ((int)server->get_client_ids().size() < clients) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    auto ids = server->get_client_ids();
+
+    // 吞吐量: 每个客户端一个发送线程, 与服务器发送图像的方式相同
+    for (unsigned int size : { 1024u, 65536u, 1048576u }) {
+        unsigned int count = std::max(8u, (64u << 20) / size / clients);
+        std::vector<unsigned char> data(size, 0xA5);
+        for (auto &r : received) {
+            r = 0;
+        }
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<std::thread> senders;
+        for (int id : ids) {
+            senders.push_back(std::thread([&, id]() {
+                for (unsigned int k = 0; k < count; k++) {
+                    server_app.encode_and_send(Message::MessageType::IMAGE_MSG,
+                                               k, data.data(), size, id);
+                }
+            }));
+        }
+        for (auto &t : senders) {
+            t.join();
+        }
+        unsigned long expected = (unsigned long)size * count;
+        // 发送完成后最多再等待 10s, 丢失的数据计入 lost_bytes 而不是一直等待
+        auto deadline =
+            std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        unsigned long total = 0;
+        for (auto &r : received) {
+            while (r < expected &&
+                   std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+            total += std::min<unsigned long>(r, expected);
+        }
+        double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - begin)
+                             .count();
+        printf("{\"bench\":\"loopback_throughput\",\"clients\":%d,"
+               "\"size\":%u,\"messages\":%u,\"mb_per_second\":%.1f,"
+               "\"messages_per_second\":%.0f,\"lost_bytes\":%lu}\n",
+               clients, size, count * clients, total / seconds / 1e6,
+               total / size / seconds, expected * clients - total);
+    }
+
+    // 延迟: 每个客户端依次发送请求并等待回复
+    const int rounds = 2000;
+    std::vector<double> rtts(clients * rounds);
+    std::vector<std::thread> pingers;
+    for (int i = 0; i < clients; i++) {
+        pingers.push_back(std::thread([&, i]() {
+            unsigned char payload[64] = { 0 };
+            for (int k = 0; k < rounds; k++) {
+                auto begin = std::chrono::steady_clock::now();
+                auto reply = apps[i]->request(Message::MessageType::STRING_MSG,
+                                              payload, sizeof(payload),
+                                              std::chrono::seconds(1), 0);
+                // 回复丢失时 1s 后超时, future 就绪且 ok 为 false
+                if (!reply.get().ok) {
+                    rtts[i * rounds + k] = -1; // 丢失的请求不计入延迟
+                    continue;
+                }
+                rtts[i * rounds + k] =
+                    std::chrono::duration<double, std::micro>(
+                        std::chrono::steady_clock::now() - begin)
+                        .count();
+            }
+        }));
+    }
+    for (auto &t : pingers) {
+        t.join();
+    }
+    size_t samples = rtts.size();
+    rtts.erase(std::remove(rtts.begin(), rtts.end(), -1.0), rtts.end());
+    std::sort(rtts.begin(), rtts.end());
+    auto percentile = [&](double p) {
+        if (rtts.empty())
+            return 0.0;
+        return rtts[std::min(rtts.size() - 1, (size_t)(p * rtts.size()))];
+    };
+    printf("{\"bench\":\"loopback_rtt\",\"clients\":%d,\"samples\":%zu,"
+           "\"lost\":%zu,\"p50_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f,"
+           "\"max_us\":%.1f}\n",
+           clients, rtts.size(), samples - rtts.size(), percentile(0.5),
+           percentile(0.9), percentile(0.99), percentile(1.0));
+}
+
+/**
+ * @brief 本地回环位姿上传测试: N 个客户端同时通过 Application 上传 OBSERVATION,
+ *        服务器与 server.cpp 相同, 按类型分发后写入 PoseStore
+ *
+ * 各客户端使用相同的 dataID 序列, 每批位姿带有客户端编号和批次号,
+ * 服务器逐条校验, 不同客户端的分包混在一起时计入 corrupt_batches
+ *
+ * @param port 端口
+ * @param clients 客户端数
+ */
+void bench_upload(int port, int clients)
+{
+    const unsigned int batch = 400;   // 每批位姿数, 约 3 个分包
+    const unsigned int batches = 500; // 每个客户端上传的批数
+    const std::string path = "bench_poses.bin";
+
+    std::shared_ptr<SocketServer> server = std::make_shared<SocketServer>(port);
+    Application<SocketServer> server_app(server);
+    auto poses = std::make_shared<PoseStore>(path);
+    std::atomic<unsigned long> rows{ 0 }, corrupt{ 0 };
+    server_app.on<Message::OBSERVATION>(
+        [&](int client, const MessageView<Message::OBSERVATION> &view) {
+            const Message::PoseSample *samples = view.begin();
+            bool ok = view.size() == batch;
+            for (unsigned int j = 0; ok && j < view.size(); j++) {
+                ok = samples[j].Target == samples[0].Target &&
+                     samples[j].Position[0] == samples[0].Position[0] &&
+                     samples[j].Position[1] == j;
+            }
+            if (!ok)
+                corrupt++;
+            poses->append(client, PoseStore::OBSERVATION, samples,
+                          view.size());
+            rows += view.size();
+        });
+    server->set_on_message([&server_app](int client, const char *message) {
+        Message msg(message);
+        unsigned char *m = server_app.receive_and_decode(msg, client);
+        if (m == nullptr)
+            return;
+        server_app.dispatch(msg, m, client);
+        delete[] m;
+    });
+    server->start();
+
+    std::vector<std::shared_ptr<SocketClient>> sockets;
+    std::vector<std::shared_ptr<Application<SocketClient>>> apps;
+    for (int i = 0; i < clients; i++) {
+        sockets.push_back(std::make_shared<SocketClient>("127.0.0.1", port));
+        apps.push_back(std::make_shared<Application<SocketClient>>(sockets[i]));
+        sockets[i]->connect();
+    }
+    while ((int)server->get_client_ids().size() < clients) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> uploaders;
+    for (int i = 0; i < clients; i++) {
+        uploaders.push_back(std::thread([&, i]() {
+            std::vector<Message::PoseSample> samples(batch);
+            for (unsigned int k = 0; k < batches; k++) {
+                for (unsigned int j = 0; j < batch; j++) {
+                    samples[j] = { 0, (unsigned int)i,
+                                   { (double)k, (double)j, 0 },
+                                   { 0, 0, 0, 1 } };
+                }
+                apps[i]->send<Message::OBSERVATION>(k, { 0 }, samples.data(),
+                                                    batch, -1);
+            }
+        }));
+    }
+    for (auto &t : uploaders) {
+        t.join();
+    }
+    unsigned long expected = (unsigned long)clients * batches * batch;
+    auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (rows < expected && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - begin)
+                         .count();
+    printf("{\"bench\":\"pose_upload\",\"clients\":%d,\"batch\":%u,"
+           "\"rows\":%lu,\"rows_per_second\":%.0f,\"lost_rows\":%lu,"
+           "\"corrupt_batches\":%lu,\"store_dropped\":%lu}\n",
+           clients, batch, rows.load(), rows / seconds, expected - rows,
+           corrupt.load(), poses->get_dropped());
+    poses.reset();
+    std::remove(path.c_str());
+}
+
+/**
+ * @brief 常用分辨率下的 JPEG 编解码耗时
+ *
+ */
+void bench_jpeg()
+{
+    std::mt19937 rng(1);
+    for (auto size : { cv::Size(640, 480), cv::Size(1280, 1024),
+                       cv::Size(1920, 1080) }) {
+        // 渐变加噪声, 压缩率接近真实画面
+        cv::Mat image(size, CV_8UC3);
+        for (int r = 0; r < size.height; r++) {
+            unsigned char *row = image.ptr<unsigned char>(r);
+            for (int c = 0; c < size.width * 3; c++) {
+                row[c] = (unsigned char)((r + c / 3) / 8 + rng() % 16);
+            }
+        }
+        for (int quality : { 95, 75 }) {
+            std::vector<unsigned char> data;
+            std::vector<int> params = { cv::IMWRITE_JPEG_QUALITY, quality };
+            double encode = measure(
+                [&]() { cv::imencode(".jpg", image, data, params); }, 0.5);
+            cv::Mat decoded;
+            double decode = measure(
+                [&]() { decoded = cv::imdecode(data, cv::IMREAD_COLOR); },
+                0.5);
+            printf("{\"bench\":\"jpeg\",\"width\":%d,\"height\":%d,"
+                   "\"quality\":%d,\"bytes\":%zu,\"encode_ms\":%.3f,"
+                   "\"decode_ms\":%.3f}\n",
+                   size.width, size.height, quality, data.size(), encode / 1e6,
+                   decode / 1e6);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    // 用法: bench [message|loopback|upload|jpeg|all] [客户端数] [端口]
+    // 每行输出一个 JSON 对象, 便于比较不同版本的结果
+    std::string section = argc > 1 ? argv[1] : "all";
+    int clients = argc > 2 ? std::stoi(argv[2]) : 4;
+    int port = argc > 3 ? std::stoi(argv[3]) : 18000;
+
+    ignore_sigpipe();
+
+    if (section == "message" || section == "all")
+        bench_message();
+    if (section == "jpeg" || section == "all")
+        bench_jpeg();
+    if (section == "loopback" || section == "all")
+        bench_loopback(port, clients);
+    if (section == "upload" || section == "all")
+        bench_upload(port + 1, clients);
+
+    exit_tool(0);
+}
@@ -2,10 +2,12 @@
 #include <opencv2/highgui/highgui.hpp>
 
 #include <signal.h>
+#include <cstdio>
 
 #include "SocketServer.hpp"
 #include "Message.hpp"
 #include "Application.hpp"
+#include "Log.hpp"
 
 #include <PHOENIX/Utils/Info/Info.hpp>
 
@@ -21,31 +23,47 @@ int main(int argc, char *argv[])
     SocketServer server(std::stoi(argv[1]));
     std::shared_ptr<SocketServer> server_ptr(&server);
     Application<SocketServer> app(server_ptr);
+    // --metrics <port> 在本机该端口上以 Prometheus 格式导出运行指标
+    // --max-clients <N> 同时连接的客户端数上限, 超出的连接建立后立即断开
+    // --camera-size <W>x<H> 标定时的图像分辨率, 客户端据此换算裁剪和缩放后的内参
+    int max_clients = 16;
+    unsigned int camera_width = 1280, camera_height = 1024;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::string(argv[i]) == "--max-clients")
+            max_clients = std::stoi(argv[i + 1]);
+        if (std::string(argv[i]) == "--camera-size")
+            sscanf(argv[i + 1], "%ux%u", &camera_width, &camera_height);
+        if (std::string(argv[i]) != "--metrics")
+            continue;
+        std::shared_ptr<Metrics> metrics = std::make_shared<Metrics>();
+        server.set_metrics(metrics);
+        app.set_metrics(metrics, "app=\"camerainfo_server\"");
+        Log::set_metrics(metrics);
+        metrics->serve(std::stoi(argv[i + 1]));
+    }
 
     server.set_on_message([&app](int client, const char *message) {});
     // 设置连接成功处理函数, 直接发送相机内参
-    server.set_on_connect([&app](int client) {
+    server.set_on_connect([&app, max_clients, camera_width,
+                           camera_height](int client) {
         INFO("Client " + std::to_string(client) + " connected.");
-        if (client > 15)
+        if (client >= max_clients) {
+            WARNING("Client " + std::to_string(client) +
+                    " rejected, --max-clients is " +
+                    std::to_string(max_clients));
             app.disconnect(client);
+            return;
+        }
 
-        double camera_info[9 + 5] = { 2142.4253006101626,
-                                      0.0,
-                                      654.8800557555103,
-                                      0.0,
-                                      2139.740720699495,
-                                      247.26009197675802,
-                                      0.0,
-                                      0.0,
-                                      1.0,
-                                      -0.04313325802537415,
-                                      0.3598873080850437,
-                                      -0.011789027160352577,
-                                      -0.0068734187976891474,
-                                      0.0 };
-        app.encode_and_send(Message::MessageType::CAMERA_INFO, 0,
-                            (unsigned char *)(camera_info), sizeof(camera_info),
-                            client);
+        Message::CameraInfoData camera_info = {
+            { 2142.4253006101626, 0.0, 654.8800557555103, 0.0,
+              2139.740720699495, 247.26009197675802, 0.0, 0.0, 1.0 },
+            { -0.04313325802537415, 0.3598873080850437, -0.011789027160352577,
+              -0.0068734187976891474, 0.0 },
+            camera_width,
+            camera_height
+        };
+        app.send<Message::CAMERA_INFO>(0, camera_info, client);
     });
 
     server.set_on_disconnect([&server](int client) {
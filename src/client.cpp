@@ -1,7 +1,17 @@
 #include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <thread>
+#include <chrono>
 #include <memory>
 #include <sstream>
 #include <vector>
+#include <atomic>
+#include <mutex>
+#include <utility>
+
+#include <signal.h>
+#include <unistd.h>
 
 #include <opencv2/core/mat.hpp>
 #include <opencv2/highgui.hpp>
@@ -11,6 +21,16 @@
 #include "SocketClient.hpp"
 #include "Message.hpp"
 #include "Application.hpp"
+#include "DecodePool.hpp"
+#include "FrameMailbox.hpp"
+#include "FrameRing.hpp"
+#include "TransformCache.hpp"
+#include "Undistorter.hpp"
+#include "ClockSync.hpp"
+#include "LatencyHistogram.hpp"
+#include "Metrics.hpp"
+#include "Trace.hpp"
+#include "Log.hpp"
 
 #include <PHOENIX/Utils/Info/Info.hpp>
 
@@ -18,8 +38,21 @@
 // 由于原先的 Application 类不太适合多 fd 处理, 因此新建一个类
 // 此处仅作为示例, 并未按照最佳实践进行设计
 struct ClientApp {
-    std::vector<cv::Mat> frames; ///< 存储接收到的图像
-    cv::Mat cameraMatrix, distCoeffs; ///< 相机内参和畸变系数
+    std::shared_ptr<FrameRing> frames; ///< 最近接收到的图像及其元数据
+    FrameMailbox display; ///< 待显示的最新帧, 由渲染线程读取
+    bool headless = false; ///< 无界面模式, 不显示图像
+    Undistorter undistorter; ///< 相机内参及缓存的去畸变映射表
+    bool undistort = false; ///< 显示前对图像去畸变
+    cv::Mat undistorted; ///< 去畸变后的图像, 只由图像处理线程使用
+    TransformCache transforms; ///< 订阅的坐标变换缓存
+    int camera_to_odom; ///< Camera -> Odom 在 transforms 中的下标
+    bool tf_sync = false; ///< 每帧向服务器请求坐标变换并等待回复, 而不是读取推送缓存
+    std::vector<unsigned char> batch_request; ///< 每帧使用的批量坐标变换请求
+    std::mutex origins_mutex; ///< 保护 origins
+    std::pair<unsigned int, long long> origins[64] = {}; ///< 最近接收的图像的 (dataID, 本地时间的采集时间)
+    LatencyHistogram end_to_end; ///< 从服务器采集到本帧处理完成的延迟
+    std::shared_ptr<Metrics> metrics; ///< 运行指标注册表, 未开启时为 nullptr
+    int end_to_end_series = -1; ///< 端到端延迟的序列编号
 
     std::shared_ptr<Application<SocketClient>> video_app; ///< 视频接收应用
     std::shared_ptr<Application<SocketClient>>
@@ -40,27 +73,112 @@ struct ClientApp {
         video_app = video_receiver;
         camerainfo_app = camerainfo_receiver;
         transformer_app = transformer;
+        camera_to_odom = transforms.add("Camera", "Odom");
+
+        // 每帧需要的坐标变换, 第一个为 Camera -> Odom
+        const char *pairs[][2] = { { "Camera", "Odom" },
+                                   { "Shooter", "Odom" },
+                                   { "Camera", "Gimbal" } };
+        Message::TransformBatchHeader header = { 0, 3 };
+        batch_request.resize(sizeof(header) +
+                             3 * sizeof(Message::TransformPair));
+        memcpy(batch_request.data(), &header, sizeof(header));
+        auto pair = (Message::TransformPair *)(batch_request.data() +
+                                               sizeof(header));
+        for (int i = 0; i < 3; i++) {
+            strncpy(pair[i].From, pairs[i][0], sizeof(pair[i].From));
+            strncpy(pair[i].To, pairs[i][1], sizeof(pair[i].To));
+        }
+    }
+    /**
+     * @brief 向服务器订阅坐标变换推送
+     * 
+     * @param policy 推送策略
+     * @param rate PUSH_RATE 策略的推送频率, 单位 Hz
+     */
+    void subscribeTransforms(unsigned int policy, double rate)
+    {
+        auto data = transforms.subscription(camera_to_odom, policy, rate);
+        transformer_app->send<Message::TRANSFORM_SUBSCRIBE>(
+            TransformCache::get_id(camera_to_odom), data, 0);
+    }
+    /**
+     * @brief 记录图像的采集时间, 在接收线程中调用
+     * 
+     * @param dataID 图像的消息 ID
+     * @param origin 已换算为本地时间的采集时间
+     */
+    void setOrigin(unsigned int dataID, long long origin)
+    {
+        std::lock_guard<std::mutex> lock(origins_mutex);
+        origins[dataID % 64] = { dataID, origin };
     }
     /**
      * @brief 图像处理函数
      * 
-     * @param frame 接收到的图像
+     * @param dataID 图像的消息 ID
+     * @param frame 接收到的图像, 指向 frames 中的缓冲, 不要长期持有
      */
-    void getFrame(cv::Mat &frame)
+    void getFrame(unsigned int dataID, cv::Mat &frame)
     {
-        // 显示图像
-        cv::imshow("received", frame);
-        cv::waitKey(1);
-
-        frames.push_back(frame);
-        // 请求获取当前坐标变换
-        Message::TransformRequestData data;
-        memcpy(data.From, "Camera", sizeof("Camera"));
-        memcpy(data.To, "Odom", sizeof("Odom"));
-
-        transformer_app->encode_and_send(
-            Message::MessageType::TRANSFORM_REQUEST, frames.size(),
-            (unsigned char *)&data, sizeof(data), 0);
+        TRACE_SPAN("getFrame", dataID);
+        // 映射表只在内参变化后的第一帧计算, 之后每帧只做一次 remap
+        cv::Mat &shown =
+            undistort && undistorter.undistort(frame, undistorted) ?
+                undistorted :
+                frame;
+        // 交给渲染线程显示, 不阻塞图像处理
+        if (!headless)
+            display.put(shown);
+
+        updateTransform(dataID);
+
+        // 本帧处理完成, 统计从服务器采集到此的延迟
+        long long origin = 0;
+        {
+            std::lock_guard<std::mutex> lock(origins_mutex);
+            if (origins[dataID % 64].first == dataID) {
+                origin = origins[dataID % 64].second;
+                origins[dataID % 64] = { 0, 0 };
+            }
+        }
+        if (origin == 0)
+            return;
+        long long latency = ClockSync::now() - origin;
+        end_to_end.record(latency);
+        if (metrics != nullptr)
+            metrics->observe(end_to_end_series, latency);
+    }
+    /**
+     * @brief 获取本帧对应的坐标变换, 记录到帧的元数据中
+     * 
+     * @param dataID 图像的消息 ID
+     */
+    void updateTransform(unsigned int dataID)
+    {
+        if (tf_sync) {
+            // 请求本帧需要的所有坐标变换, 回复按关联 ID 交付, 不会与其他帧混淆
+            auto reply = transformer_app->request(
+                Message::MessageType::TRANSFORM_BATCH_REQUEST,
+                batch_request.data(), batch_request.size(),
+                std::chrono::milliseconds(100), 0);
+            // 超时后 future 同样就绪, result.ok 为 false
+            auto result = reply.get();
+            MessageView<Message::TRANSFORM_BATCH> batch;
+            if (!result.ok ||
+                !MessageView<Message::TRANSFORM_BATCH>::parse(
+                    result.data.data(), result.data.size(), batch) ||
+                batch.size() == 0)
+                return;
+            if (batch[0].Valid)
+                frames->set_transform(dataID, batch[0].Transform);
+            return;
+        }
+
+        // 从本地缓存读取服务器推送的最新坐标变换, 不需要等待网络往返
+        Message::TransformData tf;
+        if (transforms.get(camera_to_odom, tf))
+            frames->set_transform(dataID, tf);
     }
 };
 std::shared_ptr<SocketClient> video_receiver =
@@ -77,6 +195,7 @@ std::shared_ptr<Application<SocketClient>> camerainfo_app =
 std::shared_ptr<Application<SocketClient>> transformer_app =
     std::make_shared<Application<SocketClient>>(transformer);
 ClientApp clientApp(video_app, camerainfo_app, transformer_app);
+std::shared_ptr<DecodePool> decoder; ///< 图像解码线程池, 在 main 中根据参数创建
 
 /**
  * @brief 初始化客户端
@@ -87,6 +206,33 @@ ClientApp clientApp(video_app, camerainfo_app, transformer_app);
 void initClient(std::shared_ptr<SocketClient> &socket,
                 std::shared_ptr<Application<SocketClient>> &app)
 {
+    // 按消息类型注册处理函数, 数据区长度不符的消息由 dispatch 丢弃
+    app->on<Message::STRING_MSG>(
+        [](int, const MessageView<Message::STRING_MSG> &text) { // 字符串消息
+            LOG_INFO("Server: {}", // 输出消息
+                     std::string_view(text.begin(),
+                                      strnlen(text.begin(), text.size())));
+        });
+    app->on<Message::CAMERA_INFO>(
+        [](int, const MessageView<Message::CAMERA_INFO> &info) { // 相机信息
+            // 按值存下相机内参和畸变系数, 内参不变时保留已计算的映射表
+            if (clientApp.undistorter.set_camera_info(*info))
+                DEBUG("Camera info received.");
+        });
+    app->on<Message::TRANSFORM>(
+        [](int, const MessageView<Message::TRANSFORM> &tf) { // 变换信息
+            // 订阅推送的变换只更新缓存
+            if (clientApp.transforms.update(tf.get_dataID(), *tf))
+                return;
+            // 输出变换信息
+            LOG_INFO("Transform received.\nTranslation:\n x = {} y = {} z = {}"
+                     "\nRotation:\n x = {} y = {} z = {} w = {}",
+                     tf->Translation[0], tf->Translation[1],
+                     tf->Translation[2], tf->Rotation[0], tf->Rotation[1],
+                     tf->Rotation[2], tf->Rotation[3]);
+            // 记录到对应帧的元数据中
+            clientApp.frames->set_transform(tf.get_dataID(), *tf);
+        });
     // 接收消息回调函数
     std::function recv_callback = [&app](const char *message) {
         Message msg(message);
@@ -95,47 +241,15 @@ void initClient(std::shared_ptr<SocketClient> &socket,
             return;
         if (msg.get_messageType() ==
             Message::MessageType::IMAGE_MSG) { // 图像消息
-            DEBUG("Image received.");
-            std::vector<unsigned char> data(m, m + msg.get_dataTotalLenth());
-            cv::Mat image = cv::imdecode(data, cv::IMREAD_COLOR);
-            clientApp.getFrame(image); // 处理图像
-        }
-        if (msg.get_messageType() ==
-            Message::MessageType::STRING_MSG) // 字符串消息
-            INFO("Server: " + std::string((char *)m)); // 输出消息
-        if (msg.get_messageType() ==
-            Message::MessageType::CAMERA_INFO) { // 相机信息
-            DEBUG("Camera info received.");
-            std::vector<unsigned char> data(m, m + msg.get_dataTotalLenth());
-            // 存下相机内参和畸变系数
-            clientApp.cameraMatrix =
-                cv::Mat(3, 3, CV_64F,
-                        ((Message::CameraInfoData *)data.data())->CameraMatrix);
-            clientApp.distCoeffs =
-                cv::Mat(1, 5, CV_64F,
-                        ((Message::CameraInfoData *)data.data())
-                            ->DistortionCoefficients);
-        }
-        if (msg.get_messageType() ==
-            Message::MessageType::TRANSFORM) { // 变换信息
-            DEBUG("Transform received.");
-            std::vector<unsigned char> data(m, m + msg.get_dataTotalLenth());
-            // 输出变换信息
-            std::stringstream ss;
-            // clang-format off
-            ss << "Translation:" << std::endl 
-                << " x = " << ((Message::TransformData *)data.data())->Translation[0]
-                << " y = " << ((Message::TransformData *)data.data())->Translation[1]
-                << " z = " << ((Message::TransformData *)data.data())->Translation[2] << std::endl
-               << "Rotation:" << std::endl
-                << " x = " << ((Message::TransformData *)data.data())->Rotation[0]
-                << " y = " << ((Message::TransformData *)data.data())->Rotation[1]
-                << " z = " << ((Message::TransformData *)data.data())->Rotation[2]
-                << " w = " << ((Message::TransformData *)data.data())->Rotation[3] << std::endl;
-            // clang-format on
-            INFO(ss.str());
+            // 解码和图像处理交给解码线程池, 接收线程立即返回继续读取 socket,
+            // 缓冲区由解码线程释放, 不经过 dispatch
+            long long origin;
+            if (app->get_origin(msg, origin))
+                clientApp.setOrigin(msg.get_dataID(), origin);
+            decoder->push(msg.get_dataID(), m, msg.get_dataTotalLenth());
+            return;
         }
-
+        app->dispatch(msg, m);
         delete[] m;
     };
 
@@ -143,8 +257,7 @@ void initClient(std::shared_ptr<SocketClient> &socket,
     socket->set_on_connect([&app]() { // 设置连接成功处理函数
         INFO("Connected to server.");
         std::string msg("Hello server\n");
-        app->encode_and_send(Message::MessageType::STRING_MSG, 0,
-                             (unsigned char *)(msg.c_str()), msg.size(), 0);
+        app->send<Message::STRING_MSG>(0, msg.data(), msg.size(), 0);
     });
     socket->set_on_disconnect(
         []() { INFO("Disconnected from server."); }); // 设置断开连接处理函数
@@ -152,16 +265,212 @@ void initClient(std::shared_ptr<SocketClient> &socket,
     socket->connect(); // 连接服务器
 }
 
-int main(int argc, char *argv[])
+/**
+ * @brief 解析命令行参数中的图像订阅
+ * 
+ * @param argc 参数个数
+ * @param argv 参数列表
+ * @param sub 图像订阅参数
+ * @return true 指定了订阅参数
+ * @note --size <W>x<H> 缩放到指定分辨率, --roi <x>,<y>,<w>,<h> 裁剪感兴趣区域,
+ *       --tiles <R>x<C> 使用分块编码, 客户端多线程并行解码
+ */
+bool parseSubscription(int argc, char *argv[],
+                       Message::ImageSubscribeData &sub)
+{
+    bool subscribed = false;
+    sub = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    for (int i = 1; i + 1 < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "--size" && sscanf(argv[i + 1], "%ux%u", &sub.Width,
+                                      &sub.Height) == 2) {
+            subscribed = true;
+            i++;
+        } else if (arg == "--roi" &&
+                   sscanf(argv[i + 1], "%d,%d,%d,%d", &sub.RoiX, &sub.RoiY,
+                          &sub.RoiWidth, &sub.RoiHeight) == 4) {
+            subscribed = true;
+            i++;
+        } else if (arg == "--tiles" && sscanf(argv[i + 1], "%ux%u",
+                                              &sub.TileRows,
+                                              &sub.TileCols) == 2) {
+            subscribed = true;
+            i++;
+        }
+    }
+    return subscribed;
+}
+
+/**
+ * @brief 根据命令行参数创建图像解码线程池
+ * 
+ * @param argc 参数个数
+ * @param argv 参数列表
+ * @note --decoders <N> 解码线程数, 默认为 CPU 核数减一
+ * @note --skip wait|late:<N>|latest 跳帧策略, 默认 late:4
+ */
+void initDecoder(int argc, char *argv[])
+{
+    int threads = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+    DecodePool::SkipPolicy policy = DecodePool::SKIP_LATE;
+    unsigned int max_lag = 4;
+
+    for (int i = 1; i + 1 < argc; i++) {
+        std::string arg(argv[i]);
+        std::string value(argv[i + 1]);
+        if (arg == "--decoders") {
+            threads = std::stoi(value);
+            i++;
+        } else if (arg == "--skip") {
+            if (value == "wait")
+                policy = DecodePool::WAIT_ALL;
+            else if (value == "latest")
+                policy = DecodePool::LATEST_ONLY;
+            else if (sscanf(value.c_str(), "late:%u", &max_lag) == 1)
+                policy = DecodePool::SKIP_LATE;
+            else
+                WARNING("Unknown skip policy " + value + ", use late:4.");
+            i++;
+        }
+    }
+
+    // 保留最近 16 帧历史, 解码中的帧另外占用槽位
+    clientApp.frames = std::make_shared<FrameRing>(
+        16, DecodePool::get_in_flight(threads, max_lag));
+    decoder = std::make_shared<DecodePool>(
+        threads,
+        [](unsigned int dataID, cv::Mat &image) {
+            clientApp.getFrame(dataID, image); // 按序处理图像
+        },
+        policy, max_lag, clientApp.frames);
+}
+
+/**
+ * @brief 渲染线程处理函数, 只显示信箱中的最新帧
+ * 
+ */
+void render()
 {
     cv::namedWindow("received", cv::WINDOW_NORMAL);
+    cv::Mat frame;
+    while (true) {
+        if (clientApp.display.take(frame))
+            cv::imshow("received", frame);
+        cv::waitKey(1); // 处理窗口事件, 同时避免空转
+    }
+}
+
+std::atomic<bool> dump_trace(false); ///< 收到 SIGUSR1 后由主循环导出跟踪
+
+int main(int argc, char *argv[])
+{
+    // 客户端没有命令行, 开启跟踪时用 kill -USR1 <pid> 导出
+    signal(SIGUSR1, [](int) { dump_trace = true; });
+
+    // --headless 无界面模式, 跳过所有 GUI 操作, 用于单独测量处理吞吐量
+    // --tf-sync 每帧请求坐标变换并等待回复, --undistort 显示去畸变后的图像
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--undistort")
+            clientApp.undistort = true;
+        if (std::string(argv[i]) == "--headless")
+            clientApp.headless = true;
+        if (std::string(argv[i]) == "--tf-sync")
+            clientApp.tf_sync = true;
+    }
+    if (!clientApp.headless)
+        std::thread(render).detach();
 
+    initDecoder(argc, argv);
+
+    // --metrics <port> 在该端口上以 Prometheus 格式导出运行指标
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::string(argv[i]) != "--metrics")
+            continue;
+        std::shared_ptr<Metrics> metrics = std::make_shared<Metrics>();
+        video_receiver->set_metrics(metrics);
+        camerainfo_receiver->set_metrics(metrics);
+        transformer->set_metrics(metrics);
+        video_app->set_metrics(metrics, "app=\"video\"");
+        camerainfo_app->set_metrics(metrics, "app=\"camerainfo\"");
+        transformer_app->set_metrics(metrics, "app=\"transformer\"");
+        decoder->set_metrics(metrics);
+        Log::set_metrics(metrics);
+        clientApp.metrics = metrics;
+        clientApp.end_to_end_series = metrics->add_series(
+            "client_end_to_end_seconds",
+            "Time from frame capture on the server to the end of getFrame.",
+            Metrics::SUMMARY, "", 1e-9);
+        metrics->serve(std::stoi(argv[i + 1]));
+    }
+    // --record <prefix> 把从三个服务器接收到的原始数据记录到文件, 用 replay 程序回放
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::string(argv[i]) != "--record")
+            continue;
+        std::shared_ptr<StreamRecorder> recorder =
+            std::make_shared<StreamRecorder>(argv[i + 1]);
+        video_receiver->set_recorder(recorder);
+        camerainfo_receiver->set_recorder(recorder);
+        transformer->set_recorder(recorder);
+    }
     initClient(video_receiver, video_app);
     initClient(camerainfo_receiver, camerainfo_app);
     initClient(transformer, transformer_app);
+    // 上传和请求附带时间戳, 服务器据此按客户端统计延迟
+    video_app->set_timestamps(true);
+    transformer_app->set_timestamps(true);
+    // 估计与服务器的时钟偏移, 把服务器的采集时间换算为本地时间
+    video_app->start_clock_sync(std::chrono::seconds(1));
+    transformer_app->start_clock_sync(std::chrono::seconds(1));
 
-    while (1)
-        ; // 保持程序运行
+    // 订阅坐标变换推送, --tf-rate <Hz> 按固定频率推送, 默认变化时推送
+    unsigned int policy = Message::PUSH_ON_CHANGE;
+    double rate = 0;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::string(argv[i]) == "--tf-rate") {
+            policy = Message::PUSH_RATE;
+            rate = std::stod(argv[i + 1]);
+        }
+    }
+    clientApp.subscribeTransforms(policy, rate);
+
+    // 按需订阅缩小的图像或 ROI, 减少服务器编码和传输的数据量
+    Message::ImageSubscribeData sub;
+    if (parseSubscription(argc, argv, sub))
+        video_app->send<Message::IMAGE_SUBSCRIBE>(0, sub, 0);
+    // 去畸变按订阅的 ROI 换算内参, 缩放比例由每帧的实际尺寸得出
+    clientApp.undistorter.set_roi(
+        cv::Rect(sub.RoiX, sub.RoiY, sub.RoiWidth, sub.RoiHeight));
+
+    // 保持程序运行, 无界面模式下每秒输出一次处理帧率和端到端延迟
+    unsigned long last_delivered = 0, last_skipped = 0;
+    while (1) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        if (dump_trace.exchange(false)) {
+            std::string path =
+                "trace_" + std::to_string(getpid()) + ".json";
+            if (!Trace::enabled())
+                WARNING("Trace is disabled, rebuild with -DENABLE_TRACE=ON.");
+            else if (Trace::dump(path) >= 0)
+                INFO("Trace written to " + path);
+        }
+        if (!clientApp.headless)
+            continue;
+        unsigned long delivered = decoder->get_delivered();
+        unsigned long skipped = decoder->get_skipped();
+        ClockSync::Estimate clock = { 0, 0 };
+        video_app->get_clock(-1, clock);
+        INFO("Processed " + std::to_string(delivered - last_delivered) +
+             " fps, skipped " + std::to_string(skipped - last_skipped) +
+             " fps, capture to result p50 " +
+             std::to_string(clientApp.end_to_end.percentile(0.5) / 1000) +
+             " us, p99 " +
+             std::to_string(clientApp.end_to_end.percentile(0.99) / 1000) +
+             " us, clock offset " + std::to_string(clock.offset / 1000) +
+             " us (rtt " + std::to_string(clock.rtt / 1000) + " us).");
+        clientApp.end_to_end.reset();
+        last_delivered = delivered;
+        last_skipped = skipped;
+    }
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <eigen3/Eigen/Eigen>
+#include <eigen3/Eigen/Geometry>
+
+#include "Message.hpp"
+#include "PointTransform.hpp"
+
+/**
+ * @brief 重复运行并输出每个点的平均耗时
+ * 
+ * @param name 测试名称
+ * @param points 点数
+ * @param iterations 重复次数
+ * @param run 一次变换全部点
+ * @param error 与逐点 Eigen 结果的最大误差
+ */
+void report(const char *name, size_t points, int iterations,
+            std::function<void()> run, double error)
+{
+    run(); // 预热
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        run();
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - begin)
+                         .count();
+    printf("{\"bench\":\"point_transform\",\"kernel\":\"%s\",\"points\":%zu,"
+           "\"ns_per_point\":%.3f,\"mpoints_per_second\":%.1f,"
+           "\"max_error\":%.3g}\n",
+           name, points, seconds * 1e9 / (points * (double)iterations),
+           points * (double)iterations / seconds / 1e6, error);
+}
+
+int main(int argc, char *argv[])
+{
+    // 用法: point_bench [点数] [重复次数]
+    size_t points = argc > 1 ? std::stoul(argv[1]) : 256;
+    int iterations = argc > 2 ? std::stoi(argv[2]) : 100000;
+
+    // Camera -> Gimbal -> Odom
+    std::vector<Message::TransformData> chain;
+    Eigen::Quaterniond q0(Eigen::AngleAxisd(-M_PI / 2, Eigen::Vector3d::UnitX()));
+    Eigen::Quaterniond q1(Eigen::AngleAxisd(0.65536, Eigen::Vector3d::UnitZ()) *
+                          Eigen::AngleAxisd(0.1145, Eigen::Vector3d::UnitY()));
+    chain.push_back({ { 0.2, 0, 0 }, { q0.x(), q0.y(), q0.z(), q0.w() } });
+    chain.push_back({ { 0, 0, 0.3 }, { q1.x(), q1.y(), q1.z(), q1.w() } });
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> dist(-5, 5);
+    std::vector<double> x(points), y(points), z(points);
+    std::vector<Eigen::Vector3d> aos(points);
+    for (size_t i = 0; i < points; i++) {
+        x[i] = dist(rng);
+        y[i] = dist(rng);
+        z[i] = dist(rng);
+        aos[i] = Eigen::Vector3d(x[i], y[i], z[i]);
+    }
+    std::vector<double> ox(points), oy(points), oz(points);
+    std::vector<Eigen::Vector3d> expected(points);
+
+    // 对照: 逐点用 Eigen 四元数依次应用变换链
+    auto eigen = [&]() {
+        for (size_t i = 0; i < points; i++) {
+            Eigen::Vector3d p = aos[i];
+            for (auto const &tf : chain) {
+                Eigen::Quaterniond q(tf.Rotation[3], tf.Rotation[0],
+                                     tf.Rotation[1], tf.Rotation[2]);
+                p = q * p + Eigen::Vector3d(tf.Translation[0],
+                                            tf.Translation[1],
+                                            tf.Translation[2]);
+            }
+            expected[i] = p;
+        }
+    };
+    eigen();
+    auto error = [&]() {
+        double max = 0;
+        for (size_t i = 0; i < points; i++) {
+            max = std::max(max, std::abs(ox[i] - expected[i].x()));
+            max = std::max(max, std::abs(oy[i] - expected[i].y()));
+            max = std::max(max, std::abs(oz[i] - expected[i].z()));
+        }
+        return max;
+    };
+
+    report("eigen_per_point", points, iterations, eigen, 0);
+
+    PointTransform tf(chain);
+    tf.apply_scalar(x.data(), y.data(), z.data(), ox.data(), oy.data(),
+                    oz.data(), points);
+    report("scalar", points, iterations,
+           [&]() {
+               tf.apply_scalar(x.data(), y.data(), z.data(), ox.data(),
+                               oy.data(), oz.data(), points);
+           },
+           error());
+    if (PointTransform::has_avx2()) {
+        tf.apply_avx2(x.data(), y.data(), z.data(), ox.data(), oy.data(),
+                      oz.data(), points);
+        report("avx2", points, iterations,
+               [&]() {
+                   tf.apply_avx2(x.data(), y.data(), z.data(), ox.data(),
+                                 oy.data(), oz.data(), points);
+               },
+               error());
+    }
+    // 包括每次从变换链构造的开销
+    report("chain_dispatch", points, iterations,
+           [&]() {
+               PointTransform(chain).apply(x.data(), y.data(), z.data(),
+                                           ox.data(), oy.data(), oz.data(),
+                                           points);
+           },
+           error());
+    return 0;
+}
@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "SocketServer.hpp"
+#include "Message.hpp"
+#include "StreamLog.hpp"
+#include "Tool.hpp"
+
+#include <PHOENIX/Utils/Info/Info.hpp>
+
+/**
+ * @brief 回放参数
+ *
+ */
+typedef struct {
+    std::string prefix; ///< 记录文件名前缀
+    double speed = 1; ///< 回放速度倍率, <= 0 表示不等待, 尽快发送
+    int port_offset = 0; ///< 监听端口相对记录中服务器端口的偏移
+    int clients = 1; ///< 每个端口等待的客户端数, 连接齐后开始回放
+    int loop = 1; ///< 回放次数, <= 0 表示无限循环
+} Options;
+
+/**
+ * @brief 回放记录文件
+ *
+ * 记录中的每个来源 (服务器端口) 启动一个 SocketServer, 按记录顺序把原始数据
+ * 广播给连接到对应端口的客户端. 客户端不需要修改, 连接回放程序即可收到与录制时
+ * 相同的数据; 客户端发送的消息被忽略. 录制时的时间戳扩展和 PING/PONG 只对
+ * 录制时的连接有意义, 回放时清除 TIMESTAMP_FLAG 并跳过时钟同步消息
+ *
+ * 用法: replay <prefix> [--speed <倍率>|max] [--port-offset <N>] [--clients <N>] [--loop <N>]
+ */
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        ERROR("Usage: replay <prefix> [--speed <factor>|max] "
+              "[--port-offset <N>] [--clients <N>] [--loop <N>]");
+        return 1;
+    }
+    Options options;
+    options.prefix = argv[1];
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string arg(argv[i]);
+        std::string value(argv[i + 1]);
+        if (arg == "--speed")
+            options.speed = value == "max" ? 0 : std::stod(value);
+        else if (arg == "--port-offset")
+            options.port_offset = std::stoi(value);
+        else if (arg == "--clients")
+            options.clients = std::stoi(value);
+        else if (arg == "--loop")
+            options.loop = std::stoi(value);
+        else
+            WARNING("Unknown option " + arg);
+    }
+
+    ignore_sigpipe();
+
+    // 先扫描一遍, 找出所有来源和记录的时长
+    StreamReader reader(options.prefix);
+    if (!reader.is_open())
+        return 1;
+    StreamReader::Record record;
+    std::map<int, unsigned long> sources;
+    unsigned long total = 0;
+    long long first = 0, last = 0;
+    while (reader.next(record)) {
+        if (total == 0)
+            first = record.time;
+        last = record.time;
+        sources[record.source]++;
+        total++;
+    }
+    if (total == 0) {
+        ERROR("No records in " + options.prefix);
+        return 1;
+    }
+    INFO(std::to_string(total) + " records, " +
+         std::to_string((last - first) / 1e9) + " s recorded.");
+
+    std::map<int, std::unique_ptr<SocketServer>> servers;
+    for (auto &source : sources) {
+        int port = source.first + options.port_offset;
+        servers[source.first] = std::make_unique<SocketServer>(port);
+        servers[source.first]->start();
+        INFO("Source " + std::to_string(source.first) + " (" +
+             std::to_string(source.second) + " records) on port " +
+             std::to_string(port));
+    }
+    INFO("Waiting for clients...");
+    for (auto &server : servers) {
+        while ((int)server.second->get_client_ids().size() < options.clients) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+
+    for (int round = 0; options.loop <= 0 || round < options.loop; round++) {
+        reader.rewind();
+        unsigned long sent = 0, bytes = 0, late = 0, skipped = 0;
+        long long max_lag = 0;
+        auto begin = std::chrono::steady_clock::now();
+        auto report = begin + std::chrono::seconds(1);
+        unsigned long last_sent = 0;
+        // 按录制时的间隔发送一条记录, data 须在发送完成前保持有效
+        auto replay = [&](const char *data) {
+            auto now = std::chrono::steady_clock::now();
+            if (options.speed > 0) {
+                // 按录制时的间隔发送, 落后时不等待, 只统计落后的记录数和最大落后时间
+                auto target = begin + std::chrono::nanoseconds((long long)(
+                                          (record.time - first) / options.speed));
+                if (now < target) {
+                    std::this_thread::sleep_until(target);
+                } else {
+                    long long lag =
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            now - target)
+                            .count();
+                    if (lag > 1000000)
+                        late++;
+                    max_lag = std::max(max_lag, lag);
+                }
+            }
+            servers[record.source]->broadcast(data, record.lenth);
+            sent++;
+            bytes += record.lenth;
+            if (now >= report) {
+                INFO("Replayed " + std::to_string(sent - last_sent) +
+                     " records/s.");
+                last_sent = sent;
+                report += std::chrono::seconds(1);
+            }
+        };
+        while (reader.next(record)) {
+            if (record.lenth != sizeof(Message::MessageBuffer)) {
+                replay(record.data);
+                continue;
+            }
+            Message message(record.data);
+            unsigned short type = message.get_messageType();
+            if (type == Message::MessageType::PING ||
+                type == Message::MessageType::PONG) {
+                skipped++;
+                continue;
+            }
+            // 数据按 Offset 和 DataLenth 定位, 清除标志位后末尾的时间戳扩展
+            // 只是未使用的填充, 客户端不会再用录制时的时钟计算延迟
+            message.set_messageType(type);
+            replay((const char *)message.get_buffer());
+        }
+        double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - begin)
+                             .count();
+        printf("{\"round\":%d,\"records\":%lu,\"seconds\":%.3f,"
+               "\"records_per_second\":%.1f,\"mb_per_second\":%.2f,"
+               "\"late\":%lu,\"max_lag_ms\":%.3f,\"skipped\":%lu}\n",
+               round, sent, seconds, sent / seconds, bytes / seconds / 1e6,
+               late, max_lag / 1e6, skipped);
+        fflush(stdout);
+    }
+    exit_tool(0);
+}
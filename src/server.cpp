@@ -3,10 +3,16 @@
 
 #include <signal.h>
 #include <sstream>
+#include <chrono>
+#include <thread>
 
 #include "SocketServer.hpp"
 #include "Message.hpp"
 #include "Application.hpp"
+#include "BitrateController.hpp"
+#include "ImageSubscription.hpp"
+#include "PoseStore.hpp"
+#include "Log.hpp"
 
 #include <PHOENIX/Utils/Info/Info.hpp>
 
@@ -22,19 +28,47 @@ int main(int argc, char *argv[])
     SocketServer server(std::stoi(argv[1]));
     std::shared_ptr<SocketServer> server_ptr(&server);
     Application<SocketServer> app(server_ptr);
+    // 发送的消息附带时间戳, 客户端可以统计每帧的传输延迟
+    app.set_timestamps(true);
+    // 每秒与客户端交换一次 PING/PONG, 按估计的时钟偏移换算客户端的时间戳
+    app.start_clock_sync(std::chrono::seconds(1));
+    // --metrics <port> 在本机该端口上以 Prometheus 格式导出运行指标
+    // --max-clients <N> 同时连接的客户端数上限, 超出的连接建立后立即断开
+    int max_clients = 16;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::string(argv[i]) == "--max-clients")
+            max_clients = std::stoi(argv[i + 1]);
+        if (std::string(argv[i]) != "--metrics")
+            continue;
+        std::shared_ptr<Metrics> metrics = std::make_shared<Metrics>();
+        server.set_metrics(metrics);
+        app.set_metrics(metrics, "app=\"server\"");
+        Log::set_metrics(metrics);
+        metrics->serve(std::stoi(argv[i + 1]));
+    }
+    // 按客户端自适应调整图像质量
+    std::shared_ptr<BitrateController> bitrate =
+        std::make_shared<BitrateController>();
+    app.set_bitrate_controller(bitrate);
+    // 客户端订阅的分辨率和 ROI
+    std::shared_ptr<ImageSubscriptions> subscriptions =
+        std::make_shared<ImageSubscriptions>();
+    app.set_image_subscriptions(subscriptions);
+    // 客户端上传的观测和预测位姿, 可选第二个参数指定保存文件
+    std::shared_ptr<PoseStore> poses = std::make_shared<PoseStore>(
+        argc > 2 && argv[2][0] != '-' ? argv[2] : "poses.bin");
 
-    // 设置消息处理函数
-    server.set_on_message([&app](int client, const char *message) {
-        Message msg(message);
-        unsigned char *m = app.receive_and_decode(msg); // 解码消息
-        if (m != nullptr && msg.get_messageType() ==
-                                Message::MessageType::STRING_MSG) // 字符串消息
-            INFO("Client " + std::to_string(client) + ": " + // 输出消息
-                 std::string((char *)m));
-        if (m != nullptr && msg.get_messageType() ==
-                                Message::MessageType::IMAGE_MSG) { // 图像消息
-            DEBUG("Image received.");
-            std::vector<unsigned char> data(m, m + msg.get_dataTotalLenth());
+    // 按消息类型注册处理函数, 数据区长度不符的消息由 dispatch 丢弃
+    app.on<Message::STRING_MSG>(
+        [](int client, const MessageView<Message::STRING_MSG> &text) { // 字符串消息
+            LOG_INFO("Client {}: {}", client, // 输出消息
+                     std::string_view(text.begin(),
+                                      strnlen(text.begin(), text.size())));
+        });
+    app.on<Message::IMAGE_MSG>(
+        [](int client, const MessageView<Message::IMAGE_MSG> &jpg) { // 图像消息
+            LOG_DEBUG("Image received.");
+            std::vector<unsigned char> data(jpg.begin(), jpg.end());
             cv::Mat image = cv::imdecode(data, cv::IMREAD_COLOR);
             std::thread([=]() {
                 cv::namedWindow("Client " + std::to_string(client),
@@ -43,25 +77,59 @@ int main(int argc, char *argv[])
                 cv::waitKey(0);
                 cv::destroyAllWindows();
             }).detach(); // 分离显示图像线程
-        }
-        if (m != nullptr)
-            delete[] m; // 释放内存
+        });
+    app.on<Message::IMAGE_SUBSCRIBE>(
+        [subscriptions](int client,
+                        const MessageView<Message::IMAGE_SUBSCRIBE> &sub) { // 图像订阅消息
+            subscriptions->subscribe(client, *sub);
+            LOG_INFO("Client {} subscribed roi ({}, {}, {}, {}), size {}x{}, "
+                     "tiles {}x{}",
+                     client, sub->RoiX, sub->RoiY, sub->RoiWidth,
+                     sub->RoiHeight, sub->Width, sub->Height, sub->TileRows,
+                     sub->TileCols);
+        });
+    // 观测和预测位姿, 高频上传路径, 不输出日志
+    app.on<Message::OBSERVATION>(
+        [poses](int client, const MessageView<Message::OBSERVATION> &batch) {
+            poses->append(client, PoseStore::OBSERVATION, batch.begin(),
+                          batch.size());
+        });
+    app.on<Message::PREDICTION>(
+        [poses](int client, const MessageView<Message::PREDICTION> &batch) {
+            poses->append(client, PoseStore::PREDICTION, batch.begin(),
+                          batch.size());
+        });
+    // 设置消息处理函数
+    server.set_on_message([&app](int client, const char *message) {
+        Message msg(message);
+        unsigned char *m = app.receive_and_decode(msg, client); // 解码消息
+        if (m == nullptr)
+            return;
+        app.dispatch(msg, m, client);
+        delete[] m; // 释放内存
     });
     // 设置连接成功处理函数
-    server.set_on_connect([&app](int client) {
-        if (client > 15) // 最多支持 16 个客户端
+    server.set_on_connect([&app, max_clients](int client) {
+        if (client >= max_clients) { // 超出上限的连接直接断开
+            WARNING("Client " + std::to_string(client) +
+                    " rejected, --max-clients is " +
+                    std::to_string(max_clients));
             app.disconnect(client);
+            return;
+        }
         INFO("Client " + std::to_string(client) +
              " connected."); // 输出连接信息
         // 发送 Hello client 消息
         std::string msg("Hello client " + std::to_string(client) + "\n");
-        app.encode_and_send(Message::MessageType::STRING_MSG, 0,
-                            (unsigned char *)(msg.c_str()), msg.size(), client);
+        app.send<Message::STRING_MSG>(0, msg.data(), msg.size(), client);
     });
     // 设置断开连接处理函数
-    server.set_on_disconnect([&server](int client) {
+    server.set_on_disconnect([&app, bitrate, subscriptions](int client) {
         INFO("Client " + std::to_string(client) +
              " disconnected."); // 输出断开连接信息
+        bitrate->remove(client); // 清除该客户端的码率状态
+        subscriptions->remove(client); // 清除该客户端的图像订阅
+        app.remove_clock(client); // 清除该客户端的时钟偏移估计
     });
     // 添加主动发送消息命令
     app.add_command("sendto", [&app](std::string args) {
@@ -81,9 +149,8 @@ int main(int argc, char *argv[])
         iss >> client;
         std::getline(iss, message);
 
-        app.encode_and_send(Message::MessageType::STRING_MSG, 0,
-                            (unsigned char *)(message.c_str()), message.size(),
-                            client);
+        app.send<Message::STRING_MSG>(0, message.data(), message.size(),
+                                      client);
     });
     // 添加发送图像命令
     app.add_command("sendimage", [&app](std::string args) {
@@ -103,11 +170,7 @@ int main(int argc, char *argv[])
         iss >> client >> image_path;
 
         cv::Mat image = cv::imread(image_path);
-        std::vector<unsigned char> data;
-        cv::imencode(".jpg", image, data);
-
-        app.encode_and_send(Message::MessageType::IMAGE_MSG, 0, data.data(),
-                            data.size(), client);
+        app.encode_and_send(0, image, client);
     });
     // 添加发送视频命令
     app.add_command("sendvideo", [&app](std::string args) {
@@ -128,26 +191,30 @@ int main(int argc, char *argv[])
 
         cv::VideoCapture cap(image_path);
         cv::Mat frame;
-        std::vector<std::vector<unsigned char>> datas;
         int i = 0;
 
-        DEBUG("Processing video...");
-        while (cap.read(frame)) {
-            datas.push_back(std::vector<unsigned char>());
-            cv::imencode(".jpg", frame, datas[i]);
-            i++;
-        }
+        // 发送不再阻塞读取, 按视频帧率读取, 未知时按 30 fps
+        double fps = cap.get(cv::CAP_PROP_FPS);
+        if (fps <= 0)
+            fps = 30;
+        auto interval = std::chrono::duration_cast<
+            std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1.0 / fps));
+        auto next = std::chrono::steady_clock::now();
+
+        // 编码质量随客户端状态逐帧变化, 因此边读取边编码发送
         DEBUG("Sending video...");
-        i = 0;
-        for (auto &data : datas) {
-            if (app.encode_and_send(Message::MessageType::IMAGE_MSG, i,
-                                    data.data(), data.size(), client) < 0) {
+        while (cap.read(frame)) {
+            // 以读出一帧的时间作为采集时间, 客户端据此统计从采集到处理完成的延迟
+            long long capture = ClockSync::now();
+            if (app.encode_and_send(i, frame, client, capture) < 0) {
                 ERROR("Failed to send frame " + std::to_string(i));
                 break;
             }
             i++;
+            next += interval;
+            std::this_thread::sleep_until(next);
         }
-        datas.clear();
         SUCCESS("done.");
     });
     // 添加断开连接命令
@@ -171,6 +238,42 @@ int main(int argc, char *argv[])
             WARNING("client_list: no arguments needed.");
         DEBUG("Connected clients: " + app.get_clients());
     });
+    // 添加查看/设置图像质量命令
+    app.add_command("quality", [&app, bitrate](std::string args) {
+        std::istringstream iss(args);
+        int min_quality, max_quality;
+
+        if (!(iss >> min_quality >> max_quality)) { // 无参数时输出当前质量
+            DEBUG("Image quality:\n" + bitrate->get_qualities());
+            return;
+        }
+        if (min_quality < 0 || max_quality > 100 ||
+            min_quality > max_quality) {
+            ERROR("quality: invalid range.");
+            WARNING("Usage: quality [<min> <max>], 0 <= min <= max <= 100");
+            return;
+        }
+        auto config = bitrate->get_config();
+        config.min_quality = min_quality;
+        config.max_quality = max_quality;
+        std::string scale;
+        if (iss >> scale) // 可选第三个参数 scale 开启分辨率自适应
+            config.adapt_scale = scale == "scale";
+        bitrate->set_config(config);
+        SUCCESS("Quality range set to [" + std::to_string(min_quality) + ", " +
+                std::to_string(max_quality) + "].");
+    });
+    // 添加查看图像订阅命令
+    app.add_command("subscriptions", [subscriptions](std::string args) {
+        int sp = std::count(args.begin(), args.end(), ' ');
+        if (sp > 0)
+            WARNING("subscriptions: no arguments needed.");
+        DEBUG("Image subscriptions:\n" + subscriptions->get_subscriptions());
+    });
+    // 添加查看位姿上传统计命令
+    app.add_command("poses", [poses](std::string args) {
+        DEBUG("Poses: " + poses->get_stats());
+    });
     // 添加清屏命令
     app.add_command("clear", [&app](std::string args) {
         int sp = std::count(args.begin(), args.end(), ' ');
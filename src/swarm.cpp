@@ -0,0 +1,380 @@
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "SocketClient.hpp"
+#include "Message.hpp"
+#include "Application.hpp"
+#include "Log.hpp"
+#include "Tool.hpp"
+
+#include <PHOENIX/Utils/Info/Info.hpp>
+
+/**
+ * @brief 负载参数, 每个模拟客户端相同
+ *
+ */
+typedef struct {
+    std::string host = "127.0.0.1"; ///< 服务器地址
+    int image_port = 8000; ///< 图像服务器端口, <= 0 表示不连接
+    int tf_port = 4399; ///< 坐标变换服务器端口, <= 0 表示不连接
+    int clients = 100; ///< 模拟客户端数
+    double duration = 10; ///< 测试时长, 单位秒
+    bool decode = false; ///< 是否解码接收到的图像
+    unsigned int width = 0, height = 0; ///< 订阅的图像分辨率, 0 表示原图
+    double tf_rate = 30; ///< 每个客户端的 TRANSFORM_REQUEST 频率, 单位 Hz
+    double string_rate = 1; ///< 每个客户端的字符串消息频率, 单位 Hz
+    double timeout = 1; ///< 坐标变换请求超时, 单位秒
+} Options;
+
+/**
+ * @brief 一个模拟客户端的连接和统计
+ *
+ */
+struct SimClient {
+    std::shared_ptr<SocketClient> image_socket, tf_socket; ///< 两个连接
+    std::shared_ptr<Application<SocketClient>> image_app, tf_app; ///< 应用层
+
+    std::atomic<unsigned long> images{ 0 }; ///< 接收的图像数
+    std::atomic<unsigned long> image_bytes{ 0 }; ///< 接收的图像字节数
+    std::atomic<unsigned long> image_gaps{ 0 }; ///< 相邻两帧之间缺少的 dataID 数, 包括服务器自身跳过的 ID, 不等同于网络丢帧
+    long long last_image = -1; ///< 上一帧的 dataID, 只由图像接收线程访问
+    std::atomic<unsigned long> tf_sent{ 0 }; ///< 发送的坐标变换请求数
+    std::atomic<unsigned long> strings_sent{ 0 }; ///< 发送的字符串消息数
+    std::atomic<bool> disconnected{ false }; ///< 被服务器断开, 例如超出服务器的 --max-clients, 不计入统计
+
+    std::mutex mutex; ///< 保护 pending, latencies 和 timeouts
+    std::unordered_map<unsigned int, std::chrono::steady_clock::time_point>
+        pending; ///< 未回复的请求及其发送时间
+    std::vector<double> latencies; ///< 请求往返延迟, 单位毫秒
+    unsigned long timeouts = 0; ///< 超时的请求数
+    unsigned int sequence = 0; ///< 请求 dataID, 只由驱动线程访问
+
+    std::chrono::steady_clock::time_point next_tf, next_string; ///< 下次发送时间
+};
+
+/**
+ * @brief 连接并设置接收回调
+ *
+ * @param options 负载参数
+ * @param client 模拟客户端
+ */
+void connect(const Options &options, SimClient &client)
+{
+    if (options.image_port > 0) {
+        client.image_socket = std::make_shared<SocketClient>(
+            options.host.c_str(), options.image_port);
+        client.image_app = std::make_shared<Application<SocketClient>>(
+            client.image_socket);
+        client.image_socket->set_on_message([&options,
+                                             &client](const char *message) {
+            Message msg(message);
+            unsigned char *m = client.image_app->receive_and_decode(msg);
+            if (m == nullptr)
+                return;
+            if (msg.get_messageType() == Message::MessageType::IMAGE_MSG) {
+                long long id = msg.get_dataID();
+                if (client.last_image >= 0 && id > client.last_image + 1)
+                    client.image_gaps += id - client.last_image - 1;
+                client.last_image = id;
+                client.images++;
+                client.image_bytes += msg.get_dataTotalLenth();
+                if (options.decode) {
+                    cv::Mat image = cv::imdecode(
+                        cv::Mat(1, msg.get_dataTotalLenth(), CV_8U, m),
+                        cv::IMREAD_COLOR);
+                    if (image.empty())
+                        LOG_WARNING("Failed to decode image {}.", id);
+                }
+            }
+            delete[] m;
+        });
+        client.image_socket->set_on_disconnect(
+            [&client]() { client.disconnected = true; });
+        client.image_socket->connect();
+        if (options.width > 0 && options.height > 0) {
+            Message::ImageSubscribeData sub = { 0, 0, 0, 0, options.width,
+                                                options.height, 0, 0 };
+            client.image_app->send<Message::IMAGE_SUBSCRIBE>(0, sub, 0);
+        }
+    }
+    if (options.tf_port > 0) {
+        client.tf_socket = std::make_shared<SocketClient>(options.host.c_str(),
+                                                          options.tf_port);
+        client.tf_app =
+            std::make_shared<Application<SocketClient>>(client.tf_socket);
+        client.tf_socket->set_on_message([&client](const char *message) {
+            Message msg(message);
+            unsigned char *m = client.tf_app->receive_and_decode(msg);
+            if (m == nullptr)
+                return;
+            // 回复使用请求的 dataID, 在接收线程中计算往返延迟
+            if (msg.get_messageType() == Message::MessageType::TRANSFORM) {
+                auto now = std::chrono::steady_clock::now();
+                std::lock_guard<std::mutex> lock(client.mutex);
+                auto it = client.pending.find(msg.get_dataID());
+                if (it != client.pending.end()) {
+                    client.latencies.push_back(
+                        std::chrono::duration<double, std::milli>(now -
+                                                                  it->second)
+                            .count());
+                    client.pending.erase(it);
+                }
+            }
+            delete[] m;
+        });
+        client.tf_socket->set_on_disconnect(
+            [&client]() { client.disconnected = true; });
+        client.tf_socket->connect();
+    }
+}
+
+/**
+ * @brief 驱动线程, 按频率为一组客户端发送请求和字符串消息
+ *
+ * @param options 负载参数
+ * @param clients 该线程负责的客户端
+ * @param end 结束时间
+ */
+void drive(const Options &options, std::vector<SimClient *> clients,
+           std::chrono::steady_clock::time_point end)
+{
+    using namespace std::chrono;
+    auto tf_period = duration_cast<steady_clock::duration>(
+        duration<double>(options.tf_rate > 0 ? 1.0 / options.tf_rate : 0));
+    auto string_period = duration_cast<steady_clock::duration>(
+        duration<double>(options.string_rate > 0 ? 1.0 / options.string_rate :
+                                                   0));
+    auto timeout = duration_cast<steady_clock::duration>(
+        duration<double>(options.timeout));
+
+    Message::TransformRequestData request;
+    memset(&request, 0, sizeof(request));
+    strcpy(request.From, "Camera");
+    strcpy(request.To, "Odom");
+    std::string text("swarm client\n");
+
+    while (steady_clock::now() < end) {
+        auto now = steady_clock::now();
+        auto wake = end;
+        for (auto client : clients) {
+            if (client->disconnected) // 连接已关闭, 不再发送
+                continue;
+            if (client->tf_app != nullptr && options.tf_rate > 0) {
+                if (now >= client->next_tf) {
+                    unsigned int id = client->sequence++;
+                    {
+                        std::lock_guard<std::mutex> lock(client->mutex);
+                        client->pending[id] = steady_clock::now();
+                        // 清理超时的请求
+                        for (auto it = client->pending.begin();
+                             it != client->pending.end();) {
+                            if (now - it->second > timeout) {
+                                client->timeouts++;
+                                it = client->pending.erase(it);
+                            } else {
+                                it++;
+                            }
+                        }
+                    }
+                    client->tf_app->send<Message::TRANSFORM_REQUEST>(
+                        id, request, 0);
+                    client->tf_sent++;
+                    client->next_tf += tf_period;
+                    if (client->next_tf < now) // 发送落后时不补发
+                        client->next_tf = now + tf_period;
+                }
+                wake = std::min(wake, client->next_tf);
+            }
+            if (client->image_app != nullptr && options.string_rate > 0) {
+                if (now >= client->next_string) {
+                    client->image_app->send<Message::STRING_MSG>(
+                        0, text.c_str(), text.size() + 1, 0);
+                    client->strings_sent++;
+                    client->next_string += string_period;
+                    if (client->next_string < now)
+                        client->next_string = now + string_period;
+                }
+                wake = std::min(wake, client->next_string);
+            }
+        }
+        std::this_thread::sleep_until(wake);
+    }
+}
+
+/**
+ * @brief 计算百分位数
+ *
+ * @param sorted 已排序的样本
+ * @param p 百分位, 0 ~ 1
+ * @return double 样本为空时返回 0
+ */
+double percentile(const std::vector<double> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    return sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "--decode") { // 不带参数的开关
+            options.decode = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            WARNING("Missing value for " + arg);
+            break;
+        }
+        std::string value(argv[++i]);
+        if (arg == "--host")
+            options.host = value;
+        else if (arg == "--image-port")
+            options.image_port = std::stoi(value);
+        else if (arg == "--tf-port")
+            options.tf_port = std::stoi(value);
+        else if (arg == "--clients")
+            options.clients = std::stoi(value);
+        else if (arg == "--duration")
+            options.duration = std::stod(value);
+        else if (arg == "--size")
+            sscanf(value.c_str(), "%ux%u", &options.width, &options.height);
+        else if (arg == "--tf-rate")
+            options.tf_rate = std::stod(value);
+        else if (arg == "--string-rate")
+            options.string_rate = std::stod(value);
+        else if (arg == "--timeout")
+            options.timeout = std::stod(value);
+        else
+            WARNING("Unknown option " + arg);
+    }
+
+    ignore_sigpipe();
+
+    std::vector<std::unique_ptr<SimClient>> clients;
+    for (int i = 0; i < options.clients; i++) {
+        clients.push_back(std::make_unique<SimClient>());
+        connect(options, *clients.back());
+    }
+    INFO(std::to_string(options.clients) + " clients connected.");
+    // 服务器默认最多接受 16 个客户端, 超出的连接建立后立即被断开
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    auto count_disconnected = [&clients]() {
+        int n = 0;
+        for (auto &client : clients) {
+            n += client->disconnected;
+        }
+        return n;
+    };
+    if (count_disconnected() > 0)
+        WARNING(std::to_string(count_disconnected()) +
+                " clients were disconnected by the server, start the server "
+                "with a larger --max-clients to simulate all of them.");
+
+    // 客户端均分给驱动线程, 发送时间错开, 避免所有请求同时到达
+    auto begin = std::chrono::steady_clock::now();
+    auto end = begin + std::chrono::duration_cast<
+                           std::chrono::steady_clock::duration>(
+                           std::chrono::duration<double>(options.duration));
+    int drivers = std::max(
+        1, std::min(options.clients,
+                    (int)std::thread::hardware_concurrency() / 2));
+    std::vector<std::vector<SimClient *>> groups(drivers);
+    for (int i = 0; i < options.clients; i++) {
+        auto offset = std::chrono::duration_cast<
+            std::chrono::steady_clock::duration>(std::chrono::duration<double>(
+            options.tf_rate > 0 ? (double)i / options.clients / options.tf_rate :
+                                  0));
+        clients[i]->next_tf = begin + offset;
+        clients[i]->next_string = begin + offset;
+        groups[i % drivers].push_back(clients[i].get());
+    }
+    std::vector<std::thread> threads;
+    for (auto &group : groups) {
+        threads.push_back(std::thread(drive, std::cref(options), group, end));
+    }
+
+    // 每秒输出一次汇总
+    unsigned long last_images = 0, last_replies = 0;
+    while (std::chrono::steady_clock::now() < end) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        unsigned long images = 0, replies = 0;
+        for (auto &client : clients) {
+            images += client->images;
+            std::lock_guard<std::mutex> lock(client->mutex);
+            replies += client->latencies.size();
+        }
+        INFO("images/s: " + std::to_string(images - last_images) +
+             ", tf replies/s: " + std::to_string(replies - last_replies));
+        last_images = images;
+        last_replies = replies;
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - begin)
+                         .count();
+    // 等待最后一批回复
+    std::this_thread::sleep_for(std::chrono::duration_cast<
+                                std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(std::min(options.timeout, 1.0))));
+
+    // 每个客户端一行 JSON, 最后一行为汇总; 被服务器断开的客户端只标记, 不计入汇总
+    std::vector<double> all;
+    unsigned long images = 0, bytes = 0, gaps = 0, sent = 0, timeouts = 0;
+    int disconnected = 0;
+    for (size_t i = 0; i < clients.size(); i++) {
+        SimClient &c = *clients[i];
+        if (c.disconnected) {
+            printf("{\"client\":%zu,\"disconnected\":true}\n", i);
+            disconnected++;
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(c.mutex);
+        unsigned long lost = c.timeouts + c.pending.size();
+        std::sort(c.latencies.begin(), c.latencies.end());
+        printf("{\"client\":%zu,\"images_per_second\":%.1f,"
+               "\"mb_per_second\":%.2f,\"image_gaps\":%lu,\"tf_sent\":%lu,"
+               "\"tf_replies\":%zu,\"tf_lost\":%lu,\"strings_sent\":%lu,"
+               "\"p50_ms\":%.3f,\"p99_ms\":%.3f,\"max_ms\":%.3f}\n",
+               i, c.images / seconds, c.image_bytes / seconds / 1e6,
+               c.image_gaps.load(), c.tf_sent.load(), c.latencies.size(),
+               lost, c.strings_sent.load(), percentile(c.latencies, 0.5),
+               percentile(c.latencies, 0.99),
+               c.latencies.empty() ? 0 : c.latencies.back());
+        all.insert(all.end(), c.latencies.begin(), c.latencies.end());
+        images += c.images;
+        bytes += c.image_bytes;
+        gaps += c.image_gaps;
+        sent += c.tf_sent;
+        timeouts += lost;
+    }
+    std::sort(all.begin(), all.end());
+    printf("{\"summary\":true,\"clients\":%d,\"disconnected\":%d,"
+           "\"seconds\":%.1f,"
+           "\"images_per_second\":%.1f,\"mb_per_second\":%.2f,"
+           "\"image_gaps\":%lu,\"tf_sent\":%lu,\"tf_replies\":%zu,"
+           "\"tf_lost\":%lu,\"p50_ms\":%.3f,\"p90_ms\":%.3f,"
+           "\"p99_ms\":%.3f,\"p999_ms\":%.3f,\"max_ms\":%.3f}\n",
+           options.clients - disconnected, disconnected, seconds,
+           images / seconds, bytes / seconds / 1e6,
+           gaps, sent, all.size(), timeouts, percentile(all, 0.5),
+           percentile(all, 0.9), percentile(all, 0.99),
+           percentile(all, 0.999), all.empty() ? 0 : all.back());
+
+    exit_tool(0);
+}
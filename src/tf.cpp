@@ -5,18 +5,17 @@
 #include <sstream>
 #include <fstream>
 
-#include <PHOENIX/Transformer/TransformTree.hpp>
-
-#include <eigen3/Eigen/Eigen>
-#include <eigen3/Eigen/Geometry>
-
-#include <boost/json.hpp>
-#include <boost/json/src.hpp>
-#include <boost/filesystem.hpp>
+#include <chrono>
+#include <cstring>
+#include <string_view>
+#include <vector>
 
 #include "SocketServer.hpp"
 #include "Message.hpp"
 #include "Application.hpp"
+#include "TransformLookup.hpp"
+#include "TransformPublisher.hpp"
+#include "Log.hpp"
 
 int main(int argc, char *argv[])
 {
@@ -30,69 +29,147 @@ int main(int argc, char *argv[])
     SocketServer server(4399);
     std::shared_ptr<SocketServer> server_ptr(&server);
     Application<SocketServer> app(server_ptr);
-
-    // 坐标转换树
-    PHOENIX::TransformTree tt;
-    // 读取外部文件中的坐标转换信息
-    boost::filesystem::path p("../asset/tf.json");
-    std::ifstream ifs(p);
-    std::string jsonstr((std::istreambuf_iterator<char>(ifs)),
-                        std::istreambuf_iterator<char>());
-    boost::json::value jv = boost::json::parse(jsonstr);
-    boost::json::object jo = jv.as_object();
-    auto transforms = jo.at("transform").as_array();
-    for (auto &tf : transforms) {
-        auto from = tf.at("from").as_string().c_str();
-        auto to = tf.at("to").as_string().c_str();
-        auto translation = tf.at("translation").as_array();
-        auto rotation = tf.at("rotation").as_array();
-        tt.addTransform(
-            from, to,
-            PHOENIX::Transform(Eigen::Vector3d(translation.at(0).as_double(),
-                                               translation.at(1).as_double(),
-                                               translation.at(2).as_double()),
-                               Eigen::Vector3d(rotation.at(2).as_double(),
-                                               rotation.at(1).as_double(),
-                                               rotation.at(0).as_double())));
+    app.set_timestamps(true);
+    app.start_clock_sync(std::chrono::seconds(1));
+    // --metrics <port> 在本机该端口上以 Prometheus 格式导出运行指标
+    // --max-clients <N> 同时连接的客户端数上限, 超出的连接建立后立即断开
+    int max_clients = 16;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::string(argv[i]) == "--max-clients")
+            max_clients = std::stoi(argv[i + 1]);
+        if (std::string(argv[i]) != "--metrics")
+            continue;
+        std::shared_ptr<Metrics> metrics = std::make_shared<Metrics>();
+        server.set_metrics(metrics);
+        app.set_metrics(metrics, "app=\"tf_server\"");
+        Log::set_metrics(metrics);
+        metrics->serve(std::stoi(argv[i + 1]));
     }
+
+    // 带缓存的坐标转换树, 读取外部文件中的坐标转换信息
+    TransformLookup tt;
+    tt.load("../asset/tf.json");
+    // 坐标变换订阅推送
+    TransformPublisher publisher(
+        [&](const std::string &from, const std::string &to,
+            Message::TransformData &data) {
+            return tt.lookup(from, to, data);
+        },
+        [&](int client, unsigned int id, const Message::TransformData &data) {
+            return app.send<Message::TRANSFORM>(id, data, client);
+        });
+    // 文件修改后重新加载, 并向订阅了变化推送的客户端推送新值
+    tt.watch("../asset/tf.json", [&](int) { publisher.notify(); });
+    // 按消息类型注册处理函数, 数据区长度不符的消息由 dispatch 丢弃
+    app.on<Message::TRANSFORM_REQUEST>(
+        [&](int client,
+            const MessageView<Message::TRANSFORM_REQUEST> &request) {
+            // 直接引用请求中的字符数组, 不构造 std::string
+            std::string_view from(request->From,
+                                  strnlen(request->From, sizeof(request->From)));
+            std::string_view to(request->To,
+                                strnlen(request->To, sizeof(request->To)));
+
+            LOG_INFO("Request transform from {} to {}", from, to);
+            Message::TransformData transform_data;
+            if (!tt.lookup(from, to, transform_data)) { // 获取坐标转换
+                LOG_WARNING("Unknown transform from {} to {}", from, to);
+                return;
+            }
+            // 回复使用请求的 dataID, 客户端据此匹配请求
+            app.send<Message::TRANSFORM>(request.get_dataID(), transform_data,
+                                         client);
+            LOG_SUCCESS("Transform sent.");
+        });
+    // 请求指定时刻的坐标转换
+    app.on<Message::TRANSFORM_REQUEST_STAMPED>(
+        [&](int client,
+            const MessageView<Message::TRANSFORM_REQUEST_STAMPED> &request) {
+            std::string_view from(request->From,
+                                  strnlen(request->From, sizeof(request->From)));
+            std::string_view to(request->To,
+                                strnlen(request->To, sizeof(request->To)));
+
+            Message::TransformData transform_data;
+            if (!tt.lookup(from, to, request->Stamp, transform_data)) {
+                LOG_WARNING("No transform from {} to {} at {}", from, to,
+                            request->Stamp);
+                return;
+            }
+            app.send<Message::TRANSFORM>(request.get_dataID(), transform_data,
+                                         client);
+        });
+    // 发布坐标变换
+    app.on<Message::TRANSFORM_PUBLISH>(
+        [&](int client, const MessageView<Message::TRANSFORM_PUBLISH> &pub) {
+            std::string_view from(pub->From,
+                                  strnlen(pub->From, sizeof(pub->From)));
+            std::string_view to(pub->To, strnlen(pub->To, sizeof(pub->To)));
+            long long stamp = pub->Stamp;
+            if (stamp == 0)
+                stamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::system_clock::now().time_since_epoch())
+                            .count();
+            // 高频发布路径, 不输出日志
+            if (tt.publish(from, to, pub->Transform, stamp))
+                publisher.notify();
+        });
+    // 批量请求坐标转换
+    app.on<Message::TRANSFORM_BATCH_REQUEST>(
+        [&](int client,
+            const MessageView<Message::TRANSFORM_BATCH_REQUEST> &request) {
+            std::vector<std::pair<int, int>> ids(request.size());
+            for (unsigned int i = 0; i < request.size(); i++) {
+                ids[i].first = tt.find(std::string_view(
+                    request[i].From,
+                    strnlen(request[i].From, sizeof(request[i].From))));
+                ids[i].second = tt.find(std::string_view(
+                    request[i].To,
+                    strnlen(request[i].To, sizeof(request[i].To))));
+            }
+            // 回复与请求使用相同的头部, 后接每个坐标系对的结果
+            std::vector<Message::TransformBatchResult> results(request.size());
+            tt.lookup(ids, request->Stamp, results.data());
+            app.send<Message::TRANSFORM_BATCH>(request.get_dataID(), *request,
+                                               results.data(), results.size(),
+                                               client);
+        });
+    // 订阅坐标变换
+    app.on<Message::TRANSFORM_SUBSCRIBE>(
+        [&](int client, const MessageView<Message::TRANSFORM_SUBSCRIBE> &sub) {
+            LOG_INFO("Client {} subscribe transform #{}", client,
+                     sub.get_dataID());
+            publisher.subscribe(client, sub.get_dataID(), *sub);
+        });
     // 设置消息处理函数
     server.set_on_message([&](int client, const char *message) {
         Message msg(message);
-        unsigned char *m = app.receive_and_decode(msg);
-        if (m != nullptr &&
-            msg.get_messageType() == Message::MessageType::TRANSFORM_REQUEST) { // 请求坐标转换消息
-            std::string from =
-                std::string(((Message::TransformRequestData *)m)->From);
-            std::string to =
-                std::string(((Message::TransformRequestData *)m)->To);
-
-            INFO("Request transform from " + from + " to " + to);
-            auto tf = tt.getTransform(from, to);    // 获取坐标转换
-            double transform_data[3 + 4] = {
-                tf.translation.x(), tf.translation.y(), tf.translation.z(),
-                tf.rotation.x(),    tf.rotation.y(),    tf.rotation.z(),
-                tf.rotation.w()
-            };
-            app.encode_and_send(Message::MessageType::TRANSFORM, 0,
-                                (unsigned char *)(transform_data),
-                                sizeof(transform_data), client);
-            SUCCESS("Transform sent.");
-        }
+        unsigned char *m = app.receive_and_decode(msg, client);
+        if (m == nullptr)
+            return;
+        app.dispatch(msg, m, client);
+        delete[] m; // 释放内存
     });
     // 设置连接成功处理函数
     server.set_on_connect([&](int client) {
-        if (client > 15)    // 最多支持 16 个客户端
+        if (client >= max_clients) { // 超出上限的连接直接断开
+            WARNING("Client " + std::to_string(client) +
+                    " rejected, --max-clients is " +
+                    std::to_string(max_clients));
             app.disconnect(client);
+            return;
+        }
         INFO("Client " + std::to_string(client) +
              " connected."); // 输出连接信息
         // 发送 Hello client 消息
         std::string msg("Hello client " + std::to_string(client) + "\n");
-        app.encode_and_send(Message::MessageType::STRING_MSG, 0,
-                            (unsigned char *)(msg.c_str()), msg.size(), client);
+        app.send<Message::STRING_MSG>(0, msg.data(), msg.size(), client);
     });
     // 设置断开连接处理函数
     server.set_on_disconnect([&](int client) {
         INFO("Client " + std::to_string(client) + " disconnected.");
+        publisher.remove(client); // 删除该客户端的订阅
+        app.remove_clock(client); // 删除该客户端的时钟偏移估计
     });
     // 添加主动发送消息命令
     app.add_command("send_tf", [&](std::string args) {
@@ -108,19 +185,28 @@ int main(int argc, char *argv[])
 
         iss >> client >> from >> to;
 
-        auto tf = tt.getTransform(from, to);
-        double transform_data[3 + 4] = { tf.translation.x(), tf.translation.y(),
-                                         tf.translation.z(), tf.rotation.x(),
-                                         tf.rotation.y(),    tf.rotation.z(),
-                                         tf.rotation.w() };
-        app.encode_and_send(Message::MessageType::TRANSFORM, 0,
-                            (unsigned char *)(transform_data),
-                            sizeof(transform_data), client);
+        Message::TransformData transform_data;
+        if (!tt.lookup(from, to, transform_data)) {
+            ERROR("Unknown transform from " + from + " to " + to);
+            return;
+        }
+        app.send<Message::TRANSFORM>(0, transform_data, client);
         SUCCESS("Transform sent.");
     });
 
+    // 添加查看坐标变换订阅命令
+    app.add_command("tf_subscriptions", [&](std::string args) {
+        DEBUG("Transform subscriptions:\n" + publisher.get_subscriptions());
+    });
+    // 添加查看坐标变换缓存统计命令
+    app.add_command("tf_stats", [&](std::string args) {
+        DEBUG("Transform lookup: " + tt.get_stats());
+    });
+
     server.start();
     app.join();
+    // publisher 先于 tt 析构, 先停止会调用 publisher.notify() 的文件监视线程
+    tt.unwatch();
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,246 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/json.hpp>
+
+#include <PHOENIX/Transformer/TransformTree.hpp>
+
+#include "Message.hpp"
+#include "TransformLookup.hpp"
+
+/**
+ * @brief 模拟 tf_server 处理 TRANSFORM_REQUEST 的查询开销
+ * 
+ * @param lookup 坐标变换查询
+ * @param requests 请求列表
+ * @param threads 并发线程数
+ * @param seconds 测试时长
+ * @return double 每秒请求数
+ */
+double run(TransformLookup &lookup,
+           const std::vector<Message::TransformRequestData> &requests,
+           int threads, double seconds)
+{
+    std::atomic<bool> stop(false);
+    std::atomic<unsigned long> total(0);
+    std::vector<std::thread> tt;
+
+    for (int t = 0; t < threads; t++) {
+        tt.push_back(std::thread([&, t]() {
+            unsigned long count = 0;
+            size_t i = t;
+            Message::TransformData data;
+            while (!stop.load(std::memory_order_relaxed)) {
+                auto &request = requests[i++ % requests.size()];
+                std::string_view from(
+                    request.From, strnlen(request.From, sizeof(request.From)));
+                std::string_view to(request.To,
+                                    strnlen(request.To, sizeof(request.To)));
+                lookup.lookup(from, to, data);
+                count++;
+            }
+            total += count;
+        }));
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    for (auto &t : tt) {
+        t.join();
+    }
+    return total / seconds;
+}
+
+/**
+ * @brief 一个线程持续发布 Odom -> Gimbal, 其余线程同时查询
+ * 
+ * @param path tf.json 路径
+ * @param threads 查询线程数
+ * @param seconds 测试时长
+ * @param rate 发布频率, 0 表示不限速
+ * @return true 测试完成
+ */
+bool contention(const std::string &path, int threads, double seconds,
+                double rate)
+{
+    TransformLookup lookup;
+    if (!lookup.load(path))
+        return false;
+    auto now = []() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::system_clock::now().time_since_epoch())
+            .count();
+    };
+
+    std::atomic<bool> stop(false);
+    std::atomic<unsigned long> published(0), latest(0), stamped(0);
+    std::thread writer([&]() {
+        Message::TransformData data = { { 0, 0, 0 }, { 0, 0, 0, 1 } };
+        auto period = std::chrono::duration<double>(rate > 0 ? 1.0 / rate : 0);
+        auto next = std::chrono::steady_clock::now();
+        unsigned long count = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+            double angle = (count % 1000) * 0.001;
+            data.Rotation[2] = std::sin(angle / 2);
+            data.Rotation[3] = std::cos(angle / 2);
+            lookup.publish("Odom", "Gimbal", data, now());
+            count++;
+            if (rate > 0) {
+                next += std::chrono::duration_cast<
+                    std::chrono::steady_clock::duration>(period);
+                std::this_thread::sleep_until(next);
+            }
+        }
+        published = count;
+    });
+    std::vector<std::thread> readers;
+    for (int t = 0; t < threads; t++) {
+        readers.push_back(std::thread([&]() {
+            int camera = lookup.find("Camera");
+            int odom = lookup.find("Odom");
+            unsigned long count = 0, count_stamped = 0;
+            Message::TransformData data;
+            while (!stop.load(std::memory_order_relaxed)) {
+                lookup.lookup(camera, odom, data);
+                count++;
+                // 查询 8ms 前的位姿, 落在历史采样之间
+                if (lookup.lookup(camera, odom, now() - 8000000, data))
+                    count_stamped++;
+            }
+            latest += count;
+            stamped += count_stamped;
+        }));
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    writer.join();
+    for (auto &t : readers) {
+        t.join();
+    }
+    printf("{\"bench\":\"tf_contention\",\"readers\":%d,\"rate\":%.0f,"
+           "\"publish_per_second\":%.0f,\"lookup_per_second\":%.0f,"
+           "\"stamped_lookup_per_second\":%.0f}\n",
+           threads, rate, published / seconds, latest / seconds,
+           stamped / seconds);
+    return true;
+}
+
+/**
+ * @brief 对比 TransformLookup 与 PHOENIX::TransformTree::getTransform 的查询结果
+ *
+ * 按原 tf_server 的方式把文件中的坐标变换加入 TransformTree, 对所有坐标系对分别查询,
+ * 平移误差和旋转夹角都不超过 tolerance 时通过
+ *
+ * @param path tf.json 路径
+ * @param tolerance 允许的误差
+ * @return true 所有坐标系对的结果一致
+ */
+bool verify(const std::string &path, double tolerance)
+{
+    TransformLookup lookup;
+    if (!lookup.load(path))
+        return false;
+    PHOENIX::TransformTree tree;
+    std::set<std::string> frames;
+    std::ifstream ifs(path);
+    std::string jsonstr((std::istreambuf_iterator<char>(ifs)),
+                        std::istreambuf_iterator<char>());
+    auto transforms =
+        boost::json::parse(jsonstr).as_object().at("transform").as_array();
+    for (auto &tf : transforms) {
+        std::string from = tf.at("from").as_string().c_str();
+        std::string to = tf.at("to").as_string().c_str();
+        auto translation = tf.at("translation").as_array();
+        auto rotation = tf.at("rotation").as_array();
+        tree.addTransform(
+            from, to,
+            PHOENIX::Transform(Eigen::Vector3d(translation.at(0).as_double(),
+                                               translation.at(1).as_double(),
+                                               translation.at(2).as_double()),
+                               Eigen::Vector3d(rotation.at(2).as_double(),
+                                               rotation.at(1).as_double(),
+                                               rotation.at(0).as_double())));
+        frames.insert(from);
+        frames.insert(to);
+    }
+
+    int pairs = 0, failed = 0;
+    double max_translation = 0, max_rotation = 0;
+    for (auto &from : frames) {
+        for (auto &to : frames) {
+            auto expected = tree.getTransform(from, to);
+            Message::TransformData data;
+            pairs++;
+            if (!lookup.lookup(from, to, data)) {
+                failed++;
+                continue;
+            }
+            Eigen::Vector3d translation(data.Translation[0],
+                                        data.Translation[1],
+                                        data.Translation[2]);
+            Eigen::Quaterniond rotation(data.Rotation[3], data.Rotation[0],
+                                        data.Rotation[1], data.Rotation[2]);
+            double dt = (translation - expected.translation).norm();
+            double dr = rotation.angularDistance(expected.rotation);
+            max_translation = std::max(max_translation, dt);
+            max_rotation = std::max(max_rotation, dr);
+            if (dt > tolerance || dr > tolerance) {
+                failed++;
+                fprintf(stderr, "mismatch %s -> %s: translation %g, rotation %g\n",
+                        from.c_str(), to.c_str(), dt, dr);
+            }
+        }
+    }
+    printf("{\"bench\":\"tf_verify\",\"pairs\":%d,\"failed\":%d,"
+           "\"max_translation_error\":%g,\"max_rotation_error\":%g}\n",
+           pairs, failed, max_translation, max_rotation);
+    return failed == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    // 用法: tf_bench [tf.json] [线程数] [每项测试秒数]
+    std::string path = argc > 1 ? argv[1] : "../asset/tf.json";
+    int threads = argc > 2 ? std::stoi(argv[2]) : 1;
+    double seconds = argc > 3 ? std::stod(argv[3]) : 2.0;
+
+    // 先确认带缓存的查询与原 TransformTree 的结果一致, 不一致时不测性能
+    if (!verify(path, 1e-9))
+        return 1;
+
+    const char *frames[] = { "Odom", "Gimbal", "Camera", "Shooter" };
+    std::vector<Message::TransformRequestData> requests;
+    for (auto from : frames) {
+        for (auto to : frames) {
+            Message::TransformRequestData request;
+            memset(&request, 0, sizeof(request));
+            strncpy(request.From, from, sizeof(request.From) - 1);
+            strncpy(request.To, to, sizeof(request.To) - 1);
+            requests.push_back(request);
+        }
+    }
+
+    for (bool cache : { false, true }) {
+        TransformLookup lookup(cache);
+        if (!lookup.load(path))
+            return 1;
+        double rate = run(lookup, requests, threads, seconds);
+        printf("{\"bench\":\"tf_lookup\",\"cache\":%s,\"threads\":%d,"
+               "\"requests_per_second\":%.0f}\n",
+               cache ? "true" : "false", threads, rate);
+    }
+    // 发布和查询并发: 不限速发布, 以及云台控制器的 1kHz 发布
+    for (double rate : { 0.0, 1000.0 }) {
+        if (!contention(path, threads, seconds, rate))
+            return 1;
+    }
+    return 0;
+}